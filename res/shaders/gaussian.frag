@@ -7,14 +7,37 @@ flat in int frag_draw_mode;
 
 out vec4 frag_color_out;
 
+// See gaussian.vert
+uniform layout(location = 7) bool count_stats;
+
+layout (std430, binding = 8) buffer FrameCounters {
+    uint visible;
+    uint quads;
+    uint quad_area[2];
+    uint shaded[2];
+    uint discarded[2];
+} counters;
+
+#define ATOMIC_ADD64(words, value) if (atomicAdd(words[0], value) > 0xffffffffu - (value)) atomicAdd(words[1], 1u)
+
+// Fragments per pixel in the overdraw mode
+layout (r32ui, binding = 0) uniform uimage2D overdraw_counts;
+
 void main() {
+    if (count_stats) {
+        ATOMIC_ADD64(counters.shaded, 1u);
+    }
     float power = -0.5f * (conic.x * coordxy.x * coordxy.x + conic.z * coordxy.y * coordxy.y) - conic.y * coordxy.x * coordxy.y;
     float alpha = min(0.99f, frag_alpha * exp(power));
 
     // Normal
     if (frag_draw_mode == 0) {
-        if(power > 0.0f) discard;
-        if(alpha < 1.f / 255.f) discard;
+        if (power > 0.0f || alpha < 1.f / 255.f) {
+            if (count_stats) {
+                ATOMIC_ADD64(counters.discarded, 1u);
+            }
+            discard;
+        }
         frag_color_out = vec4(frag_color, alpha);
     } 
     // Quad
@@ -31,4 +54,9 @@ void main() {
     else if (frag_draw_mode == 3) {
         frag_color_out = vec4(frag_color, alpha);
     }
+    // Overdraw, every fragment counts and the heatmap is drawn afterwards
+    else if (frag_draw_mode == 5) {
+        imageAtomicAdd(overdraw_counts, ivec2(gl_FragCoord.xy), 1u);
+        frag_color_out = vec4(0.0);
+    }
 }
@@ -4,12 +4,18 @@
 
 layout (location = 0) in vec2 quadVertex;
 
-// Per-instance attributes
-layout (location = 2) in vec3 position_ws;
+// Per-instance attributes, all read from one interleaved record per splat (see splatLayout.hpp)
+layout (location = 2) in vec3 position;
 layout (location = 3) in vec3 color;
 layout (location = 4) in vec3 scale;
 layout (location = 5) in float alpha;
 layout (location = 6) in vec4 rotation;
+// Only used with chunked positions, `position` is then relative to the chunk origin
+layout (location = 7) in uint chunk_index;
+
+layout (std430, binding = 0) readonly buffer ChunkOrigins {
+    vec4 chunk_origins[];
+};
 
 uniform layout(location = 0) mat4 VP;
 uniform layout(location = 1) float scale_multipler;
@@ -17,12 +23,28 @@ uniform layout(location = 2) mat4 view_matrix;
 uniform layout(location = 3) mat4 projection_matrix;
 uniform layout(location = 4) vec3 hfov_focal;
 uniform layout(location = 5) int draw_mode;
+uniform layout(location = 6) bool chunked_positions;
+// Fill the counters below, see frameStats.hpp
+uniform layout(location = 7) bool count_stats;
+uniform layout(location = 8) vec2 viewport_size;
 // Draw modes:
 //     Normal = 0
 //     Quad = 1
 //     Albedo = 2
 //     Depth = 3
 //     Point_Cloud = 4
+//     Overdraw = 5
+
+layout (std430, binding = 8) buffer FrameCounters {
+    uint visible;
+    uint quads;
+    uint quad_area[2];
+    uint shaded[2];
+    uint discarded[2];
+} counters;
+
+// Adds to a 64 bit counter kept as a low and a high word
+#define ATOMIC_ADD64(words, value) if (atomicAdd(words[0], value) > 0xffffffffu - (value)) atomicAdd(words[1], 1u)
 
 // To fragment shader
 out vec3 frag_color;
@@ -108,6 +130,7 @@ vec3 default_hvof_focal() {
 
 void main() { 
     vec3 hfov = default_hvof_focal();
+    vec3 position_ws = chunked_positions ? chunk_origins[chunk_index].xyz + position : position;
 
     // Near culling, made no performance benefit
     // vec4 p_view = view_matrix * vec4(position_ws, 1);
@@ -151,6 +174,13 @@ void main() {
     position_2d.xy = position_2d.xy + quadVertex * quad_ndc;
     gl_Position = position_2d;
 
+    // Index 1 is the only corner the quad doesn't share between its triangles, so it is counted once
+    if (count_stats && gl_VertexID == 1) {
+        atomicAdd(counters.quads, 1u);
+        vec2 quad_pixels = min(quad_ndc * viewport_size, viewport_size * 4.0);
+        ATOMIC_ADD64(counters.quad_area, uint(quad_pixels.x * quad_pixels.y + 0.5));
+    }
+
     // Send values to fragment shader 
 
     if (draw_mode == 3) {
@@ -0,0 +1,25 @@
+#version 430 core
+// Draws the fragments per pixel counted by gaussian.frag as a heatmap, on a log scale
+
+layout (r32ui, binding = 0) readonly uniform uimage2D overdraw_counts;
+
+uniform layout(location = 0) float max_overdraw;
+
+out vec4 frag_color_out;
+
+const vec3 ramp[6] = vec3[](
+    vec3(0.0, 0.0, 0.0),
+    vec3(0.0, 0.2, 1.0),
+    vec3(0.0, 0.9, 0.3),
+    vec3(1.0, 0.9, 0.0),
+    vec3(1.0, 0.1, 0.0),
+    vec3(1.0, 1.0, 1.0)
+);
+
+void main()
+{
+    uint count = imageLoad(overdraw_counts, ivec2(gl_FragCoord.xy)).r;
+    float t = clamp(log2(1.0 + float(count)) / log2(1.0 + max(max_overdraw, 1.0)), 0.0, 1.0) * 5.0;
+    int i = min(int(t), 4);
+    frag_color_out = vec4(mix(ramp[i], ramp[i + 1], t - float(i)), 1.0);
+}
@@ -1,7 +1,8 @@
 #version 430 core
 
-layout (location = 2) in vec3 position_ws;
+layout (location = 2) in vec3 position;
 layout (location = 3) in vec3 color;
+layout (location = 7) in uint chunk_index;
 //layout (location = 4) in vec3 scale;
 //layout (location = 5) in float alpha;
 
@@ -9,6 +10,11 @@ uniform layout(location = 0) mat4 VP;
 uniform layout(location = 1) float scale_multipler;
 //uniform layout(location = 2) mat4 view_matrix;
 //uniform layout(location = 3) mat4 projection_matrix;
+uniform layout(location = 6) bool chunked_positions;
+
+layout (std430, binding = 0) readonly buffer ChunkOrigins {
+    vec4 chunk_origins[];
+};
 
 out vec3 frag_color;
 
@@ -17,6 +23,7 @@ vec3 tone_map(vec3 c) {
 }
 
 void main() {
+    vec3 position_ws = chunked_positions ? chunk_origins[chunk_index].xyz + position : position;
     gl_Position = VP * vec4(position_ws, 1.0);
     gl_PointSize = 1 + scale_multipler;
     frag_color = color;//tone_map(color);
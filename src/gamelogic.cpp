@@ -4,6 +4,7 @@
 #include <utilities/shader.hpp>
 #include <glm/vec3.hpp>
 #include <iostream>
+#include <cstring>
 #include <utilities/timeutils.h>
 #include <utilities/mesh.h>
 #include <utilities/shapes.h>
@@ -12,6 +13,17 @@
 #include "glm/fwd.hpp"
 #include "utilities/plyParser.hpp"
 #include "utilities/camera.hpp"
+#include "utilities/profiler.hpp"
+#include "utilities/streamBuffer.hpp"
+#include "utilities/splatLayout.hpp"
+#include "utilities/splatCulling.hpp"
+#include "utilities/splatPager.hpp"
+#include "utilities/sortArena.hpp"
+#include "utilities/depthKeys.hpp"
+#include "utilities/sortScheduler.hpp"
+#include "utilities/depthSorter.hpp"
+#include "utilities/allocationCounter.hpp"
+#include "utilities/frameStats.hpp"
 #include <SFML/Audio/Sound.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -25,12 +37,15 @@
 #include <glm/gtx/string_cast.hpp> // Enables to_string on glm types, handy for debugging
 
 
-glm::mat4 lastViewMatrix;
+// Decides when the camera has changed enough to sort again
+SortScheduler sortScheduler;
+// Everything besides the view that changes which splats the sort culls
+float lastSortAspect = 0.0f;
+float lastSortScale = 0.0f;
+bool lastSortCulled = false;
+ApproximateSort lastSortApproximate;
 
-typedef struct {
-    size_t index;
-    float depth;
-} GaussianDepth;
+using Clock = std::chrono::steady_clock;
 
 
 Gloom::Camera *camera = new Gloom::Camera(glm::vec3(0.3f, 0.0f, 2.5f), 2.0f, 0.075f);
@@ -46,9 +61,38 @@ float field_of_view = glm::radians(60.0f);
 float near_clipping_plane = 0.1f;
 float far_clipping_plane = 200.0f;
 
-GaussianSplat splat;
+// Shared with ProgramState::loaded_model
+std::shared_ptr<GaussianSplat> splat;
 
-GLuint vao, vbo, ebo, positionVBO, colorVBO, scaleVBO, alphaVBO, rotationVBO;
+GLuint vao, vbo, ebo, splatVBO, chunkOriginSSBO;
+
+// Vertex buffer binding the per-instance splat records are read from, followed by one binding
+// per further attribute array with separate arrays. Binding 0 is the quad.
+#define SPLAT_BINDING 1
+SplatLayout splatLayout = splat_layout_make(splat_format_float32);
+
+// Drawing order from the latest depth sort, one uint32 splat index per splat. Slots are padded
+// to the storage buffer offset alignment, since the culling binds them as storage buffers.
+StreamBuffer sortedStream;
+size_t sortedOrderOffset = 0;
+// Scratch memory of the depth sort, reserved on the first sort of a model
+SortArena sortArena;
+// Centers and radii for the depth keys, built while the scales are still there
+SplatSortPositions sortPositions;
+// Sorts in the background when ProgramState::async_sort is set, for the view it was requested for
+AsyncDepthSorter sorter;
+Clock::time_point sortRequestTime;
+glm::mat4 sortRequestView;
+// Estimated every frame, to sort for where the camera will be
+CameraMotion cameraMotion;
+
+// Culls splatVBO in drawing order into the instance buffer that is actually drawn
+SplatCuller culler;
+// Fragment counts of the overdraw draw mode
+OverdrawMap overdrawMap;
+
+// Streams the pages of paged models, which replaces splatVBO and the depth sort above
+SplatPager pager;
 
 
 void mouseCallback(GLFWwindow* window, double x, double y) 
@@ -122,34 +166,85 @@ void setup_instanced_quad()
     glEnableVertexAttribArray(0);
 }
 
-void setup_attribute(GLuint *VBO, GLuint location, void *data, GLsizei count, GLsizei datatype_size)
+static void setup_chunk_origins(std::vector<glm::vec4> chunkOrigins)
 {
-    GLint elements = datatype_size / sizeof(float);
-    glGenBuffers(1, VBO);
-    glBindBuffer(GL_ARRAY_BUFFER, *VBO);
-    glBufferData(GL_ARRAY_BUFFER, count * datatype_size, data, GL_STATIC_DRAW);
-    glVertexAttribPointer(location, elements, GL_FLOAT, GL_FALSE, datatype_size, (void*)0);
-    glEnableVertexAttribArray(location);
-    // Tell OpenGL this is an instanced attribute
-    glVertexAttribDivisor(location, 1);
+    // The shaders declare the chunk origins even when positions are absolute, so always bind
+    // something
+    if (chunkOrigins.empty()) {
+        chunkOrigins.push_back(glm::vec4(0.0f));
+    }
+    glGenBuffers(1, &chunkOriginSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, chunkOriginSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, chunkOrigins.size() * sizeof(glm::vec4), chunkOrigins.data(), GL_STATIC_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SPLAT_CHUNK_ORIGINS_BINDING, chunkOriginSSBO);
 }
 
-void setup_gaussians() 
+// Paged models keep the format they were written with, and start out with only the page
+// summaries on the GPU
+static void setup_paged_gaussians(ProgramState *state)
 {
-    setup_attribute(&positionVBO, 2, splat.ws_positions.data(), splat.ws_positions.size(), sizeof(glm::vec3));
-    setup_attribute(&colorVBO,    3, splat.colors.data(), splat.colors.size(), sizeof(glm::vec3));
-    setup_attribute(&scaleVBO,    4, splat.scales.data(), splat.scales.size(), sizeof(glm::vec3));
-    setup_attribute(&alphaVBO,    5, splat.opacities.data(), splat.opacities.size(), sizeof(float));
-    setup_attribute(&rotationVBO, 6, splat.rotations.data(), splat.rotations.size(), sizeof(glm::vec4));
+    PROFILE_ZONE("setup paged model");
+    splatLayout = splat->paged->layout;
+    splat_pager_init(&pager, splat->paged, size_t(std::max(state->page_pool_megabytes, 0)) * 1024 * 1024);
+    splat_culler_init_empty(&culler, pager.capacity, splatLayout);
+    splat_pager_start(&pager, culler.cull_data);
+
+    glBindVertexArray(vao);
+    splat_layout_setup_attributes(splatLayout, SPLAT_BINDING);
+    splat_layout_bind_buffer(splatLayout, SPLAT_BINDING, culler.instances, culler.count);
+    // With chunked positions the chunks are the pages
+    setup_chunk_origins(splat->paged->origins);
+}
+
+void setup_gaussians(ProgramState *state) 
+{
+    if (splat->paged) {
+        setup_paged_gaussians(state);
+        return;
+    }
+    PROFILE_ZONE("upload model");
+    // All attributes of a splat are interleaved into one record, see splatLayout.hpp
+    // The records are reordered on the GPU, so the CPU copy is only needed for the upload
+    std::vector<unsigned char> packedSplats;
+    std::vector<glm::vec4> chunkOrigins;
+    splat_layout_pack(splatLayout, *splat, packedSplats, chunkOrigins);
+
+    glGenBuffers(1, &splatVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, splatVBO);
+    glBufferData(GL_ARRAY_BUFFER, packedSplats.size(), packedSplats.data(), GL_STATIC_DRAW);
+
+    // The vertex shaders read the culled and compacted copy
+    splat_culler_init(&culler, *splat, splatLayout);
+    glBindVertexArray(vao);
+    splat_layout_setup_attributes(splatLayout, SPLAT_BINDING);
+    splat_layout_bind_buffer(splatLayout, SPLAT_BINDING, culler.instances, culler.count);
+    setup_chunk_origins(std::move(chunkOrigins));
+
+    // Everything now lives on the GPU. Only the depth sort needs the positions on the CPU, and it
+    // has its own copy, so the model can go unless it is kept around in the cache.
+    if (state->depth_sort) {
+        splat_sort_positions_build(&sortPositions, *splat);
+    }
+    if (!model_cache_contains(&state->model_cache, splat.get())) {
+        gaussian_splat_release_attributes(*splat);
+    }
 }
 
 void free_gaussians() 
 {
-    glDeleteBuffers(1, &positionVBO);
-    glDeleteBuffers(1, &colorVBO);
-    glDeleteBuffers(1, &scaleVBO);
-    glDeleteBuffers(1, &alphaVBO);
-    glDeleteBuffers(1, &rotationVBO);
+    // The sorter reads the positions and the arena freed below
+    async_depth_sorter_cancel(&sorter);
+    // Sized for the old model, recreated on the next sort
+    stream_buffer_free(&sortedStream);
+    sort_arena_free(&sortArena);
+    sortPositions = SplatSortPositions();
+    glDeleteBuffers(1, &splatVBO);
+    glDeleteBuffers(1, &chunkOriginSSBO);
+    splatVBO = 0;
+    splat_culler_free(&culler);
+    splat_pager_free(&pager);
+    // Make sure the new model gets sorted even if the camera doesn't move
+    sort_scheduler_reset(&sortScheduler);
 }
 
 void render_gaussians(ProgramState *state) 
@@ -166,33 +261,77 @@ void render_gaussians(ProgramState *state)
     
     // Bind the instanced VAO
     glBindVertexArray(vao);
+    // The instance count was written by the culling passes
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culler.indirect);
    
     if (state->draw_mode == Point_Cloud) {
         // Draw as points
         glEnable(GL_PROGRAM_POINT_SIZE);
-        //glDrawArrays(GL_POINTS, 0, splat.ws_positions.size());
-        glDrawArraysInstanced(GL_POINTS, 0, 1, splat.ws_positions.size());
+        glDrawArraysIndirect(GL_POINTS, (void*)SPLAT_CULL_ARRAYS_COMMAND_OFFSET);
     } else {
-        // Draw all Gaussians as instanced quads (6 vertices per quad)
+        // Draw all visible Gaussians as instanced quads (6 vertices per quad)
         // 1. This will fetch indices from the EBO
         // 2. Draws each instance using per-instance attributes (position, scale, ...)
-        glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, splat.count);
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)SPLAT_CULL_ELEMENTS_COMMAND_OFFSET);
+    }
+}
+
+void cull_gaussians(ProgramState *state)
+{
+    float aspect_ratio = float(state->windowWidth) / float(state->windowHeight);
+    glm::mat4 projection = glm::perspective(field_of_view, aspect_ratio, near_clipping_plane, far_clipping_plane);
+    glm::mat4 view = camera->getViewMatrix();
+
+    SplatCullParams params;
+    params.view_projection = projection * view;
+    params.camera_position = camera->getPosition();
+    // The camera looks down -z in view space
+    params.camera_forward = -glm::vec3(view[0][2], view[1][2], view[2][2]);
+    params.focal_y = float(state->windowHeight) / (2.0f * std::tan(field_of_view / 2.0f));
+    params.scale_multiplier = state->scale_multiplier;
+    params.min_contribution = state->min_contribution;
+    params.cull = state->gpu_culling;
+
+    if (splat->paged) {
+        splat_culler_run(&culler, params, pager.records, pager.order.buffer, pager.order_offset, pager.order_count);
+        return;
+    }
+    // Draw in the order of the latest sort, even if sorting has been turned off since
+    GLuint order = sortedStream.buffer;
+    splat_culler_run(&culler, params, splatVBO, order, sortedOrderOffset, culler.count);
+}
+
+// Streams pages in and out for the current view, and rebuilds the drawing order of the resident
+// splats. Takes the place of the depth sort for paged models.
+void page_gaussians(ProgramState *state)
+{
+    float aspect_ratio = float(state->windowWidth) / float(state->windowHeight);
+    glm::mat4 projection = glm::perspective(field_of_view, aspect_ratio, near_clipping_plane, far_clipping_plane);
+    glm::mat4 view = camera->getViewMatrix();
+
+    splat_pager_update(&pager, projection * view, camera->getPosition());
+    Clock::time_point sort_start = Clock::now();
+    if (splat_pager_build_order(&pager, view, state->depth_sort)) {
+        state->frame_timings.sort = elapsed_ms(sort_start);
+        state->frame_timings.sort_ran = true;
+        state->depth_sort_time_in_ms = state->frame_timings.sort;
     }
+    state->paging_stats = pager.stats;
+    state->sort_arena_bytes = pager.order_arena.capacity;
+    state->sort_arena_huge_pages = pager.order_arena.huge_pages;
 }
 
 
-void init_game(GLFWwindow* window, ProgramState state) 
+void init_renderer(ProgramState *state)
 {
     setup_instanced_quad();
     
-    splat = state.loaded_model;
+    splat = state->loaded_model;
     //gaussian_splat_print(splat);
-    setup_gaussians();
-
-    // glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    glfwSetCursorPosCallback(window, mouseCallback);
-    glfwSetMouseButtonCallback(window, mouseButtonCallback);
-    glfwSetKeyCallback(window, keyCallback);
+    splatLayout = splat_layout_make(state->splat_format);
+    splat_culler_create_shaders(&culler);
+    overdraw_map_create_shaders(&overdrawMap);
+    setup_gaussians(state);
 
     // Setup shaders
     shader3D = new Gloom::Shader();
@@ -216,21 +355,96 @@ void init_game(GLFWwindow* window, ProgramState state)
     // std::cout << fmt::format("Initialized scene with {} SceneNodes.", totalChildren(rootNode)) << std::endl;
 }
 
+void free_renderer(ProgramState *state)
+{
+    // Also joins the page reader of a paged model, which must not outlive the pager
+    free_gaussians();
+    async_depth_sorter_cancel(&sorter);
+    async_depth_sorter_stop(&sorter);
+    overdraw_map_free(&overdrawMap);
+    frame_stats_free(&state->frame_stats_counter);
+    for (int pass = 0; pass < GPU_PASS_COUNT; pass++) {
+        gpu_timer_free(&state->gpu_timers[pass]);
+    }
+}
+
+void init_game(GLFWwindow* window, ProgramState *state) 
+{
+    init_renderer(state);
+
+    // glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwSetCursorPosCallback(window, mouseCallback);
+    glfwSetMouseButtonCallback(window, mouseButtonCallback);
+    glfwSetKeyCallback(window, keyCallback);
+}
+
+void set_camera_pose(glm::vec3 position, float yaw, float pitch)
+{
+    camera->setPose(position, yaw, pitch);
+}
+
+CameraPose get_camera_pose()
+{
+    return { camera->getPosition(), camera->getYaw(), camera->getPitch() };
+}
+
 void update_frame(GLFWwindow* window, ProgramState *state)
 {
+    PROFILE_ZONE("update frame");
+    // Paged models are stored in their GPU format
+    bool format_changed = !splat->paged && !splat_format_equal(state->splat_format, splatLayout.format);
+    bool needs_positions = state->depth_sort && sortPositions.x.size() != splat->count &&
+                           splat->ws_positions.empty() && splat->count > 0;
+    if (splat->attributes_released && (format_changed || needs_positions)) {
+        // The arrays needed for this were released after the upload, so get them back from disk.
+        // The old model is drawn until the reload is done.
+        if (!state->is_loading_model && !state->change_model) {
+            state->reload_model = true;
+        }
+    } else if (format_changed) {
+        // Repack the current model
+        free_gaussians();
+        splatLayout = splat_layout_make(state->splat_format);
+        setup_gaussians(state);
+    }
+
     if (state->change_model) {
         free_gaussians();
         state->change_model = false;
         splat = state->loaded_model;
         //std::cout << "Changing model!" << std::endl;
         //gaussian_splat_print(splat);
-        setup_gaussians();
+        splatLayout = splat_layout_make(state->splat_format);
+        setup_gaussians(state);
     }
 
     double current_time = glfwGetTime();
     float delta_time = static_cast<float>(current_time - last_frame_time);
     last_frame_time = current_time;
-    camera->updateCamera(delta_time);
+
+    if (state->playing_camera_path && !state->camera_path.empty()) {
+        // Driven by the frame count rather than delta_time, so every playback is identical
+        CameraPose pose = camera_path_sample(state->camera_path, state->camera_path_time);
+        camera->setPose(pose.position, pose.yaw, pose.pitch);
+
+        float end = float(state->camera_path.size() - 1);
+        state->camera_path_time += state->camera_path_speed;
+        if (state->camera_path_time > end) {
+            if (state->loop_camera_path) {
+                state->camera_path_time = 0.0f;
+            } else {
+                state->playing_camera_path = false;
+            }
+        }
+    } else {
+        camera->updateCamera(delta_time);
+    }
+
+    camera_motion_update(&cameraMotion, get_camera_pose(), current_time);
+
+    if (state->recording_camera_path) {
+        state->camera_path.push_back(get_camera_pose());
+    }
 
     // Update regular geometry
     // float aspect_ratio = float(state->windowWidth) / float(state->windowHeight);
@@ -298,96 +512,150 @@ void renderNode3D(SceneNode* node) {
     }
 }
 
-bool depth_sort_and_update_buffers() 
+// Publishes a finished sort: the culled splats and then the sorted ones go into the next slot of
+// the order stream
+static void upload_depth_order(ProgramState *state, const DepthSortResult &result, const glm::mat4 &view)
 {
-    // Only perform the depth sort if camera has moved
+    FrameTimings *timings = &state->frame_timings;
+    timings->depth = result.depth_ms;
+    timings->sort = result.sort_ms;
+    timings->depth_ran = timings->sort_ran = true;
+    state->sorted_splats = result.visible;
+    if (result.approximate) {
+        state->sort_quality = result.quality;
+    }
+    state->sort_arena_bytes = sortArena.capacity;
+    state->sort_arena_huge_pages = sortArena.huge_pages;
+    sort_scheduler_sorted(&sortScheduler, state->sort_schedule, view, sortPositions, result.sorted, result.visible);
+    state->sort_schedule_stats = sortScheduler.stats;
+
+    // Only the sorted indices go to the GPU, the culling passes gather the records from there.
+    // They are written straight into the next slot of the stream ring, and the wait for the slot
+    // to be free counts as upload time.
+    Clock::time_point stage_start = Clock::now();
+    PROFILE_ZONE("upload");
+    size_t count = result.visible + result.culled_count;
+    if (sortedStream.buffer == 0) {
+        GLint alignment = 256;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        size_t order_size = count * sizeof(uint32_t);
+        stream_buffer_init(&sortedStream, (order_size + alignment - 1) / alignment * alignment);
+    }
+    // The culled splats go first, so they are drawn behind everything if this order is still used
+    // after they come into view
+    uint32_t *order = reinterpret_cast<uint32_t *>(stream_buffer_begin_write(&sortedStream));
+    memcpy(order, result.culled, result.culled_count * sizeof(uint32_t));
+    memcpy(order + result.culled_count, result.sorted, result.visible * sizeof(uint32_t));
+    state->gpu_upload_timed = sortedStream.mapped == nullptr;
+    if (state->gpu_upload_timed) {
+        gpu_timer_begin(&state->gpu_timers[GPU_PASS_UPLOAD]);
+    }
+    sortedOrderOffset = stream_buffer_end_write(&sortedStream);
+    if (state->gpu_upload_timed) {
+        gpu_timer_end(&state->gpu_timers[GPU_PASS_UPLOAD]);
+    }
+    timings->upload = elapsed_ms(stage_start);
+    timings->upload_ran = true;
+    state->depth_sort_time_in_ms = float(timings->depth + timings->sort + timings->upload);
+}
+
+bool depth_sort_and_update_buffers(ProgramState *state)
+{
+    // Sorting was turned on after the positions were released, update_frame has asked for a reload
+    if (sortPositions.x.size() != splat->count && splat->ws_positions.size() != splat->count) {
+        return false;
+    }
+    // A background sort that has finished is drawn from this frame on
+    if (async_depth_sorter_poll(&sorter)) {
+        float latency = float(elapsed_ms(sortRequestTime));
+        state->sort_latency_ms = state->sort_latency_ms > 0.0f ? 0.8f * state->sort_latency_ms + 0.2f * latency : latency;
+        upload_depth_order(state, sorter.result, sortRequestView);
+        // The render thread's own allocations are counted by render_frame
+        state->sort_allocations += sorter.result.allocations;
+        return true;
+    }
+    if (async_depth_sorter_busy(&sorter)) {
+        return false;
+    }
+
+    // Only perform the depth sort if camera has changed enough, see sortScheduler.hpp
     glm::mat4 currentViewMatrix = camera->getViewMatrix();
-    bool viewMatrixChanged = true;
-    viewMatrixChanged = false;
-    for (int i = 0; i < 4 && !viewMatrixChanged; i++) {
-        for (int j = 0; j < 4 && !viewMatrixChanged; j++) {
-            // Use a small epsilon for floating point comparison
-            if (std::abs(currentViewMatrix[i][j] - lastViewMatrix[i][j]) > 0.0001f) {
-                viewMatrixChanged = true;
-            }
-        }
+    float aspect_ratio = float(state->windowWidth) / float(state->windowHeight);
+    ApproximateSort approximate = state->approximate_sort;
+    approximate.near_depth = near_clipping_plane;
+    approximate.far_depth = far_clipping_plane;
+    if (aspect_ratio != lastSortAspect || state->scale_multiplier != lastSortScale ||
+        state->gpu_culling != lastSortCulled || approximate.enabled != lastSortApproximate.enabled ||
+        approximate.buckets != lastSortApproximate.buckets ||
+        approximate.exact_depth != lastSortApproximate.exact_depth) {
+        sort_scheduler_reset(&sortScheduler);
     }
-    if (!viewMatrixChanged) {
+    bool sort = sort_scheduler_should_sort(&sortScheduler, state->sort_schedule, currentViewMatrix);
+    state->sort_schedule_stats = sortScheduler.stats;
+    if (!sort) {
         return false;
     }
 
-    lastViewMatrix = currentViewMatrix;
+    lastSortAspect = aspect_ratio;
+    lastSortScale = state->scale_multiplier;
+    lastSortCulled = state->gpu_culling;
+    lastSortApproximate = approximate;
 
-    std::vector<GaussianDepth> depthSortData(splat.ws_positions.size());
-    glm::mat4 viewMatrix = camera->getViewMatrix();
-    
-    // ~300 ms
-    // Calculate view-space depth for each Gaussian
-    for (size_t i = 0; i < splat.ws_positions.size(); i++) {
-        glm::vec4 viewPos = viewMatrix * glm::vec4(splat.ws_positions[i], 1.0f);
-        depthSortData[i].index = i;
-        depthSortData[i].depth = -viewPos.z;  // Negative because view space goes into  the negative Z
+    if (sortPositions.x.size() != splat->count) {
+        // Depth sorting was turned on for a model that is still whole, because it is in the cache
+        splat_sort_positions_build(&sortPositions, *splat);
     }
-    
-    // ~600 ms
-    // TODO: Count sort is faster, and then consider sorting on the GPU
-    std::sort(depthSortData.begin(), depthSortData.end(),
-        [](const GaussianDepth& a, const GaussianDepth& b) {
-            return a.depth > b.depth;
-        });
 
-    
-    // ~500 ms
-    // Create temporary vectors for sorted data
-    std::vector<glm::vec3> sorted_positions(splat.ws_positions.size());
-    std::vector<glm::vec3> sorted_colors(splat.colors.size());
-    std::vector<glm::vec3> sorted_scales(splat.scales.size());
-    std::vector<float> sorted_opacities(splat.opacities.size());
-    std::vector<glm::vec4> sorted_rotations(splat.rotations.size());
-    
-    // Reorder data based on sorted depths
-    for (size_t i = 0; i < depthSortData.size(); i++) {
-        size_t idx = depthSortData[i].index;
-        sorted_positions[i] = splat.ws_positions[idx];
-        sorted_colors[i] = splat.colors[idx];
-        sorted_scales[i] = splat.scales[idx];
-        sorted_opacities[i] = splat.opacities[idx];
-        sorted_rotations[i] = splat.rotations[idx];
+    // A background sort is drawn from about sort_latency_ms from now, so sort for where the camera
+    // will be by then
+    glm::mat4 view = currentViewMatrix;
+    if (state->async_sort && state->predict_sort) {
+        CameraPose pose = camera_motion_predict(cameraMotion, state->sort_latency_ms / 1000.0);
+        Gloom::Camera predicted(pose.position);
+        predicted.setPose(pose.position, pose.yaw, pose.pitch);
+        view = predicted.getViewMatrix();
     }
-    
-    // TODO: Is this necessary? Can we do some trickery to make this fast?
-    // Update buffers
-    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
-    glBufferData(GL_ARRAY_BUFFER, sorted_positions.size() * sizeof(glm::vec3),
-                 sorted_positions.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, colorVBO);
-    glBufferData(GL_ARRAY_BUFFER, sorted_colors.size() * sizeof(glm::vec3),
-                 sorted_colors.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, scaleVBO);
-    glBufferData(GL_ARRAY_BUFFER, sorted_scales.size() * sizeof(glm::vec3),
-                 sorted_scales.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, alphaVBO);
-    glBufferData(GL_ARRAY_BUFFER, sorted_opacities.size() * sizeof(float),
-                 sorted_opacities.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, rotationVBO);
-    glBufferData(GL_ARRAY_BUFFER, sorted_rotations.size() * sizeof(glm::vec4),
-                 sorted_rotations.data(), GL_STATIC_DRAW);
 
+    // The culling passes on the GPU do the same frustum test, this only saves sorting the splats
+    // they would drop anyway. The frustum is widened by what the scheduler lets the camera move
+    // before the next sort.
+    DepthKeyParams params = sort_scheduler_key_params(state->sort_schedule, view);
+    params.cull = state->gpu_culling &&
+                  sort_scheduler_cull_planes(state->sort_schedule, field_of_view, aspect_ratio, far_clipping_plane,
+                                             view, params.planes);
+    params.radius_scale = state->scale_multiplier;
+
+    if (state->async_sort) {
+        if (!sorter.worker.joinable()) {
+            async_depth_sorter_start(&sorter);
+        }
+        sortRequestTime = Clock::now();
+        sortRequestView = view;
+        async_depth_sorter_request(&sorter, &sortPositions, params, approximate, &sortArena);
+        return false;
+    }
+    upload_depth_order(state, depth_sort_run(sortPositions, params, approximate, &sortArena), view);
     return true;
 }
 
 void render_frame(GLFWwindow* window, ProgramState *state) 
 {
-    if (state->depth_sort) {
-        auto start_time = std::chrono::high_resolution_clock::now();
-        if (depth_sort_and_update_buffers()) {
-            auto end_time = std::chrono::high_resolution_clock::now();
-            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
-            state->depth_sort_time_in_ms = duration;
-        }
+    PROFILE_ZONE("render frame");
+    collect_gpu_timings(state);
+    frame_stats_collect(&state->frame_stats_counter);
+
+    state->frame_timings = FrameTimings();
+    state->sort_allocations = 0;
+    uint64_t allocations = allocation_count();
+    if (splat->paged) {
+        page_gaussians(state);
+    } else if (state->depth_sort) {
+        depth_sort_and_update_buffers(state);
     }
+    state->sort_allocations += allocation_count() - allocations;
 
-    glfwGetWindowSize(window, &state->windowWidth, &state->windowHeight);
+    // The caller keeps windowWidth and windowHeight up to date, so this also works when rendering
+    // into an offscreen framebuffer
     glViewport(0, 0, state->windowWidth, state->windowHeight);
 
     // Draw regular geometry
@@ -395,6 +663,14 @@ void render_frame(GLFWwindow* window, ProgramState *state)
     // glUniform3fv(shader3D->getUniformFromName("camera_position"), 1, glm::value_ptr(camera->getPosition()));
     // renderNode3D(rootNode);
 
+    Clock::time_point cull_start = Clock::now();
+    PROFILE_ZONE_NAMED(cull_zone, "cull");
+    gpu_timer_begin(&state->gpu_timers[GPU_PASS_CULL]);
+    cull_gaussians(state);
+    gpu_timer_end(&state->gpu_timers[GPU_PASS_CULL]);
+    state->frame_timings.cull = elapsed_ms(cull_start);
+    PROFILE_ZONE_END(cull_zone);
+
     if (state->draw_mode == Point_Cloud) {
         shader_point_cloud->activate();
     } else {
@@ -403,6 +679,7 @@ void render_frame(GLFWwindow* window, ProgramState *state)
 
     glUniform1f(1, state->scale_multiplier);
     glUniform1i(5, state->draw_mode);
+    glUniform1i(6, splatLayout.format.position == SPLAT_POSITION_FLOAT16_CHUNKED);
 
     // NOTE: Didn't work for some stupid unknown reason ... 
     //       Had to resolve to just hard-coding the focal_fov into the shader :-(
@@ -414,5 +691,42 @@ void render_frame(GLFWwindow* window, ProgramState *state)
     // glm::vec3 focal_fov = glm::vec3(htanx, htany, focal_z);
     // glUniform3fv(4, 1, glm::value_ptr(focal_fov));
 
+    bool count_stats = false;
+    if (state->draw_mode != Point_Cloud) {
+        count_stats = state->frame_stats &&
+                      frame_stats_begin(&state->frame_stats_counter, culler.indirect,
+                                        SPLAT_CULL_ELEMENTS_COMMAND_OFFSET + sizeof(uint32_t));
+        glUniform1i(7, count_stats);
+        glUniform2f(8, float(state->windowWidth), float(state->windowHeight));
+    }
+    if (state->draw_mode == Overdraw) {
+        overdraw_map_begin(&overdrawMap, state->windowWidth, state->windowHeight);
+    }
+
+    Clock::time_point draw_start = Clock::now();
+    PROFILE_ZONE("draw");
+    gpu_timer_begin(&state->gpu_timers[GPU_PASS_DRAW]);
     render_gaussians(state);
+    if (state->draw_mode == Overdraw) {
+        overdraw_map_resolve(&overdrawMap, state->max_overdraw);
+    }
+    gpu_timer_end(&state->gpu_timers[GPU_PASS_DRAW]);
+    if (count_stats) {
+        frame_stats_end(&state->frame_stats_counter);
+    }
+    // The slot that was just drawn from must not be rewritten until the GPU is done with it
+    stream_buffer_fence(&sortedStream);
+    stream_buffer_fence(&pager.order);
+    state->frame_timings.draw = elapsed_ms(draw_start);
+}
+
+unsigned collect_gpu_timings(ProgramState *state)
+{
+    unsigned updated = 0;
+    for (int pass = 0; pass < GPU_PASS_COUNT; pass++) {
+        if (gpu_timer_collect(&state->gpu_timers[pass]) > 0) {
+            updated |= 1u << pass;
+        }
+    }
+    return updated;
 }
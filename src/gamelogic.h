@@ -6,6 +6,15 @@
 #include "program.hpp"
 
 void updateNodeTransformations(SceneNode* node, glm::mat4 transformationThusFar, glm::mat4 VP);
-void init_game(GLFWwindow* window, ProgramState state);
+// Sets up buffers and shaders for the loaded model. Does not touch any window state.
+void init_renderer(ProgramState *state);
+// Stops the background depth sort and frees the per-frame GPU resources. Call once no more
+// frames are rendered.
+void free_renderer(ProgramState *state);
+void init_game(GLFWwindow* window, ProgramState *state);
+void set_camera_pose(glm::vec3 position, float yaw, float pitch);
+CameraPose get_camera_pose();
 void update_frame(GLFWwindow* window, ProgramState *state);
 void render_frame(GLFWwindow* window, ProgramState *state);
+// Reads GPU timer results that are ready. Returns a bitmask of the GpuPass timers that got a new result.
+unsigned collect_gpu_timings(ProgramState *state);
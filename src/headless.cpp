@@ -0,0 +1,415 @@
+// Local headers
+#include "program.hpp"
+#include "gamelogic.h"
+#include "utilities/window.hpp"
+#include "utilities/cameraPath.hpp"
+#include "utilities/timeutils.h"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <lodepng.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+typedef struct {
+    GLuint fbo;
+    GLuint color_texture;
+} OffscreenTarget;
+
+typedef struct {
+    double min, mean, p50, p95, p99, max;
+} TimingStats;
+
+
+static void free_offscreen_target(OffscreenTarget *target)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &target->fbo);
+    glDeleteTextures(1, &target->color_texture);
+}
+
+// The renderer does not use the depth buffer, so a colour attachment is enough
+static bool create_offscreen_target(OffscreenTarget *target, int width, int height)
+{
+    glGenTextures(1, &target->color_texture);
+    glBindTexture(GL_TEXTURE_2D, target->color_texture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    glGenFramebuffers(1, &target->fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->color_texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "ERROR: Offscreen framebuffer is incomplete" << std::endl;
+        free_offscreen_target(target);
+        return false;
+    }
+    return true;
+}
+
+// Loads the model and sets up the renderer for offscreen rendering
+static bool init_offscreen_state(ProgramState *state, CommandLineOptions &options)
+{
+    if (options.modelPath.empty()) {
+        std::cerr << "ERROR: --model is required in headless and benchmark mode" << std::endl;
+        return false;
+    }
+    if (options.width <= 0 || options.height <= 0) {
+        std::cerr << "ERROR: Invalid resolution " << options.width << "x" << options.height << std::endl;
+        return false;
+    }
+
+    if (!splat_format_from_name(options.splatLayout, &state->splat_format)) {
+        std::cerr << "ERROR: Unknown splat layout " << options.splatLayout << std::endl;
+        return false;
+    }
+
+    configure_opengl();
+
+    set_loaded_model(state, load_model(options.modelPath, nullptr, &options.loadOptions), options.modelPath);
+    if (state->loaded_model->had_error) {
+        std::cerr << "ERROR: Failed to load " << options.modelPath << std::endl;
+        return false;
+    }
+    // Every camera has a different view, so always render with correct blending order: sorted
+    // for exactly this view before drawing
+    state->depth_sort = true;
+    state->async_sort = false;
+    state->sort_schedule.max_translation = 0.0f;
+    state->sort_schedule.max_rotation = 0.0f;
+    state->sort_schedule.max_error = 0.0f;
+    state->change_model = false;
+    state->windowWidth = options.width;
+    state->windowHeight = options.height;
+    state->frame_stats = options.frameStats;
+    init_renderer(state);
+    return true;
+}
+
+static bool write_framebuffer_png(const std::string &filename, int width, int height)
+{
+    // Splats blend into the alpha channel as well, which would make the images see-through, so
+    // only the colour is kept
+    std::vector<unsigned char> pixels(size_t(width) * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    // OpenGL has the origin in the bottom left corner, PNG in the top left
+    size_t row_size = size_t(width) * 3;
+    std::vector<unsigned char> row(row_size);
+    for (int y = 0; y < height / 2; y++) {
+        unsigned char *top = pixels.data() + y * row_size;
+        unsigned char *bottom = pixels.data() + (height - 1 - y) * row_size;
+        memcpy(row.data(), top, row_size);
+        memcpy(top, bottom, row_size);
+        memcpy(bottom, row.data(), row_size);
+    }
+
+    unsigned error = lodepng::encode(filename, pixels, width, height, LCT_RGB);
+    if (error) {
+        std::cerr << "ERROR: Could not write " << filename << ": " << lodepng_error_text(error) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int run_headless(GLFWwindow* window, CommandLineOptions options)
+{
+    std::vector<CameraPose> cameras;
+    if (options.cameraFile.empty()) {
+        cameras.push_back(default_camera_pose);
+    } else if (!camera_poses_from_file(options.cameraFile, cameras)) {
+        return EXIT_FAILURE;
+    }
+
+    std::error_code ec;
+    fs::create_directories(options.outputDirectory, ec);
+    if (ec) {
+        std::cerr << "ERROR: Could not create output directory " << options.outputDirectory
+                  << ": " << ec.message() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    ProgramState state;
+    OffscreenTarget target;
+    if (!init_offscreen_state(&state, options) ||
+        !create_offscreen_target(&target, options.width, options.height)) {
+        // Also fine if the renderer was never set up, the target frees itself when incomplete
+        free_renderer(&state);
+        return EXIT_FAILURE;
+    }
+
+    std::string model_name = fs::path(options.modelPath).stem().string();
+    int result = EXIT_SUCCESS;
+    for (size_t i = 0; i < cameras.size(); i++) {
+        set_camera_pose(cameras[i].position, cameras[i].yaw, cameras[i].pitch);
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        render_frame(window, &state);
+
+        char name[64];
+        snprintf(name, sizeof(name), "_%04zu.png", i);
+        std::string filename = (fs::path(options.outputDirectory) / (model_name + name)).string();
+        if (!write_framebuffer_png(filename, options.width, options.height)) {
+            result = EXIT_FAILURE;
+            break;
+        }
+        printGLError();
+    }
+
+    std::cout << "Rendered " << cameras.size() << " image(s) of " << options.modelPath
+              << " to " << options.outputDirectory << std::endl;
+
+    free_renderer(&state);
+    free_offscreen_target(&target);
+    return result;
+}
+
+
+static TimingStats compute_stats(std::vector<double> samples)
+{
+    TimingStats stats = {};
+    if (samples.empty()) {
+        return stats;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    // Nearest-rank percentile
+    auto percentile = [&samples](double p) {
+        size_t rank = size_t(std::ceil(p / 100.0 * samples.size()));
+        return samples[std::max<size_t>(rank, 1) - 1];
+    };
+
+    stats.min = samples.front();
+    stats.max = samples.back();
+    stats.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+    stats.p50 = percentile(50);
+    stats.p95 = percentile(95);
+    stats.p99 = percentile(99);
+    return stats;
+}
+
+// The model path and layout come from the command line, so they may contain anything
+static void write_json_string(std::ofstream &file, const std::string &str)
+{
+    file << '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            file << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            file << escaped;
+        } else {
+            file << c;
+        }
+    }
+    file << '"';
+}
+
+// Writes the statistics of every series as a JSON object of objects
+static void write_json_stats(std::ofstream &file, const std::vector<std::pair<std::string, std::vector<double>>> &series)
+{
+    for (size_t i = 0; i < series.size(); i++) {
+        TimingStats s = compute_stats(series[i].second);
+        file << "    \"" << series[i].first << "\": { \"count\": " << series[i].second.size()
+             << ", \"min\": " << s.min << ", \"mean\": " << s.mean
+             << ", \"p50\": " << s.p50 << ", \"p95\": " << s.p95 << ", \"p99\": " << s.p99
+             << ", \"max\": " << s.max << " }" << (i + 1 < series.size() ? "," : "") << "\n";
+    }
+}
+
+// Units of the frame statistics, in the order run_benchmark collects them
+static const char *const frame_stat_units[] = { "splats", "pixels", "fragments", "fragments", "fragments/pixel" };
+
+static void write_csv_stats(std::ofstream &file, const std::string &name, const char *unit, const std::vector<double> &samples)
+{
+    TimingStats s = compute_stats(samples);
+    file << name << "," << unit << "," << samples.size() << "," << s.min << "," << s.mean
+         << "," << s.p50 << "," << s.p95 << "," << s.p99 << "," << s.max << "\n";
+}
+
+static bool write_benchmark_results(CommandLineOptions &options, ProgramState &state, size_t frames,
+                                    const std::vector<std::pair<std::string, std::vector<double>>> &stages,
+                                    const std::vector<std::pair<std::string, std::vector<double>>> &frame_stats)
+{
+    std::ofstream file(options.benchmarkOutput);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Could not open " << options.benchmarkOutput << " for writing" << std::endl;
+        return false;
+    }
+
+    bool csv = fs::path(options.benchmarkOutput).extension() == ".csv";
+    if (csv) {
+        // Stages are in milliseconds, the frame statistics each have their own unit
+        file << "series,unit,count,min,mean,p50,p95,p99,max\n";
+        for (const auto &stage : stages) {
+            write_csv_stats(file, stage.first, "ms", stage.second);
+        }
+        // Empty without --frame-stats, or if the GPU never caught up
+        if (!frame_stats.empty() && !frame_stats[0].second.empty()) {
+            for (size_t i = 0; i < frame_stats.size(); i++) {
+                write_csv_stats(file, frame_stats[i].first, frame_stat_units[i], frame_stats[i].second);
+            }
+        }
+        return true;
+    }
+
+    file << "{\n";
+    file << "  \"model\": ";
+    write_json_string(file, state.loaded_model->filename);
+    file << ",\n";
+    file << "  \"splats\": " << state.loaded_model->count << ",\n";
+    file << "  \"width\": " << options.width << ",\n";
+    file << "  \"height\": " << options.height << ",\n";
+    file << "  \"frames\": " << frames << ",\n";
+    file << "  \"splat_layout\": ";
+    write_json_string(file, options.splatLayout);
+    file << ",\n";
+    file << "  \"splat_format\": \"" << splat_format_describe(state.splat_format) << "\",\n";
+    file << "  \"splat_record_bytes\": " << splat_layout_make(state.splat_format).stride << ",\n";
+    // Without it there is no gpu_upload stage, see ProgramState::gpu_upload_timed
+    file << "  \"gpu_upload_timed\": " << (state.gpu_upload_timed ? "true" : "false") << ",\n";
+    file << "  \"stages_ms\": {\n";
+    write_json_stats(file, stages);
+    // Empty without --frame-stats, or if the GPU never caught up
+    if (!frame_stats.empty() && !frame_stats[0].second.empty()) {
+        file << "  },\n";
+        file << "  \"frame_stats\": {\n";
+        write_json_stats(file, frame_stats);
+    }
+    file << "  }\n";
+    file << "}\n";
+    return true;
+}
+
+int run_benchmark(GLFWwindow* window, CommandLineOptions options)
+{
+    // Frames rendered before measuring starts, so shader compilation and first-touch page faults
+    // don't end up in the numbers
+    const size_t warmup_frames = 10;
+
+    if (options.benchmarkFrames <= 0) {
+        std::cerr << "ERROR: --frames must be positive" << std::endl;
+        return EXIT_FAILURE;
+    }
+    size_t frames = size_t(options.benchmarkFrames);
+
+    // Either the (recorded) camera path from file stretched over all frames, or one orbit around
+    // the origin starting at the default camera
+    std::vector<CameraPose> path;
+    if (!options.cameraFile.empty()) {
+        if (!camera_poses_from_file(options.cameraFile, path)) {
+            return EXIT_FAILURE;
+        }
+        if (path.empty()) {
+            std::cerr << "ERROR: Camera file " << options.cameraFile << " contains no cameras" << std::endl;
+            return EXIT_FAILURE;
+        }
+        path = camera_path_resample(path, frames);
+    } else {
+        glm::vec3 p = default_camera_pose.position;
+        path = camera_orbit(glm::vec3(0.0f), glm::length(glm::vec2(p.x, p.z)), p.y, frames);
+    }
+
+    ProgramState state;
+    OffscreenTarget target;
+    if (!init_offscreen_state(&state, options) ||
+        !create_offscreen_target(&target, options.width, options.height)) {
+        // Also fine if the renderer was never set up, the target frees itself when incomplete
+        free_renderer(&state);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::pair<std::string, std::vector<double>>> stages = {
+        {"frame", {}}, {"depth", {}}, {"sort", {}}, {"upload", {}}, {"cull", {}}, {"draw", {}},
+        {"gpu_upload", {}}, {"gpu_cull", {}}, {"gpu_draw", {}},
+    };
+    for (auto &stage : stages) {
+        stage.second.reserve(frames);
+    }
+    // Per frame, see frameStats.hpp. Overdraw is the shaded fragments per pixel.
+    std::vector<std::pair<std::string, std::vector<double>>> counters;
+    if (options.frameStats) {
+        counters = {
+            {"visible_splats", {}}, {"average_quad_area", {}}, {"fragments_shaded", {}},
+            {"fragments_discarded", {}}, {"overdraw", {}},
+        };
+    }
+
+    for (size_t i = 0; i < warmup_frames + frames; i++) {
+        // Warm-up frames are taken from the start of the path
+        const CameraPose &pose = path[i < warmup_frames ? i % path.size() : i - warmup_frames];
+        set_camera_pose(pose.position, pose.yaw, pose.pitch);
+
+        auto frame_start = std::chrono::steady_clock::now();
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        render_frame(window, &state);
+        // Wait for the GPU so the frame time covers the whole frame and frames don't overlap
+        glFinish();
+        double frame_ms = elapsed_ms(frame_start);
+
+        // Everything has finished after glFinish, so this gets the results for this frame
+        unsigned gpu_updated = collect_gpu_timings(&state);
+        if (i < warmup_frames) {
+            continue;
+        }
+        FrameTimings &t = state.frame_timings;
+        auto gpu_ms = [&](GpuPass pass) { return state.gpu_timers[pass].latest_ms; };
+        auto gpu_done = [&](GpuPass pass) { return (gpu_updated & (1u << pass)) != 0; };
+        double samples[] = { frame_ms, t.depth, t.sort, t.upload, t.cull, t.draw,
+                             gpu_ms(GPU_PASS_UPLOAD), gpu_ms(GPU_PASS_CULL), gpu_ms(GPU_PASS_DRAW) };
+        // Frames without a sort don't count towards the sort stages, and passes without a timer
+        // result (not run, or the query was skipped) don't count towards the GPU times
+        bool ran[] = { true, t.depth_ran, t.sort_ran, t.upload_ran, true, true,
+                       gpu_done(GPU_PASS_UPLOAD), gpu_done(GPU_PASS_CULL), gpu_done(GPU_PASS_DRAW) };
+        for (size_t s = 0; s < stages.size(); s++) {
+            if (ran[s]) {
+                stages[s].second.push_back(samples[s]);
+            }
+        }
+
+        if (options.frameStats && frame_stats_collect(&state.frame_stats_counter) > 0) {
+            const FrameStats &f = state.frame_stats_counter.latest;
+            double overdraw = double(f.fragments_shaded) / (double(options.width) * double(options.height));
+            double values[] = { double(f.visible_splats), f.average_quad_area, double(f.fragments_shaded),
+                                double(f.fragments_discarded), overdraw };
+            for (size_t s = 0; s < counters.size(); s++) {
+                counters[s].second.push_back(values[s]);
+            }
+        }
+    }
+    printGLError();
+
+    // The order was written into persistent mapped memory, there was no upload to time
+    if (!state.gpu_upload_timed) {
+        stages.erase(std::find_if(stages.begin(), stages.end(),
+                                  [](const auto &stage) { return stage.first == "gpu_upload"; }));
+    }
+
+    free_renderer(&state);
+    free_offscreen_target(&target);
+
+    if (!write_benchmark_results(options, state, frames, stages, counters)) {
+        return EXIT_FAILURE;
+    }
+
+    TimingStats frame_stats = compute_stats(stages[0].second);
+    printf("Benchmarked %zu frames of %s: mean %.3f ms, p50 %.3f ms, p99 %.3f ms. Results written to %s\n",
+           frames, options.modelPath.c_str(), frame_stats.mean, frame_stats.p50, frame_stats.p99,
+           options.benchmarkOutput.c_str());
+    return EXIT_SUCCESS;
+}
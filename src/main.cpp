@@ -1,6 +1,7 @@
 // Local headers
 #include "utilities/window.hpp"
 #include "program.hpp"
+#include "utilities/profiler.hpp"
 
 // System headers
 #include "imgui.h"
@@ -11,7 +12,9 @@
 #include <GLFW/glfw3.h>
 
 // Standard headers
+#include <algorithm>
 #include <cstdlib>
+#include <iostream>
 #include <arrrgh.hpp>
 
 
@@ -27,7 +30,7 @@ static void glfwErrorCallback(int error, const char *description)
 }
 
 
-GLFWwindow* initialise()
+GLFWwindow* initialise(bool offscreen)
 {
     // Initialise GLFW
     if (!glfwInit()) {
@@ -46,6 +49,8 @@ GLFWwindow* initialise()
     // Set additional window options
     glfwWindowHint(GLFW_RESIZABLE, windowResizable);
     glfwWindowHint(GLFW_SAMPLES, windowSamples);  // MSAA
+    // In headless and benchmark mode the window only exists to own the OpenGL context and is never shown
+    glfwWindowHint(GLFW_VISIBLE, offscreen ? GLFW_FALSE : GLFW_TRUE);
 
     // Create window using GLFW
     GLFWwindow* window = glfwCreateWindow(windowWidthDefault, windowHeightDefault, windowTitle.c_str(), nullptr, nullptr);
@@ -61,14 +66,16 @@ GLFWwindow* initialise()
     glfwMakeContextCurrent(window);
     gladLoadGL();
 
-	// Initialize ImGUI
-    IMGUI_CHECKVERSION();
-    ImGui::CreateContext();
-    ImGuiIO& io = ImGui::GetIO(); (void)io;
-    // io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
-    ImGui::StyleColorsDark();
-    ImGui_ImplGlfw_InitForOpenGL(window, true);
-    ImGui_ImplOpenGL3_Init("#version 430");
+    if (!offscreen) {
+        // Initialize ImGUI
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO& io = ImGui::GetIO(); (void)io;
+        // io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
+        ImGui::StyleColorsDark();
+        ImGui_ImplGlfw_InitForOpenGL(window, true);
+        ImGui_ImplOpenGL3_Init("#version 430");
+    }
 
     // Print various OpenGL information to stdout
     printf("%s: %s\n", glGetString(GL_VENDOR), glGetString(GL_RENDERER));
@@ -80,12 +87,134 @@ GLFWwindow* initialise()
 }
 
 
-int main()
+static CommandLineOptions parse_command_line(int argc, const char* argv[])
 {
+    arrrgh::parser parser("glowbox", "3D Gaussian Splatting renderer");
+    const auto& showHelp = parser.add<bool>("help", "Show this help message.", 'h', arrrgh::Optional, false);
+    const auto& enableMusic = parser.add<bool>("enable-music", "Play background music.", 'm', arrrgh::Optional, false);
+    const auto& headless = parser.add<bool>("headless", "Render offscreen to PNG files and exit. No window or UI.", 'x', arrrgh::Optional, false);
+    const auto& model = parser.add<std::string>("model", "Model (.ply, .splat, .psplat or .csplat) to render in headless mode, or to convert.", 'i', arrrgh::Optional, "");
+    const auto& cameras = parser.add<std::string>("cameras", "Camera list file, one 'x y z yaw pitch' per line.", 'c', arrrgh::Optional, "");
+    const auto& width = parser.add<int>("width", "Width of the rendered images.", 'W', arrrgh::Optional, windowWidthDefault);
+    const auto& height = parser.add<int>("height", "Height of the rendered images.", 'H', arrrgh::Optional, windowHeightDefault);
+    const auto& output = parser.add<std::string>("output", "Directory to write rendered images to.", 'o', arrrgh::Optional, ".");
+    const auto& benchmark = parser.add<bool>("benchmark", "Replay a camera path offscreen and write frame timing statistics.", 'b', arrrgh::Optional, false);
+    const auto& frames = parser.add<int>("frames", "Number of frames to measure in benchmark mode.", 'n', arrrgh::Optional, 600);
+    const auto& benchmarkOutput = parser.add<std::string>("benchmark-output", "Benchmark results file (.json or .csv).", 'r', arrrgh::Optional, "benchmark.json");
+    const auto& frameStats = parser.add<bool>("frame-stats", "Also count visible splats, quad area and fragments in benchmark mode. Adds an atomic per fragment.", 'S', arrrgh::Optional, false);
+    const auto& splatLayout = parser.add<std::string>("splat-layout", "GPU layout of the splats in headless and benchmark mode: float32, compact or separate.", 'l', arrrgh::Optional, "float32");
+    const auto& modelCache = parser.add<int>("model-cache", "Memory budget in MB for keeping recently used models decoded.", 'M', arrrgh::Optional, MODEL_CACHE_DEFAULT_MEGABYTES);
+    const auto& pagePool = parser.add<int>("page-pool", "GPU memory budget in MB for the resident pages of paged models.", 'P', arrrgh::Optional, SPLAT_PAGER_DEFAULT_MEGABYTES);
+    const auto& writePaged = parser.add<std::string>("write-paged", "Convert --model to a paged .psplat file in the --splat-layout format and exit.", 'w', arrrgh::Optional, "");
+    const auto& prune = parser.add<std::string>("prune", "Drop splats when loading, e.g. 'opacity=0.005,min-scale=1e-4,max-scale=20,contribution=1e-7,merge=0.001'.", 'p', arrrgh::Optional, "");
+    const auto& shCodebook = parser.add<int>("sh-codebook", "Replace the spherical harmonics of loaded models with a codebook of this many entries (power of two, up to 65536).", 's', arrrgh::Optional, 0);
+    const auto& shTraining = parser.add<int>("sh-training", "Number of splats the SH codebook is trained on, 0 for all of them.", 'T', arrrgh::Optional, SH_CODEBOOK_DEFAULT_TRAINING);
+    const auto& trace = parser.add<std::string>("trace", "Record profiling zones and write them as a Chrome trace to this file on exit.", 't', arrrgh::Optional, "");
+
+    try {
+        parser.parse(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error parsing arguments: " << e.what() << std::endl;
+        parser.show_usage(std::cerr);
+        exit(EXIT_FAILURE);
+    }
+
+    if (showHelp.value()) {
+        parser.show_usage(std::cout);
+        exit(EXIT_SUCCESS);
+    }
+
+    CommandLineOptions options;
+    options.enableMusic = enableMusic.value();
+    options.enableAutoplay = false;
+    options.headless = headless.value();
+    options.modelPath = model.value();
+    options.cameraFile = cameras.value();
+    options.width = width.value();
+    options.height = height.value();
+    options.outputDirectory = output.value();
+    options.benchmark = benchmark.value();
+    options.benchmarkFrames = frames.value();
+    options.benchmarkOutput = benchmarkOutput.value();
+    options.frameStats = frameStats.value();
+    options.traceFile = trace.value();
+    options.splatLayout = splatLayout.value();
+    options.modelCacheMegabytes = modelCache.value();
+    options.pagePoolMegabytes = pagePool.value();
+    options.writePagedFile = writePaged.value();
+    std::string pruneError;
+    if (!splat_prune_options_parse(prune.value(), &options.loadOptions.prune, &pruneError)) {
+        std::cerr << pruneError << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    int codebookSize = shCodebook.value();
+    if (codebookSize < 0 || codebookSize > SH_CODEBOOK_MAX_SIZE || (codebookSize & (codebookSize - 1)) != 0) {
+        std::cerr << "Error: --sh-codebook must be a power of two up to " << SH_CODEBOOK_MAX_SIZE << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    options.loadOptions.sh_codebook.size = codebookSize;
+    options.loadOptions.sh_codebook.training_splats = size_t(std::max(shTraining.value(), 0));
+    return options;
+}
+
+
+// --write-paged: converts options.modelPath and exits
+static int write_paged(const CommandLineOptions &options)
+{
+    SplatFormat format;
+    if (!splat_format_from_name(options.splatLayout, &format)) {
+        std::cerr << "ERROR: Unknown splat layout " << options.splatLayout << std::endl;
+        return EXIT_FAILURE;
+    }
+    // Paged files don't store spherical harmonics, so there is nothing to quantize
+    ModelLoadOptions loadOptions = options.loadOptions;
+    loadOptions.sh_codebook.size = 0;
+    std::shared_ptr<GaussianSplat> splat = load_model(options.modelPath, nullptr, &loadOptions);
+    if (splat->had_error) {
+        std::cerr << "ERROR: Could not load " << options.modelPath << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::string error;
+    if (!paged_splat_write(options.writePagedFile, *splat, format, &error)) {
+        std::cerr << error << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Wrote " << options.writePagedFile << std::endl;
+    return EXIT_SUCCESS;
+}
+
+
+int main(int argc, const char* argv[])
+{
+    CommandLineOptions options = parse_command_line(argc, argv);
+    if (!options.writePagedFile.empty()) {
+        // No window needed
+        return write_paged(options);
+    }
+    if (!options.traceFile.empty()) {
+        profiler_set_enabled(true);
+    }
+
     // Initialise window using GLFW
-    GLFWwindow* window = initialise();
+    bool offscreen = options.headless || options.benchmark;
+    GLFWwindow* window = initialise(offscreen);
+
+    if (offscreen) {
+        int result = options.benchmark ? run_benchmark(window, options) : run_headless(window, options);
+        if (!options.traceFile.empty()) {
+            profiler_set_enabled(false);
+            profiler_export_chrome_trace(options.traceFile);
+        }
+        glfwTerminate();
+        return result;
+    }
+
     // Run an OpenGL application using this window
-    run_program(window);
+    run_program(window, options);
+    if (!options.traceFile.empty()) {
+        profiler_set_enabled(false);
+        profiler_export_chrome_trace(options.traceFile);
+    }
     // Terminate GLFW (no need to call glfwDestroyWindow)
     glfwTerminate();
 	// Shutdown all ImGUI stuff
@@ -1,5 +1,6 @@
 // Local headers
 #include "program.hpp"
+#include "utilities/compressedSplat.hpp"
 #include "utilities/plyParser.hpp"
 #include "utilities/window.hpp"
 #include "gamelogic.h"
@@ -18,8 +19,11 @@
 #include <utilities/shader.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <utilities/timeutils.h>
+#include <utilities/profiler.hpp>
+#include <utilities/allocationCounter.hpp>
+#include <utilities/depthKeys.hpp>
 
-#include <thread>
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
 
@@ -29,63 +33,64 @@ namespace fs = std::filesystem;
 static std::vector<std::string> list_ply_and_splat_files(const std::string& directory) {
     std::vector<std::string> files;
     for (const auto& entry : fs::directory_iterator(directory)) {
-        if (entry.path().extension() == ".ply" || entry.path().extension() == ".splat") {
+        if (entry.path().extension() == ".ply" || entry.path().extension() == ".splat" ||
+            entry.path().extension() == PAGED_SPLAT_EXTENSION || entry.path().extension() == COMPRESSED_SPLAT_EXTENSION) {
             files.push_back(entry.path().string());
         }
     }
     return files;
 }
 
-static void load_model(ProgramState *state, std::string model_path)
+void set_loaded_model(ProgramState *state, std::shared_ptr<GaussianSplat> model, std::string model_path)
 {
-    GaussianSplat new_model;
-    if (model_path == "test") {
-        std::vector<glm::vec3> ws_positions = {
-            {0.0f, 0.0f, 0.0f},
-            {1.0f, 0.0f, 0.0f},
-            // {0.0f, 1.0f, 0.0f},
-            // {0.0f, 0.0f, 1.0f}
-        };
-        std::vector<glm::vec4> rotations = {
-            {1.0f, 0.0f, 0.0f, 0.0f},
-            {1.0f, 0.0f, 0.0f, 0.0f},
-            // {1.0f, 0.0f, 0.0f, 0.0f},
-            // {1.0f, 0.0f, 0.0f, 0.0f}
-        };
-        std::vector<glm::vec3> scales = {
-            {0.03f, 0.03f, 0.03f},
-            {0.2f,  0.03f, 0.03f},
-            // {0.03f, 0.2f,  0.03f},
-            // {0.03f, 0.03f, 0.2f}
-        };
-        std::vector<glm::vec3> colors = {
-            {(0.0f - 0.5f) / 0.28209f, (0.0f - 0.5f) / 0.28209f, (1.0f - 0.5f) / 0.28209f},
-            {(1.0f - 0.5f) / 0.28209f, (0.0f - 0.5f) / 0.28209f, (0.0f - 0.5f) / 0.28209f},
-            // {(0.0f - 0.5f) / 0.28209f, (1.0f - 0.5f) / 0.28209f, (0.0f - 0.5f) / 0.28209f},
-            // {(0.0f - 0.5f) / 0.28209f, (0.0f - 0.5f) / 0.28209f, (1.0f - 0.5f) / 0.28209f}
-        };
-        std::vector<float> opacities = {1.0f, 1.0f};//, 1.0f, 1.0f};
-        new_model.count = 2;
-        new_model.ws_positions = ws_positions;
-        new_model.scales = scales;
-        new_model.rotations = rotations;
-        new_model.colors = colors;
-        new_model.opacities = opacities;
+    state->loaded_model = std::move(model);
+    state->current_model = model_path;
+    state->change_model = true;
+}
+
+// Shows a model straight from the cache, or starts loading it
+static void select_model(ProgramState *state, const std::string &model_path)
+{
+    if (std::shared_ptr<GaussianSplat> cached = model_cache_get(&state->model_cache, model_path)) {
+        // A load that is still running would replace this model when done
+        model_loader_cancel(&state->model_loader);
+        set_loaded_model(state, std::move(cached), model_path);
     } else {
-        new_model = gaussian_splat_from_file(model_path);
+        model_loader_request(&state->model_loader, model_path);
     }
+}
 
-    std::cout << "Loaded new model:" << std::endl;
-    gaussian_splat_print(new_model);
-    state->loaded_model = new_model;
-    state->current_model = model_path;
-    state->change_model = true;
-    state->is_loading_model = false;
+// Schedules prefetching of the neighbours of the current model in the list, the next one first
+// as models are usually stepped through forwards. Models that are cached already, or that would
+// not fit in the unused part of the cache budget, are skipped.
+static void prefetch_neighbours(ProgramState *state)
+{
+    std::vector<std::string> paths;
+    auto it = std::find(state->all_models.begin(), state->all_models.end(), state->current_model);
+    if (state->prefetch_models && it != state->all_models.end()) {
+        size_t index = size_t(it - state->all_models.begin());
+        size_t free_bytes = state->model_cache.budget_bytes - std::min(state->model_cache.used_bytes, state->model_cache.budget_bytes);
+        for (size_t neighbour : { index + 1, index - 1 }) {
+            if (neighbour >= state->all_models.size()) {
+                continue;
+            }
+            const std::string &path = state->all_models[neighbour];
+            size_t bytes = model_cache_estimate_bytes(path);
+            if (path == "test" || model_cache_contains_path(&state->model_cache, path) || bytes == 0 || bytes > free_bytes) {
+                continue;
+            }
+            paths.push_back(path);
+            free_bytes -= bytes;
+        }
+    }
+    model_loader_prefetch(&state->model_loader, paths);
+    state->prefetched_around = state->current_model;
 }
 
 
 static void imgui_draw(ProgramState *state)
 {
+    PROFILE_ZONE("imgui draw");
     // Find currently selected model so we can default the dropdown list of models to it
     size_t selected_model_index = 0;
     for (size_t i = 0; i < state->all_models.size(); i++) {
@@ -107,30 +112,28 @@ static void imgui_draw(ProgramState *state)
         float time = ImGui::GetTime();
         char spinner[4] = {"|/-\\"[(int)(time * 10) % 4], 0};
         ImGui::Text("%s", spinner);
+
+        std::shared_ptr<LoadProgress> progress = model_loader_progress(&state->model_loader);
+        if (progress) {
+            size_t bytes_total = progress->bytes_total;
+            float fraction = bytes_total > 0 ? float(progress->bytes_read) / float(bytes_total) : 0.0f;
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "%zu / %zu splats", size_t(progress->splats_decoded),
+                     size_t(progress->splats_total));
+            ImGui::ProgressBar(fraction, ImVec2(-1, 0), overlay);
+        }
     }
 
-    // TODO: For large models, we could consider caching the parsed splat file
     if (!state->all_models.empty()) {
         char *preview_value = (char *)state->all_models[selected_model_index].c_str();
         if (ImGui::BeginCombo("Select Model", preview_value)) {
             for (size_t i = 0; i < state->all_models.size(); i++) {
                 bool is_selected = selected_model_index == i;
-                // Disable selection if currently loading a model
-                if (!state->is_loading_model && 
-                    ImGui::Selectable(state->all_models[i].c_str(), is_selected) &&
+                // Picking a model while another one is loading cancels the other load
+                if (ImGui::Selectable(state->all_models[i].c_str(), is_selected) &&
                     selected_model_index != i) {
-                    // This path is only taken if a new model is selected and no other models
-                    // are already loading. Since we only allow one thread we don't need
-                    // any synchronization mechanisms here.
                     selected_model_index = i;
-                    std::string selected_model = state->all_models[i];
-                    
-                    // Create a new detatched thread for loading the splat file
-                    state->is_loading_model = true;
-                    std::thread loading_thread([state, selected_model]() {
-                        load_model(state, selected_model);
-                    });
-                    loading_thread.detach();
+                    select_model(state, state->all_models[i]);
                 }
 
                 if (is_selected) {
@@ -143,16 +146,55 @@ static void imgui_draw(ProgramState *state)
 
     // Display data for the currently chosen model
     if (ImGui::CollapsingHeader("Model Statistics")) {
-        ImGui::Text("Vertex Count: %zu", state->loaded_model.count);
-        ImGui::Text("Load time: %f (ms)", state->loaded_model.load_time_in_ms);
+        ImGui::Text("Vertex Count: %zu", state->loaded_model->count);
+        if (state->loaded_model->pruned_count > 0) {
+            ImGui::Text("Pruned: %zu", state->loaded_model->pruned_count);
+        }
+        if (const ShCodebook *codebook = state->loaded_model->sh_codebook.get()) {
+            ImGui::Text("SH codebook: %zu entries, built in %.1f ms", codebook->entries.size(), codebook->stats.build_ms);
+            ImGui::Text("SH RMS error: %.4f (of %.4f)", codebook->stats.rms_error, codebook->stats.rms_value);
+        }
+        ImGui::Text("Load time: %f (ms)", state->loaded_model->load_time_in_ms);
         ImGui::Text("Depth sort time: %f (ms)", state->depth_sort_time_in_ms);
+        if (state->depth_sort && !state->loaded_model->paged) {
+            ImGui::Text("Sorted: %zu in the frustum (%s keys)", state->sorted_splats, depth_keys_instruction_set());
+        }
+        ImGui::Text("Allocations: %llu last frame, %llu in the sort", (unsigned long long)state->frame_allocations,
+                    (unsigned long long)state->sort_allocations);
+        ImGui::Text("Sort arena: %.1f MB%s", state->sort_arena_bytes / (1024.0 * 1024.0),
+                    state->sort_arena_huge_pages ? ", huge pages" : "");
+
+        // Counted on the GPU, a few frames behind like the timers below
+        ImGui::Checkbox("Frame statistics", &state->frame_stats);
+        if (state->frame_stats) {
+            const FrameStats &stats = state->frame_stats_counter.latest;
+            double pixels = double(state->windowWidth) * double(state->windowHeight);
+            ImGui::Text("Visible splats: %llu", (unsigned long long)stats.visible_splats);
+            ImGui::Text("Average quad: %.1f pixels", stats.average_quad_area);
+            ImGui::Text("Fragments: %llu shaded, %llu discarded", (unsigned long long)stats.fragments_shaded,
+                        (unsigned long long)stats.fragments_discarded);
+            ImGui::Text("Overdraw: %.1f fragments per pixel", pixels > 0.0 ? stats.fragments_shaded / pixels : 0.0);
+        }
+
+        // GPU time per pass. These lag a few frames behind so reading them never stalls.
+        for (int pass = 0; pass < GPU_PASS_COUNT; pass++) {
+            const GpuTimer &timer = state->gpu_timers[pass];
+            if (pass == GPU_PASS_UPLOAD && !state->gpu_upload_timed) {
+                ImGui::Text("GPU %s: not timed, written to persistent mapped memory", gpu_pass_names[pass]);
+                continue;
+            }
+            char overlay[64];
+            snprintf(overlay, sizeof(overlay), "GPU %s: %.3f ms", gpu_pass_names[pass], timer.latest_ms);
+            ImGui::PlotLines(gpu_pass_names[pass], timer.history, GPU_TIMER_HISTORY_SIZE,
+                             (int)timer.history_offset, overlay, 0.0f, FLT_MAX, ImVec2(0, 40));
+        }
     }
 
     // Display any warnings or errors for the currently chosen model
-    if (state->loaded_model.had_error) {
+    if (state->loaded_model->had_error) {
         ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "Model loaded with errors:");
         if (ImGui::BeginChild("ModelErrors", ImVec2(0, 100), true)) {
-            for (const auto& message : state->loaded_model.warning_and_error_messages) {
+            for (const auto& message : state->loaded_model->warning_and_error_messages) {
                 // TODO: should probably have a tag or something on the error message
                 //       stupid to have to to string compares all the time
 
@@ -167,26 +209,185 @@ static void imgui_draw(ProgramState *state)
             }
             ImGui::EndChild();
         }
-    } else if (!state->loaded_model.warning_and_error_messages.empty()) {
+    } else if (!state->loaded_model->warning_and_error_messages.empty()) {
         // No errors, but some warnings
         ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.0f, 1.0f), "Model loaded with warnings:");
         if (ImGui::BeginChild("ModelWarnings", ImVec2(0, 100), true)) {
-            for (const auto& message : state->loaded_model.warning_and_error_messages) {
+            for (const auto& message : state->loaded_model->warning_and_error_messages) {
                 ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.0f, 1.0f), "%s", message.c_str());
             }
             ImGui::EndChild();
         }
     }
 
+    if (ImGui::CollapsingHeader("Model Cache")) {
+        ModelCache &cache = state->model_cache;
+        const double mb = 1024.0 * 1024.0;
+        ImGui::Text("%zu models, %.0f / %.0f MB", cache.entries.size(), cache.used_bytes / mb, cache.budget_bytes / mb);
+        ImGui::Text("Hits: %zu | Misses: %zu", cache.hits, cache.misses);
+        if (ImGui::Checkbox("Prefetch neighbours", &state->prefetch_models)) {
+            prefetch_neighbours(state);
+        }
+        int budget_mb = int(cache.budget_bytes / (1024 * 1024));
+        if (ImGui::SliderInt("Budget (MB)", &budget_mb, 0, 32768)) {
+            model_cache_set_budget(&cache, size_t(budget_mb) * 1024 * 1024);
+        }
+        if (ImGui::Button("Clear cache")) {
+            model_cache_clear(&cache);
+        }
+        for (const ModelCacheEntry &entry : cache.entries) {
+            ImGui::BulletText("%s (%.0f MB)", entry.model->filename.c_str(), entry.bytes / mb);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Camera Path")) {
+        static char camera_path_file[256] = "camera_path.txt";
+        ImGui::Text("Keyframes: %zu", state->camera_path.size());
+
+        if (state->recording_camera_path) {
+            if (ImGui::Button("Stop recording")) {
+                state->recording_camera_path = false;
+            }
+        } else if (ImGui::Button("Record")) {
+            state->camera_path.clear();
+            state->playing_camera_path = false;
+            state->recording_camera_path = true;
+        }
+        ImGui::SameLine();
+        if (state->playing_camera_path) {
+            if (ImGui::Button("Stop")) {
+                state->playing_camera_path = false;
+            }
+        } else if (ImGui::Button("Play") && !state->camera_path.empty()) {
+            state->recording_camera_path = false;
+            state->camera_path_time = 0.0f;
+            state->playing_camera_path = true;
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox("Loop", &state->loop_camera_path);
+        ImGui::SliderFloat("Keyframes per frame", &state->camera_path_speed, 0.1f, 4.0f);
+
+        ImGui::InputText("File", camera_path_file, sizeof(camera_path_file));
+        if (ImGui::Button("Save")) {
+            camera_poses_to_file(camera_path_file, state->camera_path);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Load")) {
+            std::vector<CameraPose> poses;
+            if (camera_poses_from_file(camera_path_file, poses)) {
+                state->camera_path = poses;
+                state->recording_camera_path = false;
+                state->playing_camera_path = false;
+            }
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Profiler")) {
+        static char trace_file[256] = "trace.json";
+        bool capturing = profiler_is_enabled.load();
+        if (!capturing && ImGui::Button("Start capture")) {
+            profiler_clear();
+            profiler_set_enabled(true);
+        } else if (capturing && ImGui::Button("Stop capture and save")) {
+            profiler_set_enabled(false);
+            profiler_export_chrome_trace(trace_file);
+        }
+        ImGui::InputText("Trace file", trace_file, sizeof(trace_file));
+    }
+
     ImGui::SliderFloat("Scale multipler", &state->scale_multiplier, 0.1, 3.0);
     ImGui::Checkbox("Depth sort", &state->depth_sort);
+    if (state->depth_sort && ImGui::CollapsingHeader("Sort Schedule")) {
+        SortSchedule &schedule = state->sort_schedule;
+        const char *orders[] = { "View depth", "Distance to camera" };
+        int order = static_cast<int>(schedule.order);
+        if (ImGui::Combo("Sort by", &order, orders, IM_ARRAYSIZE(orders))) {
+            schedule.order = static_cast<SortOrder>(order);
+        }
+        ImGui::SliderFloat("Max translation", &schedule.max_translation, 0.0f, 1.0f, "%.3f");
+        if (schedule.order == SORT_ORDER_VIEW_DEPTH) {
+            ImGui::SliderFloat("Max rotation", &schedule.max_rotation, 0.0f, 10.0f, "%.2f deg");
+        }
+        ImGui::SliderFloat("Max error", &schedule.max_error, 0.0f, 0.05f, "%.4f");
+        const SortSchedulerStats &stats = state->sort_schedule_stats;
+        ImGui::Text("Since the last sort: %.3f units, %.2f deg, %.2f%% out of order", stats.translation, stats.rotation,
+                    stats.error * 100.0f);
+        ImGui::Text("Sorts: %zu | Reused: %zu", stats.sorts, stats.skips);
+        ImGui::Checkbox("Sort in the background", &state->async_sort);
+        if (state->async_sort) {
+            ImGui::Checkbox("Sort for the predicted camera", &state->predict_sort);
+            ImGui::Text("Sort latency: %.1f ms", state->sort_latency_ms);
+        }
+        ApproximateSort &approximate = state->approximate_sort;
+        ImGui::Checkbox("Approximate sort", &approximate.enabled);
+        if (approximate.enabled) {
+            int bucket_bits = 0;
+            while ((1u << (bucket_bits + 1)) <= approximate.buckets) {
+                bucket_bits++;
+            }
+            if (ImGui::SliderInt("Buckets (log2)", &bucket_bits, 8, 20)) {
+                approximate.buckets = 1u << bucket_bits;
+            }
+            ImGui::SliderFloat("Exact within", &approximate.exact_depth, 0.0f, 50.0f, "%.2f units");
+            const SortQuality &quality = state->sort_quality;
+            ImGui::Text("Against the exact order: %.2f%% swapped, max %.3f%% depth error", quality.swapped * 100.0f,
+                        quality.max_error * 100.0f);
+        }
+    }
+    ImGui::Checkbox("GPU culling", &state->gpu_culling);
+    if (state->gpu_culling) {
+        ImGui::SliderFloat("Min contribution", &state->min_contribution, 0.0f, 1.0f, "%.4f", ImGuiSliderFlags_Logarithmic);
+    }
+
+    if (ImGui::CollapsingHeader("GPU Format")) {
+        // The model is repacked when any of these change
+        SplatFormat &format = state->splat_format;
+        const char *position_formats[] = { "fp32", "fp16 chunk relative" };
+        const char *color_formats[] = { "fp32", "rgba8" };
+        const char *precisions[] = { "fp32", "fp16" };
+        int position = static_cast<int>(format.position);
+        int color = static_cast<int>(format.color);
+        int scale = static_cast<int>(format.scale);
+        int rotation = static_cast<int>(format.rotation);
+        if (ImGui::Combo("Position", &position, position_formats, IM_ARRAYSIZE(position_formats))) {
+            format.position = static_cast<SplatPositionFormat>(position);
+        }
+        if (ImGui::Combo("Color and opacity", &color, color_formats, IM_ARRAYSIZE(color_formats))) {
+            format.color = static_cast<SplatColorFormat>(color);
+        }
+        if (ImGui::Combo("Scale", &scale, precisions, IM_ARRAYSIZE(precisions))) {
+            format.scale = static_cast<SplatPrecision>(scale);
+        }
+        if (ImGui::Combo("Rotation", &rotation, precisions, IM_ARRAYSIZE(precisions))) {
+            format.rotation = static_cast<SplatPrecision>(rotation);
+        }
+        ImGui::Checkbox("Separate attribute arrays", &format.separate);
+        size_t stride = splat_layout_make(format).stride;
+        ImGui::Text("%zu bytes per splat, %.1f MB", stride, stride * state->loaded_model->count / (1024.0 * 1024.0));
+        if (state->loaded_model->paged) {
+            ImGui::Text("Paged models keep the format they were written in");
+        }
+    }
+
+    if (state->loaded_model->paged && ImGui::CollapsingHeader("Paging")) {
+        const SplatPagerStats &stats = state->paging_stats;
+        ImGui::Text("Resident pages: %zu / %zu slots, %zu pages", stats.resident, stats.slots, stats.pages);
+        ImGui::Text("Visible pages: %zu | Pending reads: %zu", stats.visible, stats.pending);
+        ImGui::Text("Loaded: %zu | Evicted: %zu", stats.loaded, stats.evicted);
+        ImGui::Text("Pool: %.0f MB", stats.pool_bytes / (1024.0 * 1024.0));
+        // Takes effect the next time a paged model is set up
+        ImGui::SliderInt("Pool budget (MB)", &state->page_pool_megabytes, 64, 16384);
+    }
 
     // Draw mode
-    const char *draw_modes[] = { "Normal", "Quad", "Albedo", "Depth", "Point Cloud" };
+    const char *draw_modes[] = { "Normal", "Quad", "Albedo", "Depth", "Point Cloud", "Overdraw" };
     int current_draw_mode = static_cast<int>(state->draw_mode);
     if (ImGui::Combo("Draw Mode", &current_draw_mode, draw_modes, IM_ARRAYSIZE(draw_modes))) {
         state->draw_mode = static_cast<DrawMode>(current_draw_mode);
     }
+    if (state->draw_mode == Overdraw) {
+        ImGui::SliderFloat("Max overdraw", &state->max_overdraw, 1.0f, 1024.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+    }
 
     ImGui::Text("Help:");
     const char *help_text =
@@ -195,19 +396,17 @@ static void imgui_draw(ProgramState *state)
         "- Camera controls:\n"
         "  * Move: WASD, Space (up), Left Shift (down)\n"
         "  * Look: Hold Right Mouse Button and move the mouse\n"
+        "- Camera paths can be recorded, replayed and saved under 'Camera Path'.\n"
         "\n";
 
     ImGuiInputTextFlags flags = ImGuiInputTextFlags_ReadOnly;
     ImGui::InputTextMultiline("##help_text", (char*)help_text, strlen(help_text) + 1,
-                              ImVec2(-FLT_MIN, ImGui::GetTextLineHeight() * 8), flags);
+                              ImVec2(-FLT_MIN, ImGui::GetTextLineHeight() * 9), flags);
     ImGui::End();
 }
 
-void run_program(GLFWwindow* window)
+void configure_opengl()
 {
-    // Disable vsync
-    glfwSwapInterval(0);
-
     // Enable depth (Z) buffer (accept "closest" fragment)
     // glEnable(GL_DEPTH_TEST);
     // glDepthFunc(GL_LESS);
@@ -227,6 +426,14 @@ void run_program(GLFWwindow* window)
 
     // Set default colour after clearing the colour buffer
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+}
+
+void run_program(GLFWwindow* window, CommandLineOptions options)
+{
+    // Disable vsync
+    glfwSwapInterval(0);
+
+    configure_opengl();
 
     // Initialise global program state
     ProgramState state;
@@ -238,19 +445,32 @@ void run_program(GLFWwindow* window)
     // std::string default_model = "test";
     auto it = std::find(state.all_models.begin(), state.all_models.end(), default_model);
 
-    if (it != state.all_models.end()) {
-        load_model(&state, *it);
-    } else if (!state.all_models.empty()) {
-        load_model(&state, state.all_models.at(0));
-    } else {
-        std::cerr << "ERROR: No .ply or .splat models found in ../res/" << std::endl;
+    if (it == state.all_models.end() && !state.all_models.empty()) {
+        it = state.all_models.begin();
+    }
+    if (it == state.all_models.end()) {
+        std::cerr << "ERROR: No .ply, .splat, .psplat or .csplat models found in ../res/" << std::endl;
         exit(1);
     }
 
-    init_game(window, state);
+    // The first model is loaded before the renderer starts, the rest in the background
+    model_cache_set_budget(&state.model_cache, size_t(std::max(options.modelCacheMegabytes, 0)) * 1024 * 1024);
+    state.page_pool_megabytes = options.pagePoolMegabytes;
+    state.model_loader.load_options = options.loadOptions;
+    std::shared_ptr<GaussianSplat> first_model = load_model(*it, nullptr, &state.model_loader.load_options);
+    model_cache_put(&state.model_cache, *it, first_model);
+    set_loaded_model(&state, std::move(first_model), *it);
+
+    init_game(window, &state);
+    model_loader_start(&state.model_loader);
 
     // Rendering Loop
+    uint64_t frame_start_allocations = allocation_count();
     while (!glfwWindowShouldClose(window)) {
+        PROFILE_ZONE("frame");
+        uint64_t allocations = allocation_count();
+        state.frame_allocations = allocations - frame_start_allocations;
+        frame_start_allocations = allocations;
 	    // Clear colour and depth buffers
 	    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -258,6 +478,26 @@ void run_program(GLFWwindow* window)
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
+        // Models are only handed over here, so the renderer never sees a model change mid-frame
+        if (std::unique_ptr<LoadedModel> loaded = model_loader_poll(&state.model_loader)) {
+            model_cache_put(&state.model_cache, loaded->path, loaded->model);
+            set_loaded_model(&state, std::move(loaded->model), loaded->path);
+        }
+        if (state.reload_model) {
+            state.reload_model = false;
+            model_loader_request(&state.model_loader, state.current_model);
+            // The request cancelled any prefetch, schedule it again once the model is back
+            state.prefetched_around.clear();
+        }
+        state.is_loading_model = model_loader_busy(&state.model_loader);
+        if (std::unique_ptr<LoadedModel> prefetched = model_loader_poll_prefetched(&state.model_loader)) {
+            model_cache_put_if_fits(&state.model_cache, prefetched->path, std::move(prefetched->model));
+        }
+        if (!state.is_loading_model && state.prefetched_around != state.current_model) {
+            prefetch_neighbours(&state);
+        }
+
+        glfwGetWindowSize(window, &state.windowWidth, &state.windowHeight);
         update_frame(window, &state);
         render_frame(window, &state);
 
@@ -268,12 +508,20 @@ void run_program(GLFWwindow* window)
         handleKeyboardInput(window);
 
 		// Renders the ImGUI elements
+        PROFILE_ZONE_NAMED(imgui_zone, "imgui render");
         ImGui::Render();
+        gpu_timer_begin(&state.gpu_timers[GPU_PASS_IMGUI]);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        gpu_timer_end(&state.gpu_timers[GPU_PASS_IMGUI]);
+        PROFILE_ZONE_END(imgui_zone);
 
         // Flip buffers
+        PROFILE_ZONE("swap buffers");
         glfwSwapBuffers(window);
     }
+
+    free_renderer(&state);
+    model_loader_stop(&state.model_loader);
 }
 
 
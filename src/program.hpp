@@ -6,10 +6,20 @@
 // System headers
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
+#include <memory>
 #include <string>
 #include <vector>
 #include <utilities/window.hpp>
 #include <utilities/plyParser.hpp>
+#include <utilities/cameraPath.hpp>
+#include <utilities/gpuTimer.hpp>
+#include <utilities/frameStats.hpp>
+#include <utilities/splatLayout.hpp>
+#include <utilities/modelLoader.hpp>
+#include <utilities/modelCache.hpp>
+#include <utilities/splatPager.hpp>
+#include <utilities/sortScheduler.hpp>
+#include <utilities/depthSorter.hpp>
 
 typedef enum {
     Normal = 0,
@@ -17,29 +27,130 @@ typedef enum {
     Albedo,
     Depth,
     Point_Cloud,
+    Overdraw, // Fragments per pixel as a heatmap, see frameStats.hpp
 } DrawMode;
 
+// CPU time in milliseconds spent in each stage of the last frame. The sort stages are zero for
+// frames where no depth sort happened, the flags tell those apart from stages that ran.
+typedef struct frame_timings_t {
+    double depth = 0.0;  // view-space depth of each splat
+    double sort = 0.0;
+    double cull = 0.0;   // issuing the GPU culling passes
+    double upload = 0.0;
+    double draw = 0.0;   // issuing the draw call, not the time the GPU spends on it
+
+    bool depth_ran = false;
+    bool sort_ran = false;   // Paged models time their whole order rebuild as the sort
+    bool upload_ran = false;
+} FrameTimings;
+
+// GPU passes measured with timer queries
+typedef enum {
+    GPU_PASS_UPLOAD = 0, // Uploading the drawing order after a depth sort
+    GPU_PASS_CULL,       // Culling and compacting the splats
+    GPU_PASS_DRAW,
+    GPU_PASS_IMGUI,
+    GPU_PASS_COUNT,
+} GpuPass;
+
+const char *const gpu_pass_names[GPU_PASS_COUNT] = { "upload", "cull", "draw", "imgui" };
+
 typedef struct program_state_t {
     std::string current_model;
     std::vector<std::string> all_models;
-    GaussianSplat loaded_model;
+    // Shared with the renderer rather than copied. The renderer frees the per-splat arrays once
+    // they are on the GPU, see gaussian_splat_release_attributes().
+    std::shared_ptr<GaussianSplat> loaded_model;
     // If true then the renderer will start to render the loaded_model and set the change_model 
     // flag back to false
     bool change_model = false;
-    bool is_loading_model = false;
+    // Background loads. Everything else in here is only touched by the render thread.
+    ModelLoader model_loader;
+    bool is_loading_model = false; // Updated from model_loader every frame
+    ModelCache model_cache;
+    // Decode the models before and after the current one in the list into the cache while idle
+    bool prefetch_models = true;
+    std::string prefetched_around; // Model the prefetch was last scheduled for
+    // Set by the renderer when it needs arrays it has already released, e.g. when depth sorting
+    // is turned on. The current model is then loaded again.
+    bool reload_model = false;
     
     float scale_multiplier = 1.0f;
     bool depth_sort = false;
     float depth_sort_time_in_ms = 0.0f;
+    // Splats that passed the frustum test of the latest depth sort, the rest is not sorted
+    size_t sorted_splats = 0;
+    // When to sort again as the camera changes
+    SortSchedule sort_schedule;
+    SortSchedulerStats sort_schedule_stats;
+    // Sort on a thread of its own and keep drawing the previous order meanwhile, for the camera
+    // pose extrapolated sort_latency_ms ahead if predict_sort is set
+    bool async_sort = true;
+    bool predict_sort = true;
+    float sort_latency_ms = 0.0f; // From requesting a background sort to drawing it, smoothed
+    // Bucket sort instead of an exact one, the depth range is that of the projection
+    ApproximateSort approximate_sort;
+    SortQuality sort_quality; // Of the latest approximate sort
+    // Frustum and contribution culling on the GPU, see splatCulling.hpp
+    bool gpu_culling = true;
+    float min_contribution = 1.0f / 255.0f;
+    FrameTimings frame_timings;
+    // Calls to operator new, see allocationCounter.hpp: on the render thread during all of the
+    // previous frame, and during the depth sort of this one, including a background sort that
+    // finished this frame. Both stay zero in steady state.
+    uint64_t frame_allocations = 0;
+    uint64_t sort_allocations = 0;
+    // Scratch memory reserved for sorting the current model, see sortArena.hpp
+    size_t sort_arena_bytes = 0;
+    bool sort_arena_huge_pages = false;
+    GpuTimer gpu_timers[GPU_PASS_COUNT];
+    // Only the glBufferSubData fallback uploads the drawing order with GL commands that can be
+    // timed. With a persistent mapping the CPU writes it directly and there is no upload pass.
+    bool gpu_upload_timed = false;
+    // Count splats, quad area and fragments of the splat draw on the GPU. Costs an atomic add per
+    // fragment, so it is off by default. Not counted in the point cloud mode.
+    bool frame_stats = false;
+    FrameStatsCounter frame_stats_counter;
+    float max_overdraw = 64.0f; // Fragments per pixel drawn white in the overdraw mode
 
     DrawMode draw_mode = Normal;
+    SplatFormat splat_format = splat_format_float32;
+    // GPU budget of the page pool of paged models, used when a paged model is set up
+    int page_pool_megabytes = SPLAT_PAGER_DEFAULT_MEGABYTES;
+    SplatPagerStats paging_stats; // Of the current model, all zero unless it is paged
+
+    // Camera path recording and playback. Playback advances by a fixed number of keyframes per
+    // rendered frame, independent of wall-clock time, so it is reproducible.
+    std::vector<CameraPose> camera_path;
+    bool recording_camera_path = false;
+    bool playing_camera_path = false;
+    bool loop_camera_path = false;
+    float camera_path_time = 0.0f;  // In keyframes
+    float camera_path_speed = 1.0f; // Keyframes per frame
 
     int windowWidth = windowWidthDefault;
     int windowHeight = windowHeightDefault;
 } ProgramState;
 
 // Main OpenGL program
-void run_program(GLFWwindow* window);
+void run_program(GLFWwindow* window, CommandLineOptions options);
+
+// Renders every camera in options.cameraFile into an offscreen framebuffer and writes the
+// results as PNGs to options.outputDirectory. No ImGui, and the window is never shown.
+// Returns EXIT_SUCCESS or EXIT_FAILURE.
+int run_headless(GLFWwindow* window, CommandLineOptions options);
+
+// Replays a camera path for options.benchmarkFrames frames and writes min/mean/percentile frame
+// and per-stage timings to options.benchmarkOutput (.json or .csv). Returns EXIT_SUCCESS or
+// EXIT_FAILURE.
+int run_benchmark(GLFWwindow* window, CommandLineOptions options);
+
+// Sets the global OpenGL state (blending, culling, clear colour, ...) used by the renderer
+void configure_opengl();
+
+// Makes model the current model and sets state->change_model. Render thread only, models
+// loaded in the background come through state->model_loader.
+void set_loaded_model(ProgramState *state, std::shared_ptr<GaussianSplat> model, std::string model_path);
 
 // Function for handling keypresses
 void handleKeyboardInput(GLFWwindow* window);
@@ -0,0 +1,59 @@
+#include "allocationCounter.hpp"
+
+#include <cstdlib>
+#include <new>
+
+// Plain data, so it is usable before any constructors run
+static thread_local uint64_t thread_allocations = 0;
+
+uint64_t allocation_count()
+{
+    return thread_allocations;
+}
+
+// The nothrow forms of operator delete default to these. The aligned forms are left alone, they
+// don't go through malloc and free, and are rare.
+void *operator new(std::size_t size)
+{
+    thread_allocations++;
+    if (void *memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    thread_allocations++;
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return ::operator new(size, std::nothrow);
+}
+
+void operator delete(void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
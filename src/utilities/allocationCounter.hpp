@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// Counts the calls to operator new of every thread, by replacing the global allocation
+// functions in allocationCounter.cpp. Cheap enough to leave on: one thread local increment per
+// allocation. Memory from malloc directly, e.g. by C libraries or the driver, is not counted.
+//
+//     uint64_t before = allocation_count();
+//     ... work ...
+//     uint64_t allocations = allocation_count() - before;
+
+// Allocations made by the calling thread so far
+uint64_t allocation_count();
@@ -0,0 +1,504 @@
+#include "blockCodec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
+#include <utility>
+
+// Shortest match worth a sequence
+#define MIN_MATCH 4
+// Long enough to stop looking for a longer one
+#define GOOD_MATCH 1024
+#define HASH_BITS 17
+// Every this many positions without a match, the search skips one more byte. Data that doesn't
+// compress is passed over quickly, and the Huffman stage still gets its literals.
+#define SKIP_MISSES 32
+#define HUFFMAN_MAX_BITS 11
+// Streams shorter than this are stored, the code lengths alone take 128 bytes
+#define HUFFMAN_MIN_SIZE 256
+
+// Block layout, integers little endian:
+//   u8 method, u32 decompressed size
+//   BLOCK_STORED: the bytes
+//   BLOCK_LZ: literals section, sequences section
+// Section layout:
+//   u8 kind, u32 decoded size
+//   SECTION_RAW: the bytes
+//   SECTION_HUFFMAN: u32 encoded size, 256 code lengths as 4-bit nibbles, LSB first bit stream
+// The sequences are varints: literal length, match length - MIN_MATCH + 1 and offset. The last
+// sequence has a match length of 0 and no offset.
+enum { BLOCK_STORED = 0, BLOCK_LZ = 1 };
+enum { SECTION_RAW = 0, SECTION_HUFFMAN = 1 };
+
+static void put_u32(std::vector<unsigned char> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        out.push_back((unsigned char)(value >> (8 * i)));
+    }
+}
+
+static uint32_t get_u32(const unsigned char *p)
+{
+    return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+}
+
+static void put_varint(std::vector<unsigned char> &out, size_t value)
+{
+    while (value >= 0x80) {
+        out.push_back((unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char)value);
+}
+
+static bool get_varint(const unsigned char *&p, const unsigned char *end, size_t *value)
+{
+    size_t result = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        unsigned char byte = *p++;
+        result |= size_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// LZ77
+//
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t hash4(const unsigned char *p)
+{
+    return (read32(p) * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static size_t match_length(const unsigned char *a, const unsigned char *b, size_t limit)
+{
+    size_t length = 0;
+    while (length + 8 <= limit) {
+        uint64_t x, y;
+        memcpy(&x, a + length, sizeof(x));
+        memcpy(&y, b + length, sizeof(y));
+        if (x != y) {
+            break;
+        }
+        length += 8;
+    }
+    while (length < limit && a[length] == b[length]) {
+        length++;
+    }
+    return length;
+}
+
+// Greedy parse with hash chains
+static void lz_parse(const unsigned char *src, size_t size, std::vector<unsigned char> &literals,
+                     std::vector<unsigned char> &sequences)
+{
+    std::vector<int32_t> head(size_t(1) << HASH_BITS, -1);
+    std::vector<int32_t> chain(size);
+    size_t anchor = 0;
+    size_t i = 0;
+    size_t misses = 0;
+    while (i + MIN_MATCH <= size) {
+        uint32_t hash = hash4(src + i);
+        size_t best_length = 0;
+        size_t best_offset = 0;
+        int32_t candidate = head[hash];
+        for (int depth = 0; candidate >= 0 && depth < BLOCK_CODEC_SEARCH_DEPTH; depth++) {
+            size_t offset = i - size_t(candidate);
+            if (offset > BLOCK_CODEC_WINDOW) {
+                break;
+            }
+            // A longer match has to agree on the byte after the current best first
+            if (src[candidate + best_length] == src[i + best_length]) {
+                size_t length = match_length(src + candidate, src + i, size - i);
+                if (length > best_length) {
+                    best_length = length;
+                    best_offset = offset;
+                    if (length >= GOOD_MATCH || i + length == size) {
+                        break;
+                    }
+                }
+            }
+            candidate = chain[candidate];
+        }
+        chain[i] = head[hash];
+        head[hash] = int32_t(i);
+
+        if (best_length < MIN_MATCH) {
+            i += 1 + misses++ / SKIP_MISSES;
+            continue;
+        }
+        misses = 0;
+        literals.insert(literals.end(), src + anchor, src + i);
+        put_varint(sequences, i - anchor);
+        put_varint(sequences, best_length - MIN_MATCH + 1);
+        put_varint(sequences, best_offset);
+        for (size_t p = i + 1; p < i + best_length && p + MIN_MATCH <= size; p++) {
+            uint32_t h = hash4(src + p);
+            chain[p] = head[h];
+            head[h] = int32_t(p);
+        }
+        i += best_length;
+        anchor = i;
+    }
+    literals.insert(literals.end(), src + anchor, src + size);
+    put_varint(sequences, size - anchor);
+    put_varint(sequences, 0);
+}
+
+//
+// Huffman
+//
+
+// Code lengths of at most HUFFMAN_MAX_BITS. Frequencies are halved until the tree is shallow enough.
+static void huffman_lengths(const uint32_t frequencies[256], uint8_t lengths[256])
+{
+    std::vector<uint32_t> weights(frequencies, frequencies + 256);
+    while (true) {
+        typedef std::pair<uint64_t, int> Node; // Weight, index
+        std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+        std::vector<int> parent(256, -1);
+        for (int s = 0; s < 256; s++) {
+            if (weights[s] > 0) {
+                queue.push({ weights[s], s });
+            }
+        }
+        memset(lengths, 0, 256);
+        if (queue.size() == 1) {
+            lengths[queue.top().second] = 1;
+            return;
+        }
+        while (queue.size() > 1) {
+            Node a = queue.top();
+            queue.pop();
+            Node b = queue.top();
+            queue.pop();
+            int node = int(parent.size());
+            parent.push_back(-1);
+            parent[a.second] = node;
+            parent[b.second] = node;
+            queue.push({ a.first + b.first, node });
+        }
+
+        // Internal nodes are created after their children, so parents are done first going backwards
+        std::vector<int> depth(parent.size(), 0);
+        for (int node = int(parent.size()) - 2; node >= 0; node--) {
+            if (parent[node] >= 0) {
+                depth[node] = depth[parent[node]] + 1;
+            }
+        }
+        int max_length = 0;
+        for (int s = 0; s < 256; s++) {
+            lengths[s] = weights[s] > 0 ? uint8_t(depth[s]) : 0;
+            max_length = std::max(max_length, int(lengths[s]));
+        }
+        if (max_length <= HUFFMAN_MAX_BITS) {
+            return;
+        }
+        for (uint32_t &weight : weights) {
+            weight = weight > 0 ? (weight + 1) / 2 : 0;
+        }
+    }
+}
+
+// Canonical codes, bit reversed for the LSB first stream. Returns false if the lengths are not a
+// valid prefix code.
+static bool huffman_codes(const uint8_t lengths[256], uint16_t codes[256])
+{
+    uint32_t length_count[HUFFMAN_MAX_BITS + 1] = {};
+    uint32_t kraft = 0;
+    for (int s = 0; s < 256; s++) {
+        if (lengths[s] > HUFFMAN_MAX_BITS) {
+            return false;
+        }
+        if (lengths[s] > 0) {
+            length_count[lengths[s]]++;
+            kraft += 1u << (HUFFMAN_MAX_BITS - lengths[s]);
+        }
+    }
+    if (kraft == 0 || kraft > (1u << HUFFMAN_MAX_BITS)) {
+        return false;
+    }
+    uint32_t next_code[HUFFMAN_MAX_BITS + 2] = {};
+    uint32_t code = 0;
+    for (int length = 1; length <= HUFFMAN_MAX_BITS; length++) {
+        code = (code + length_count[length - 1]) << 1;
+        next_code[length] = code;
+    }
+    for (int s = 0; s < 256; s++) {
+        int length = lengths[s];
+        codes[s] = 0;
+        if (length == 0) {
+            continue;
+        }
+        uint32_t c = next_code[length]++;
+        uint16_t reversed = 0;
+        for (int bit = 0; bit < length; bit++) {
+            reversed = uint16_t(reversed << 1 | ((c >> bit) & 1));
+        }
+        codes[s] = reversed;
+    }
+    return true;
+}
+
+static void encode_section(const std::vector<unsigned char> &data, std::vector<unsigned char> &out)
+{
+    if (data.size() >= HUFFMAN_MIN_SIZE) {
+        uint32_t frequencies[256] = {};
+        for (unsigned char byte : data) {
+            frequencies[byte]++;
+        }
+        uint8_t lengths[256];
+        uint16_t codes[256];
+        huffman_lengths(frequencies, lengths);
+        huffman_codes(lengths, codes);
+
+        uint64_t total_bits = 0;
+        for (int s = 0; s < 256; s++) {
+            total_bits += uint64_t(frequencies[s]) * lengths[s];
+        }
+        size_t encoded_size = size_t((total_bits + 7) / 8);
+        if (4 + 128 + encoded_size < data.size()) {
+            out.push_back(SECTION_HUFFMAN);
+            put_u32(out, uint32_t(data.size()));
+            put_u32(out, uint32_t(encoded_size));
+            for (int s = 0; s < 256; s += 2) {
+                out.push_back((unsigned char)(lengths[s] | lengths[s + 1] << 4));
+            }
+            size_t start = out.size();
+            out.resize(start + encoded_size + 8); // Slack for the 64-bit stores
+            unsigned char *p = out.data() + start;
+            uint64_t bits = 0;
+            int count = 0;
+            for (unsigned char byte : data) {
+                bits |= uint64_t(codes[byte]) << count;
+                count += lengths[byte];
+                if (count >= 32) {
+                    memcpy(p, &bits, 4);
+                    p += 4;
+                    bits >>= 32;
+                    count -= 32;
+                }
+            }
+            while (count > 0) {
+                *p++ = (unsigned char)bits;
+                bits >>= 8;
+                count -= 8;
+            }
+            out.resize(start + encoded_size);
+            return;
+        }
+    }
+    out.push_back(SECTION_RAW);
+    put_u32(out, uint32_t(data.size()));
+    out.insert(out.end(), data.begin(), data.end());
+}
+
+// max_size bounds the decoded size, so a corrupt size can't allocate more than the block needs
+static bool decode_section(const unsigned char *&p, const unsigned char *end, size_t max_size,
+                           std::vector<unsigned char> &data)
+{
+    if (end - p < 5) {
+        return false;
+    }
+    int kind = *p++;
+    size_t size = get_u32(p);
+    p += 4;
+    if (size > max_size) {
+        return false;
+    }
+    if (kind == SECTION_RAW) {
+        if (size_t(end - p) < size) {
+            return false;
+        }
+        data.assign(p, p + size);
+        p += size;
+        return true;
+    }
+    if (kind != SECTION_HUFFMAN || end - p < 4 + 128) {
+        return false;
+    }
+    size_t encoded_size = get_u32(p);
+    p += 4;
+    uint8_t lengths[256];
+    for (int s = 0; s < 256; s += 2) {
+        lengths[s] = p[s / 2] & 15;
+        lengths[s + 1] = p[s / 2] >> 4;
+    }
+    p += 128;
+    uint16_t codes[256];
+    // Codes are at least one bit long
+    if (size_t(end - p) < encoded_size || size > encoded_size * 8 || !huffman_codes(lengths, codes)) {
+        return false;
+    }
+
+    // Symbol << 4 | length for every HUFFMAN_MAX_BITS bit pattern, length 0 for unused patterns
+    std::vector<uint16_t> table(size_t(1) << HUFFMAN_MAX_BITS, 0);
+    for (int s = 0; s < 256; s++) {
+        for (size_t i = codes[s]; lengths[s] > 0 && i < table.size(); i += size_t(1) << lengths[s]) {
+            table[i] = uint16_t(s << 4 | lengths[s]);
+        }
+    }
+
+    data.resize(size);
+    const unsigned char *in = p;
+    const unsigned char *in_end = p + encoded_size;
+    uint64_t bits = 0;
+    int count = 0;
+    for (size_t i = 0; i < size; i++) {
+        while (count <= 56 && in < in_end) {
+            bits |= uint64_t(*in++) << count;
+            count += 8;
+        }
+        uint16_t entry = table[bits & ((1u << HUFFMAN_MAX_BITS) - 1)];
+        int length = entry & 15;
+        if (length == 0 || length > count) {
+            return false;
+        }
+        data[i] = (unsigned char)(entry >> 4);
+        bits >>= length;
+        count -= length;
+    }
+    p = in_end;
+    return true;
+}
+
+//
+// Blocks
+//
+
+void block_compress(const unsigned char *src, size_t size, std::vector<unsigned char> &dst)
+{
+    size_t start = dst.size();
+    if (size >= 2 * MIN_MATCH) {
+        std::vector<unsigned char> literals;
+        std::vector<unsigned char> sequences;
+        lz_parse(src, size, literals, sequences);
+        dst.push_back(BLOCK_LZ);
+        put_u32(dst, uint32_t(size));
+        encode_section(literals, dst);
+        encode_section(sequences, dst);
+        if (dst.size() - start < 5 + size) {
+            return;
+        }
+        dst.resize(start);
+    }
+    dst.push_back(BLOCK_STORED);
+    put_u32(dst, uint32_t(size));
+    dst.insert(dst.end(), src, src + size);
+}
+
+bool block_decompress(const unsigned char *src, size_t size, unsigned char *dst, size_t dst_size)
+{
+    const unsigned char *end = src + size;
+    if (size < 5 || get_u32(src + 1) != dst_size) {
+        return false;
+    }
+    int method = src[0];
+    const unsigned char *p = src + 5;
+    if (method == BLOCK_STORED) {
+        if (size_t(end - p) != dst_size) {
+            return false;
+        }
+        memcpy(dst, p, dst_size);
+        return true;
+    }
+    if (method != BLOCK_LZ) {
+        return false;
+    }
+
+    std::vector<unsigned char> literals;
+    std::vector<unsigned char> sequences;
+    // A sequence is three varints for at least MIN_MATCH bytes of output, at most 5 bytes for
+    // short matches with long offsets and a few more for the end
+    if (!decode_section(p, end, dst_size, literals) || !decode_section(p, end, 2 * dst_size + 16, sequences)) {
+        return false;
+    }
+    const unsigned char *s = sequences.data();
+    const unsigned char *s_end = s + sequences.size();
+    size_t literal = 0;
+    size_t out = 0;
+    while (true) {
+        size_t literal_length, match_code;
+        if (!get_varint(s, s_end, &literal_length) || literal_length > literals.size() - literal ||
+            literal_length > dst_size - out) {
+            return false;
+        }
+        memcpy(dst + out, literals.data() + literal, literal_length);
+        literal += literal_length;
+        out += literal_length;
+        if (!get_varint(s, s_end, &match_code)) {
+            return false;
+        }
+        if (match_code == 0) {
+            return out == dst_size && literal == literals.size();
+        }
+        size_t length = match_code + MIN_MATCH - 1;
+        size_t offset;
+        if (!get_varint(s, s_end, &offset) || offset == 0 || offset > out || length > dst_size - out) {
+            return false;
+        }
+        unsigned char *to = dst + out;
+        const unsigned char *from = to - offset;
+        if (offset >= length) {
+            memcpy(to, from, length);
+        } else {
+            // Overlapping, repeats the last offset bytes
+            for (size_t i = 0; i < length; i++) {
+                to[i] = from[i];
+            }
+        }
+        out += length;
+    }
+}
+
+//
+// Filters
+//
+
+void byte_shuffle(const unsigned char *src, size_t count, size_t element_size, unsigned char *dst)
+{
+    for (size_t i = 0; i < count; i++) {
+        for (size_t b = 0; b < element_size; b++) {
+            dst[b * count + i] = src[i * element_size + b];
+        }
+    }
+}
+
+void byte_unshuffle(const unsigned char *src, size_t count, size_t element_size, unsigned char *dst)
+{
+    for (size_t i = 0; i < count; i++) {
+        for (size_t b = 0; b < element_size; b++) {
+            dst[i * element_size + b] = src[b * count + i];
+        }
+    }
+}
+
+void delta_encode_u16(uint16_t *values, size_t count)
+{
+    uint16_t previous = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint16_t value = values[i];
+        values[i] = uint16_t(value - previous);
+        previous = value;
+    }
+}
+
+void delta_decode_u16(uint16_t *values, size_t count)
+{
+    uint16_t previous = 0;
+    for (size_t i = 0; i < count; i++) {
+        previous = uint16_t(previous + values[i]);
+        values[i] = previous;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A small self-contained block compressor, so compressed files need no external library.
+//
+// Blocks are compressed with LZ77 like zstd, split into two streams: the literals, and the
+// sequences (literal length, match length, offset). Each stream is then Huffman coded on its own
+// if that makes it smaller. Every block is independent, so blocks can be decompressed in any
+// order and on any number of threads.
+//
+// Floating point and quantized data compresses much better after a filter that brings
+// correlated bytes together, see byte_shuffle() and delta_encode_u16().
+
+// Matches are searched up to this far back
+#define BLOCK_CODEC_WINDOW (1 << 20)
+// Candidates compared per position, more is slower and compresses a little better
+#define BLOCK_CODEC_SEARCH_DEPTH 16
+
+// Appends the compressed block to dst. Never fails, blocks that don't compress are stored.
+void block_compress(const unsigned char *src, size_t size, std::vector<unsigned char> &dst);
+// Decompresses a block of exactly dst_size bytes. Returns false if the block is corrupt.
+bool block_decompress(const unsigned char *src, size_t size, unsigned char *dst, size_t dst_size);
+
+// Transposes count elements of element_size bytes into element_size planes of count bytes: the
+// first byte of every element, then the second byte and so on
+void byte_shuffle(const unsigned char *src, size_t count, size_t element_size, unsigned char *dst);
+void byte_unshuffle(const unsigned char *src, size_t count, size_t element_size, unsigned char *dst);
+
+// Replaces every value with its difference to the previous one, wrapping around. Turns slowly
+// changing values, like sorted positions, into small numbers.
+void delta_encode_u16(uint16_t *values, size_t count);
+void delta_decode_u16(uint16_t *values, size_t count);
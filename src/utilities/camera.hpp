@@ -35,6 +35,20 @@ namespace Gloom
         /* Getter for the camera position */
         glm::vec3 getPosition() const { return cPosition; }
 
+        /* Getters for the euler angles (in degrees) */
+        float getYaw() const { return yaw; }
+        float getPitch() const { return pitch; }
+
+        /* Place the camera at `position` looking in the direction given by `newYaw` and
+           `newPitch` (in degrees). Used when the camera is not driven by user input. */
+        void setPose(glm::vec3 position, float newYaw, float newPitch)
+        {
+            cPosition = position;
+            yaw = newYaw;
+            pitch = glm::clamp(newPitch, -89.0f, 89.0f);
+            updateCameraVectors();
+        }
+
         /* Handle keyboard inputs from a callback mechanism */
         void handleKeyboardInputs(int key, int action)
         {
@@ -0,0 +1,166 @@
+#include "cameraPath.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+
+// Orientation of a yaw/pitch pair as a rotation of the +x axis (yaw = pitch = 0) onto the
+// camera's front vector, see Gloom::Camera::updateCameraVectors()
+static glm::quat pose_orientation(const CameraPose &pose)
+{
+    return glm::angleAxis(glm::radians(-pose.yaw), glm::vec3(0.0f, 1.0f, 0.0f)) *
+           glm::angleAxis(glm::radians(pose.pitch), glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+static glm::vec3 catmull_rom(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, float t)
+{
+    float t2 = t * t;
+    float t3 = t2 * t;
+    return 0.5f * ((2.0f * p1) +
+                   (-p0 + p2) * t +
+                   (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 +
+                   (-p0 + 3.0f * p1 - 3.0f * p2 + p3) * t3);
+}
+
+
+bool camera_poses_from_file(const std::string &filename, std::vector<CameraPose> &poses)
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Could not open camera file " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') {
+            continue;
+        }
+
+        std::istringstream iss(line);
+        CameraPose pose;
+        if (!(iss >> pose.position.x >> pose.position.y >> pose.position.z >> pose.yaw >> pose.pitch)) {
+            std::cerr << "ERROR: " << filename << ":" << line_number
+                      << ": expected 'x y z yaw pitch'" << std::endl;
+            return false;
+        }
+        poses.push_back(pose);
+    }
+
+    return true;
+}
+
+std::vector<CameraPose> camera_orbit(glm::vec3 center, float radius, float height, size_t frames)
+{
+    std::vector<CameraPose> poses(frames);
+    for (size_t i = 0; i < frames; i++) {
+        float theta = 2.0f * float(M_PI) * float(i) / float(frames);
+        glm::vec3 offset = glm::vec3(radius * std::cos(theta), height, radius * std::sin(theta));
+        glm::vec3 front = -offset;
+
+        poses[i].position = center + offset;
+        // Inverse of Gloom::Camera::updateCameraVectors()
+        poses[i].yaw = glm::degrees(std::atan2(front.z, front.x));
+        poses[i].pitch = glm::degrees(std::asin(front.y / glm::length(front)));
+    }
+    return poses;
+}
+
+bool camera_poses_to_file(const std::string &filename, const std::vector<CameraPose> &poses)
+{
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Could not open camera file " << filename << " for writing" << std::endl;
+        return false;
+    }
+
+    file << "# x y z yaw pitch\n";
+    file.precision(9);
+    for (const CameraPose &pose : poses) {
+        file << pose.position.x << " " << pose.position.y << " " << pose.position.z << " "
+             << pose.yaw << " " << pose.pitch << "\n";
+    }
+    return bool(file);
+}
+
+CameraPose camera_path_sample(const std::vector<CameraPose> &poses, float t)
+{
+    size_t last = poses.size() - 1;
+    t = glm::clamp(t, 0.0f, float(last));
+    size_t i = std::min(size_t(t), last);
+    if (i == last) {
+        return poses[last];
+    }
+    float f = t - float(i);
+
+    // Duplicate the end points so the spline passes through the first and last pose
+    const glm::vec3 &p0 = poses[i > 0 ? i - 1 : i].position;
+    const glm::vec3 &p1 = poses[i].position;
+    const glm::vec3 &p2 = poses[i + 1].position;
+    const glm::vec3 &p3 = poses[i + 2 <= last ? i + 2 : last].position;
+
+    glm::quat q = glm::slerp(pose_orientation(poses[i]), pose_orientation(poses[i + 1]), f);
+    glm::vec3 front = glm::normalize(q * glm::vec3(1.0f, 0.0f, 0.0f));
+
+    CameraPose pose;
+    pose.position = catmull_rom(p0, p1, p2, p3, f);
+    pose.yaw = glm::degrees(std::atan2(front.z, front.x));
+    pose.pitch = glm::degrees(std::asin(glm::clamp(front.y, -1.0f, 1.0f)));
+    return pose;
+}
+
+std::vector<CameraPose> camera_path_resample(const std::vector<CameraPose> &poses, size_t frames)
+{
+    std::vector<CameraPose> resampled(frames);
+    float step = frames > 1 ? float(poses.size() - 1) / float(frames - 1) : 0.0f;
+    for (size_t i = 0; i < frames; i++) {
+        resampled[i] = camera_path_sample(poses, step * float(i));
+    }
+    return resampled;
+}
+
+// Time constant of the smoothing, in seconds
+#define CAMERA_MOTION_SMOOTHING 0.1
+// Gaps longer than this, e.g. while loading, restart the estimate
+#define CAMERA_MOTION_MAX_GAP 0.25
+
+void camera_motion_update(CameraMotion *motion, const CameraPose &pose, double time)
+{
+    double dt = time - motion->time;
+    if (!motion->valid || dt > CAMERA_MOTION_MAX_GAP) {
+        *motion = CameraMotion();
+        motion->valid = true;
+        motion->pose = pose;
+        motion->time = time;
+        return;
+    }
+    if (dt <= 0.0) {
+        return;
+    }
+
+    // Paths give yaws in (-180, 180], so take the short way around
+    float yaw_change = std::remainder(pose.yaw - motion->pose.yaw, 360.0f);
+    float alpha = float(1.0 - std::exp(-dt / CAMERA_MOTION_SMOOTHING));
+    motion->velocity = glm::mix(motion->velocity, (pose.position - motion->pose.position) / float(dt), alpha);
+    motion->yaw_rate = glm::mix(motion->yaw_rate, yaw_change / float(dt), alpha);
+    motion->pitch_rate = glm::mix(motion->pitch_rate, (pose.pitch - motion->pose.pitch) / float(dt), alpha);
+    motion->pose = pose;
+    motion->time = time;
+}
+
+CameraPose camera_motion_predict(const CameraMotion &motion, double seconds)
+{
+    CameraPose pose = motion.pose;
+    pose.position += motion.velocity * float(seconds);
+    pose.yaw += motion.yaw_rate * float(seconds);
+    pose.pitch = glm::clamp(pose.pitch + motion.pitch_rate * float(seconds), -89.0f, 89.0f);
+    return pose;
+}
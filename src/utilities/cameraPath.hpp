@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+typedef struct {
+    glm::vec3 position;
+    // Euler angles in degrees, same convention as Gloom::Camera
+    float yaw;
+    float pitch;
+} CameraPose;
+
+// Same pose as the default camera in gamelogic.cpp
+const CameraPose default_camera_pose = { glm::vec3(0.3f, 0.0f, 2.5f), -90.0f, 0.0f };
+
+// A camera path is a list of poses, one per recorded frame. Camera list files and recorded paths
+// share the same file format, so a recording can be used directly with --cameras.
+
+// Parses a camera list file. Each non-empty line that does not start with '#' is a camera on
+// the form "x y z yaw pitch". Returns false if the file could not be read or a line is malformed.
+bool camera_poses_from_file(const std::string &filename, std::vector<CameraPose> &poses);
+
+// Scripted path: `frames` poses evenly spaced on a circle around `center` in the xz-plane,
+// all looking at the center.
+std::vector<CameraPose> camera_orbit(glm::vec3 center, float radius, float height, size_t frames);
+
+// Writes poses in the format read by camera_poses_from_file()
+bool camera_poses_to_file(const std::string &filename, const std::vector<CameraPose> &poses);
+
+// Samples the path at `t`, measured in keyframes (t = 1.5 is halfway between pose 1 and 2).
+// Position is interpolated with a Catmull-Rom spline, orientation with slerp. t is clamped to
+// the path, which must not be empty.
+CameraPose camera_path_sample(const std::vector<CameraPose> &poses, float t);
+
+// Resamples the path to `frames` evenly spaced poses covering the whole path
+std::vector<CameraPose> camera_path_resample(const std::vector<CameraPose> &poses, size_t frames);
+
+// Velocity of a camera, estimated from its pose every frame. Gloom::Camera only applies input, and
+// camera paths set poses directly, so this works for both. Smoothed over about a tenth of a second.
+typedef struct {
+    bool valid = false;
+    CameraPose pose;  // Latest
+    double time = 0.0; // Of the latest pose, in seconds
+    glm::vec3 velocity = glm::vec3(0.0f); // World units per second
+    float yaw_rate = 0.0f;   // Degrees per second
+    float pitch_rate = 0.0f;
+} CameraMotion;
+
+void camera_motion_update(CameraMotion *motion, const CameraPose &pose, double time);
+// Where the camera will be in `seconds` if it keeps moving and turning like it does now
+CameraPose camera_motion_predict(const CameraMotion &motion, double seconds);
@@ -0,0 +1,468 @@
+#include "compressedSplat.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <glm/gtc/packing.hpp>
+#include "blockCodec.hpp"
+#include "parallel.hpp"
+#include "profiler.hpp"
+
+static const char compressed_splat_magic[4] = { 'S', 'P', 'L', 'Z' };
+
+// The quantized positions and the opacity change slowly between neighbouring splats, the half
+// floats are stored as they are
+static const uint64_t compressed_splat_delta_planes = 0x7 | 1 << 6;
+
+static size_t plane_count(bool with_shs)
+{
+    return COMPRESSED_SPLAT_BASE_PLANES + (with_shs ? SPHERICAL_HARMONICS_COEFFS_COUNT : 0);
+}
+
+static void write_bytes(std::ofstream &file, const void *data, size_t size)
+{
+    file.write(reinterpret_cast<const char *>(data), std::streamsize(size));
+}
+
+static uint16_t quantize(float value, float lo, float scale)
+{
+    return uint16_t(glm::clamp(std::round((value - lo) * scale), 0.0f, 65535.0f));
+}
+
+// Appends the compressed chunk of splats [first, first + count) to out
+static void encode_chunk(const GaussianSplat &splat, size_t first, size_t count, bool with_shs,
+                         CompressedSplatChunk *chunk, std::vector<unsigned char> &out)
+{
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    for (size_t i = first; i < first + count; i++) {
+        lo = glm::min(lo, splat.ws_positions[i]);
+        hi = glm::max(hi, splat.ws_positions[i]);
+    }
+    glm::vec3 extent = hi - lo;
+    glm::vec3 scale(0.0f);
+    for (int axis = 0; axis < 3; axis++) {
+        scale[axis] = extent[axis] > 0.0f ? 65535.0f / extent[axis] : 0.0f;
+    }
+
+    size_t planes = plane_count(with_shs);
+    std::vector<uint16_t> values(planes * count);
+    for (size_t i = 0; i < count; i++) {
+        size_t s = first + i;
+        uint16_t *v = values.data() + i;
+        for (int axis = 0; axis < 3; axis++) {
+            v[axis * count] = quantize(splat.ws_positions[s][axis], lo[axis], scale[axis]);
+            v[(3 + axis) * count] = glm::packHalf1x16(splat.colors[s][axis]);
+            v[(7 + axis) * count] = glm::packHalf1x16(splat.scales[s][axis]);
+        }
+        v[6 * count] = quantize(splat.opacities[s], 0.0f, 65535.0f);
+        for (int c = 0; c < 4; c++) {
+            v[(10 + c) * count] = glm::packHalf1x16(splat.rotations[s][c]);
+        }
+        for (int c = 0; with_shs && c < SPHERICAL_HARMONICS_COEFFS_COUNT; c++) {
+            v[(COMPRESSED_SPLAT_BASE_PLANES + c) * count] = glm::packHalf1x16(splat.shs[s].coeffs[c]);
+        }
+    }
+    for (size_t plane = 0; plane < planes; plane++) {
+        if (compressed_splat_delta_planes >> plane & 1) {
+            delta_encode_u16(values.data() + plane * count, count);
+        }
+    }
+
+    // Every byte plane gets its own block, and so its own Huffman table: the high bytes of the
+    // half floats are mostly exponent and compress well, the low bytes are close to noise
+    std::vector<unsigned char> shuffled(values.size() * sizeof(uint16_t));
+    byte_shuffle(reinterpret_cast<const unsigned char *>(values.data()), values.size(), sizeof(uint16_t),
+                 shuffled.data());
+    size_t byte_planes = planes * sizeof(uint16_t);
+    size_t table = out.size();
+    out.resize(table + byte_planes * sizeof(uint32_t));
+    for (size_t plane = 0; plane < byte_planes; plane++) {
+        size_t start = out.size();
+        block_compress(shuffled.data() + plane * count, count, out);
+        uint32_t size = uint32_t(out.size() - start);
+        memcpy(out.data() + table + plane * sizeof(uint32_t), &size, sizeof(size));
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        chunk->bounds_min[axis] = lo[axis];
+        chunk->bounds_max[axis] = hi[axis];
+    }
+    chunk->count = uint32_t(count);
+    chunk->raw_size = uint32_t(shuffled.size());
+}
+
+bool compressed_splat_decode_chunk(const CompressedSplatFile &file, size_t chunk, const unsigned char *data,
+                                   GaussianSplat &splat, size_t first)
+{
+    const CompressedSplatChunk &info = file.chunks[chunk];
+    size_t count = info.count;
+    size_t planes = plane_count(file.with_shs);
+    if (info.raw_size != planes * count * sizeof(uint16_t)) {
+        return false;
+    }
+    size_t byte_planes = planes * sizeof(uint16_t);
+    size_t offset = byte_planes * sizeof(uint32_t);
+    if (info.size < offset) {
+        return false;
+    }
+    std::vector<unsigned char> shuffled(info.raw_size);
+    for (size_t plane = 0; plane < byte_planes; plane++) {
+        uint32_t size;
+        memcpy(&size, data + plane * sizeof(uint32_t), sizeof(size));
+        if (size > info.size - offset || !block_decompress(data + offset, size, shuffled.data() + plane * count, count)) {
+            return false;
+        }
+        offset += size;
+    }
+    std::vector<uint16_t> values(planes * count);
+    byte_unshuffle(shuffled.data(), values.size(), sizeof(uint16_t), reinterpret_cast<unsigned char *>(values.data()));
+    for (size_t plane = 0; plane < planes; plane++) {
+        if (file.delta_planes >> plane & 1) {
+            delta_decode_u16(values.data() + plane * count, count);
+        }
+    }
+
+    glm::vec3 lo(info.bounds_min[0], info.bounds_min[1], info.bounds_min[2]);
+    glm::vec3 step = (glm::vec3(info.bounds_max[0], info.bounds_max[1], info.bounds_max[2]) - lo) / 65535.0f;
+    bool with_shs = file.with_shs && !splat.shs.empty();
+    for (size_t i = 0; i < count; i++) {
+        size_t s = first + i;
+        const uint16_t *v = values.data() + i;
+        for (int axis = 0; axis < 3; axis++) {
+            splat.ws_positions[s][axis] = lo[axis] + float(v[axis * count]) * step[axis];
+            splat.colors[s][axis] = glm::unpackHalf1x16(v[(3 + axis) * count]);
+            splat.scales[s][axis] = glm::unpackHalf1x16(v[(7 + axis) * count]);
+        }
+        splat.opacities[s] = float(v[6 * count]) * (1.0f / 65535.0f);
+        glm::vec4 rotation;
+        for (int c = 0; c < 4; c++) {
+            rotation[c] = glm::unpackHalf1x16(v[(10 + c) * count]);
+        }
+        float length_squared = glm::dot(rotation, rotation);
+        // Zero stays zero for splat_prune_test(), see normalize_quaternion() in plyParser.cpp
+        splat.rotations[s] = length_squared == 0.0f ? rotation : rotation * (1.0f / std::sqrt(length_squared));
+        for (int c = 0; with_shs && c < SPHERICAL_HARMONICS_COEFFS_COUNT; c++) {
+            splat.shs[s].coeffs[c] = glm::unpackHalf1x16(v[(COMPRESSED_SPLAT_BASE_PLANES + c) * count]);
+        }
+    }
+    return true;
+}
+
+//
+// Writing
+//
+
+bool compressed_splat_writer_open(CompressedSplatWriter *writer, const std::string &path, bool with_shs,
+                                  int threads, std::string *error)
+{
+    writer->path = path;
+    writer->with_shs = with_shs;
+    writer->threads = std::max(threads, 1);
+    writer->file.open(path, std::ios::binary | std::ios::trunc);
+    if (!writer->file.is_open()) {
+        *error = "Error: Could not open " + path + " for writing";
+        return false;
+    }
+    // Filled in by compressed_splat_writer_close()
+    CompressedSplatHeader header = {};
+    write_bytes(writer->file, &header, sizeof(header));
+    writer->offset = sizeof(header);
+    return bool(writer->file);
+}
+
+template <typename T>
+static void append_range(std::vector<T> &dst, const std::vector<T> &src)
+{
+    dst.insert(dst.end(), src.begin(), src.end());
+}
+
+template <typename T>
+static void erase_front(std::vector<T> &values, size_t count)
+{
+    values.erase(values.begin(), values.begin() + std::min(count, values.size()));
+}
+
+// Compresses and writes the whole chunks in pending, and the partial last one if `all` is set
+static bool flush_chunks(CompressedSplatWriter *writer, bool all, std::string *error)
+{
+    GaussianSplat &pending = writer->pending;
+    size_t count = pending.ws_positions.size();
+    size_t chunk_count = all ? (count + COMPRESSED_SPLAT_CHUNK_SPLATS - 1) / COMPRESSED_SPLAT_CHUNK_SPLATS
+                             : count / COMPRESSED_SPLAT_CHUNK_SPLATS;
+    if (chunk_count == 0) {
+        return true;
+    }
+
+    std::vector<CompressedSplatChunk> chunks(chunk_count);
+    std::vector<std::vector<unsigned char>> data(chunk_count);
+    parallel_for(chunk_count, writer->threads, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            size_t first = c * COMPRESSED_SPLAT_CHUNK_SPLATS;
+            size_t n = std::min<size_t>(COMPRESSED_SPLAT_CHUNK_SPLATS, count - first);
+            encode_chunk(pending, first, n, writer->with_shs, &chunks[c], data[c]);
+        }
+    });
+    for (size_t c = 0; c < chunk_count; c++) {
+        chunks[c].offset = writer->offset;
+        chunks[c].size = data[c].size();
+        write_bytes(writer->file, data[c].data(), data[c].size());
+        writer->offset += data[c].size();
+        writer->splat_count += chunks[c].count;
+        writer->chunks.push_back(chunks[c]);
+    }
+
+    size_t flushed = std::min(count, chunk_count * COMPRESSED_SPLAT_CHUNK_SPLATS);
+    erase_front(pending.ws_positions, flushed);
+    erase_front(pending.colors, flushed);
+    erase_front(pending.opacities, flushed);
+    erase_front(pending.scales, flushed);
+    erase_front(pending.rotations, flushed);
+    erase_front(pending.shs, flushed);
+    if (!writer->file) {
+        *error = "Error: Failed writing " + writer->path;
+        return false;
+    }
+    return true;
+}
+
+bool compressed_splat_writer_add(CompressedSplatWriter *writer, const GaussianSplat &splats, std::string *error)
+{
+    GaussianSplat &pending = writer->pending;
+    append_range(pending.ws_positions, splats.ws_positions);
+    append_range(pending.colors, splats.colors);
+    append_range(pending.opacities, splats.opacities);
+    append_range(pending.scales, splats.scales);
+    append_range(pending.rotations, splats.rotations);
+    if (writer->with_shs) {
+        append_range(pending.shs, splats.shs);
+        if (pending.shs.size() != pending.ws_positions.size()) {
+            *error = "Error: Splats without spherical harmonics written to a file with them";
+            return false;
+        }
+    }
+    // Enough for every thread, so compressing a chunk at a time doesn't leave cores idle
+    if (pending.ws_positions.size() < size_t(writer->threads) * COMPRESSED_SPLAT_CHUNK_SPLATS) {
+        return true;
+    }
+    return flush_chunks(writer, false, error);
+}
+
+bool compressed_splat_writer_close(CompressedSplatWriter *writer, std::string *error)
+{
+    if (!flush_chunks(writer, true, error)) {
+        return false;
+    }
+    CompressedSplatHeader header = {};
+    memcpy(header.magic, compressed_splat_magic, sizeof(header.magic));
+    header.version = COMPRESSED_SPLAT_VERSION;
+    header.flags = writer->with_shs ? COMPRESSED_SPLAT_FLAG_SHS : 0;
+    header.chunk_splats = COMPRESSED_SPLAT_CHUNK_SPLATS;
+    header.delta_planes = compressed_splat_delta_planes;
+    header.splat_count = writer->splat_count;
+    header.chunk_count = writer->chunks.size();
+    header.table_offset = writer->offset;
+    write_bytes(writer->file, writer->chunks.data(), writer->chunks.size() * sizeof(CompressedSplatChunk));
+    writer->file.seekp(0);
+    write_bytes(writer->file, &header, sizeof(header));
+    writer->file.close();
+    if (!writer->file) {
+        *error = "Error: Failed writing " + writer->path;
+        return false;
+    }
+    return true;
+}
+
+void compressed_splat_writer_sizes(const CompressedSplatWriter *writer, uint64_t *raw, uint64_t *compressed)
+{
+    *raw = 0;
+    *compressed = 0;
+    for (const CompressedSplatChunk &chunk : writer->chunks) {
+        *raw += chunk.raw_size;
+        *compressed += chunk.size;
+    }
+}
+
+//
+// Reading
+//
+
+bool compressed_splat_open(const std::string &path, CompressedSplatFile *file, std::string *error)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open()) {
+        *error = "Error: Could not open file " + path;
+        return false;
+    }
+    std::error_code size_error;
+    uint64_t file_size = std::filesystem::file_size(path, size_error);
+    if (size_error) {
+        *error = "Error: Could not get the size of " + path + ": " + size_error.message();
+        return false;
+    }
+
+    CompressedSplatHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        memcmp(header.magic, compressed_splat_magic, sizeof(header.magic)) != 0) {
+        *error = "Error: Not a compressed splat file";
+        return false;
+    }
+    if (header.version != COMPRESSED_SPLAT_VERSION) {
+        *error = "Error: Unsupported compressed splat version " + std::to_string(header.version);
+        return false;
+    }
+    // Checked without overflowing, so a damaged header can't size the chunk table beyond the file
+    if (header.table_offset > file_size ||
+        header.chunk_count > (file_size - header.table_offset) / sizeof(CompressedSplatChunk)) {
+        *error = "Error: Compressed splat file is truncated";
+        return false;
+    }
+
+    file->path = path;
+    file->with_shs = header.flags & COMPRESSED_SPLAT_FLAG_SHS;
+    file->delta_planes = header.delta_planes;
+    file->splat_count = size_t(header.splat_count);
+    file->chunks.resize(size_t(header.chunk_count));
+    in.seekg(std::streamoff(header.table_offset));
+    in.read(reinterpret_cast<char *>(file->chunks.data()), std::streamsize(file->chunks.size() * sizeof(CompressedSplatChunk)));
+    if (!in) {
+        *error = "Error: Compressed splat file is truncated";
+        return false;
+    }
+
+    // Chunks are back to back after the header, which reading them in batches relies on
+    uint64_t total = 0;
+    uint64_t next_offset = sizeof(header);
+    for (const CompressedSplatChunk &chunk : file->chunks) {
+        if (chunk.count > header.chunk_splats || chunk.offset != next_offset || chunk.size > header.table_offset ||
+            chunk.offset > header.table_offset - chunk.size) {
+            *error = "Error: Invalid chunk in compressed splat file";
+            return false;
+        }
+        total += chunk.count;
+        next_offset = chunk.offset + chunk.size;
+    }
+    if (total != header.splat_count) {
+        *error = "Error: Chunks of compressed splat file don't add up to its splat count";
+        return false;
+    }
+    return true;
+}
+
+bool compressed_splat_read_chunk(std::ifstream &in, const CompressedSplatFile &file, size_t chunk,
+                                 std::vector<unsigned char> &data)
+{
+    // Chunk sizes were checked against the file in compressed_splat_open()
+    const CompressedSplatChunk &info = file.chunks[chunk];
+    data.resize(size_t(info.size));
+    in.clear();
+    in.seekg(std::streamoff(info.offset));
+    in.read(reinterpret_cast<char *>(data.data()), std::streamsize(data.size()));
+    return bool(in);
+}
+
+// Chunks read with one read and decoded together, a few per thread
+typedef struct {
+    size_t first_chunk = 0;
+    size_t chunk_count = 0;
+    std::vector<unsigned char> data;
+} ChunkBatch;
+
+static bool read_batch(std::ifstream &in, const CompressedSplatFile &file, size_t first_chunk, size_t chunk_count,
+                       ChunkBatch &batch)
+{
+    batch.first_chunk = first_chunk;
+    batch.chunk_count = chunk_count;
+    if (chunk_count == 0) {
+        return true;
+    }
+    // Chunks are written back to back, so a batch is one contiguous range
+    const CompressedSplatChunk &last = file.chunks[first_chunk + chunk_count - 1];
+    uint64_t begin = file.chunks[first_chunk].offset;
+    batch.data.resize(size_t(last.offset + last.size - begin));
+    in.clear();
+    in.seekg(std::streamoff(begin));
+    in.read(reinterpret_cast<char *>(batch.data.data()), std::streamsize(batch.data.size()));
+    return bool(in);
+}
+
+GaussianSplat gaussian_splat_from_compressed_file(std::string filename, LoadProgress *progress)
+{
+    GaussianSplat splat;
+    splat.filename = std::filesystem::path(filename).filename().string();
+    splat.had_error = false;
+    splat.from_ply = false;
+    splat.count = 0;
+
+    CompressedSplatFile file;
+    std::string error;
+    if (!compressed_splat_open(filename, &file, &error)) {
+        splat.had_error = true;
+        splat.warning_and_error_messages.push_back(error);
+        std::cout << error << std::endl;
+        return splat;
+    }
+
+    PROFILE_ZONE("decompress chunks");
+    std::ifstream in(filename, std::ios::binary);
+    splat.from_ply = file.with_shs;
+    gaussian_splat_resize(splat, file.splat_count, file.with_shs);
+    uint64_t bytes_total = file.chunks.empty() ? 0 : file.chunks.back().offset + file.chunks.back().size;
+    set_progress_totals(progress, file.splat_count, size_t(bytes_total));
+
+    // Index of the first splat of every chunk
+    std::vector<size_t> chunk_first(file.chunks.size() + 1, 0);
+    for (size_t c = 0; c < file.chunks.size(); c++) {
+        chunk_first[c + 1] = chunk_first[c] + file.chunks[c].count;
+    }
+
+    int threads = parallel_thread_count();
+    size_t batch_chunks = size_t(threads) * 2;
+    ChunkBatch batch;
+    ChunkBatch next_batch;
+    bool ok = read_batch(in, file, 0, std::min(batch_chunks, file.chunks.size()), batch);
+    if (!ok) {
+        error = "Error: Failed reading " + filename;
+    }
+    while (ok && batch.chunk_count > 0) {
+        size_t next_first = batch.first_chunk + batch.chunk_count;
+        size_t next_count = std::min(batch_chunks, file.chunks.size() - next_first);
+        std::future<bool> next_read = std::async(std::launch::async, [&]() {
+            return read_batch(in, file, next_first, next_count, next_batch);
+        });
+
+        std::vector<uint8_t> decoded(batch.chunk_count, 0);
+        uint64_t base = file.chunks[batch.first_chunk].offset;
+        parallel_for(batch.chunk_count, threads, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++) {
+                size_t c = batch.first_chunk + b;
+                const unsigned char *data = batch.data.data() + (file.chunks[c].offset - base);
+                decoded[b] = compressed_splat_decode_chunk(file, c, data, splat, chunk_first[c]);
+            }
+        });
+        ok = next_read.get();
+        if (std::find(decoded.begin(), decoded.end(), 0) != decoded.end()) {
+            error = "Error: Corrupt chunk in " + filename;
+            ok = false;
+        } else if (!ok) {
+            error = "Error: Failed reading " + filename;
+        }
+        if (ok && !report_progress(progress, chunk_first[next_first], size_t(file.chunks[next_first - 1].offset +
+                                                                                 file.chunks[next_first - 1].size))) {
+            error = "Error: Loading was cancelled";
+            ok = false;
+        }
+        std::swap(batch, next_batch);
+    }
+
+    if (!ok) {
+        splat.had_error = true;
+        splat.warning_and_error_messages.push_back(error);
+        std::cout << error << std::endl;
+    }
+    return splat;
+}
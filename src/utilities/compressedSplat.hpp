@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "plyParser.hpp"
+
+#define COMPRESSED_SPLAT_EXTENSION ".csplat"
+#define COMPRESSED_SPLAT_VERSION 1
+// Most splats in one chunk, about 1 MB before compression, or 4 MB with spherical harmonics
+#define COMPRESSED_SPLAT_CHUNK_SPLATS 32768
+// 16-bit planes of every splat, see below
+#define COMPRESSED_SPLAT_BASE_PLANES 14
+#define COMPRESSED_SPLAT_FLAG_SHS 1
+
+// A compressed (.csplat) file stores a scene in independently compressed chunks of up to
+// COMPRESSED_SPLAT_CHUNK_SPLATS consecutive splats, so loading reads a fraction of the bytes
+// of a .ply and decompresses the chunks on all cores. Written in Morton order by splat-convert,
+// every chunk covers a small part of the scene and can be read on its own through the chunk table.
+//
+// Layout, everything little endian:
+//   CompressedSplatHeader
+//   Per chunk: uint32_t compressed size * byte plane count, then a block_compress() block of
+//              count bytes per byte plane, see blockCodec.hpp
+//   CompressedSplatChunk * chunk_count, at table_offset
+//
+// A chunk holds 16-bit planes of count values each, byte shuffled into byte planes (the low
+// bytes of all planes, then the high bytes):
+//   0-2   Position, quantized to the bounds of the chunk
+//   3-5   Color, half float
+//   6     Opacity, unorm16
+//   7-9   Scale, half float
+//   10-13 Rotation, half float
+//   14-58 Spherical harmonics, half float, only with COMPRESSED_SPLAT_FLAG_SHS
+// Planes with their bit set in delta_planes are delta encoded before shuffling.
+typedef struct {
+    char magic[4]; // "SPLZ"
+    uint32_t version;
+    uint32_t flags;
+    uint32_t chunk_splats;
+    uint64_t delta_planes;
+    uint64_t splat_count;
+    uint64_t chunk_count;
+    uint64_t table_offset;
+} CompressedSplatHeader;
+
+typedef struct {
+    // Of the splat centers, also the range the positions are quantized to
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t count;
+    uint32_t raw_size; // Decompressed
+    uint64_t offset;
+    uint64_t size;     // Compressed
+} CompressedSplatChunk;
+
+typedef struct {
+    std::string path;
+    bool with_shs = false;
+    uint64_t delta_planes = 0;
+    size_t splat_count = 0;
+    std::vector<CompressedSplatChunk> chunks;
+} CompressedSplatFile;
+
+// Writes splats a block at a time in any number of calls. Whole chunks are compressed on
+// `threads` threads as soon as there are enough of them, and the rest is kept for the next call.
+typedef struct {
+    std::ofstream file;
+    std::string path;
+    bool with_shs = false;
+    int threads = 1;
+    uint64_t splat_count = 0;
+    uint64_t offset = 0; // Of the next chunk
+    std::vector<CompressedSplatChunk> chunks;
+    GaussianSplat pending;
+} CompressedSplatWriter;
+
+bool compressed_splat_writer_open(CompressedSplatWriter *writer, const std::string &path, bool with_shs,
+                                  int threads, std::string *error);
+// Only positions, colors, opacities, scales, rotations and, if enabled, shs are used
+bool compressed_splat_writer_add(CompressedSplatWriter *writer, const GaussianSplat &splats, std::string *error);
+// Writes the last chunk, the chunk table and the header
+bool compressed_splat_writer_close(CompressedSplatWriter *writer, std::string *error);
+// Bytes of all chunks before and after compression
+void compressed_splat_writer_sizes(const CompressedSplatWriter *writer, uint64_t *raw, uint64_t *compressed);
+
+// Reads the header and the chunk table
+bool compressed_splat_open(const std::string &path, CompressedSplatFile *file, std::string *error);
+// Reads the compressed bytes of one chunk. `in` must have been opened in binary mode.
+bool compressed_splat_read_chunk(std::ifstream &in, const CompressedSplatFile &file, size_t chunk,
+                                 std::vector<unsigned char> &data);
+// Decodes one chunk into splat, starting at splat index first. The arrays must already be big
+// enough, see gaussian_splat_resize(). Only touches that range, so chunks can be decoded in parallel.
+bool compressed_splat_decode_chunk(const CompressedSplatFile &file, size_t chunk, const unsigned char *data,
+                                   GaussianSplat &splat, size_t first);
+
+// Reads all chunks, decompressing them on all cores while the next ones are read
+GaussianSplat gaussian_splat_from_compressed_file(std::string filename, LoadProgress *progress = nullptr);
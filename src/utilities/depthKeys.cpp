@@ -0,0 +1,406 @@
+#include "depthKeys.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+#include "splatCulling.hpp"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define DEPTH_KEYS_X86
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+typedef struct {
+    // Depth is dot(depth_row, (x, y, z, 1)), the negated third row of the view matrix
+    float depth_row[4];
+    // Depth is the squared distance to camera instead
+    bool distance;
+    float camera[3];
+    float planes[6][4];
+    float radius_scale;
+    bool cull;
+} KernelParams;
+
+typedef struct {
+    size_t visible = 0;
+    size_t culled = 0;
+} KernelCounts;
+
+static KernelParams kernel_params(const DepthKeyParams &params)
+{
+    KernelParams k;
+    for (int i = 0; i < 4; i++) {
+        // The camera looks down -z, so the depth is -z
+        k.depth_row[i] = -params.view[i][2];
+    }
+    k.distance = params.distance;
+    for (int i = 0; i < 3; i++) {
+        k.camera[i] = params.camera_position[i];
+    }
+    for (int p = 0; p < 6; p++) {
+        for (int i = 0; i < 4; i++) {
+            k.planes[p][i] = params.planes[p][i];
+        }
+    }
+    k.radius_scale = params.radius_scale;
+    k.cull = params.cull;
+    return k;
+}
+
+void splat_sort_positions_build(SplatSortPositions *positions, const GaussianSplat &splat)
+{
+    size_t count = splat.ws_positions.size();
+    bool has_scales = splat.scales.size() == count;
+    positions->x.resize(count);
+    positions->y.resize(count);
+    positions->z.resize(count);
+    positions->radius.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 p = splat.ws_positions[i];
+        positions->x[i] = p.x;
+        positions->y[i] = p.y;
+        positions->z[i] = p.z;
+        positions->radius[i] = has_scales ? splat_cull_data(p, splat.scales[i], 1.0f).radius
+                                          : std::numeric_limits<float>::infinity();
+    }
+}
+
+static void compute_scalar(const SplatSortPositions &positions, const KernelParams &k, size_t begin, size_t end,
+                           uint32_t *keys, uint32_t *indices, uint32_t *culled, KernelCounts *counts)
+{
+    for (size_t i = begin; i < end; i++) {
+        float x = positions.x[i], y = positions.y[i], z = positions.z[i];
+        bool visible = true;
+        if (k.cull) {
+            float radius = -positions.radius[i] * k.radius_scale;
+            for (int p = 0; p < 6; p++) {
+                const float *plane = k.planes[p];
+                visible = visible && plane[0] * x + plane[1] * y + plane[2] * z + plane[3] >= radius;
+            }
+        }
+        if (visible) {
+            float depth;
+            if (k.distance) {
+                float dx = x - k.camera[0], dy = y - k.camera[1], dz = z - k.camera[2];
+                depth = dx * dx + dy * dy + dz * dz;
+            } else {
+                depth = k.depth_row[0] * x + k.depth_row[1] * y + k.depth_row[2] * z + k.depth_row[3];
+            }
+            keys[counts->visible] = depth_key(depth);
+            indices[counts->visible++] = uint32_t(i);
+        } else {
+            culled[counts->culled++] = uint32_t(i);
+        }
+    }
+}
+
+#ifdef DEPTH_KEYS_X86
+
+// Lane permutations that move the lanes set in an 8 bit mask to the front, for the AVX2 kernel,
+// which has no compress store
+typedef struct {
+    uint32_t lanes[256][8];
+} CompressTable;
+
+static CompressTable make_compress_table()
+{
+    CompressTable table = {};
+    for (int mask = 0; mask < 256; mask++) {
+        int n = 0;
+        for (int lane = 0; lane < 8; lane++) {
+            if (mask & (1 << lane)) {
+                table.lanes[mask][n++] = uint32_t(lane);
+            }
+        }
+    }
+    return table;
+}
+
+static const CompressTable compress_table = make_compress_table();
+
+// Keys of 8 depths, see depth_key()
+TARGET_AVX2 static inline __m256i depth_keys_avx2(__m256 depth)
+{
+    __m256i bits = _mm256_castps_si256(depth);
+    __m256i negative = _mm256_srai_epi32(bits, 31);
+    return _mm256_xor_si256(bits, _mm256_andnot_si256(negative, _mm256_set1_epi32(0x7fffffff)));
+}
+
+TARGET_AVX2 static inline void compress_store_avx2(uint32_t *dst, __m256i values, int mask)
+{
+    __m256i permutation = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(compress_table.lanes[mask]));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst), _mm256_permutevar8x32_epi32(values, permutation));
+}
+
+// Stores are always 8 lanes wide, but never pass the end: at most i splats have been written
+// before the block starting at i
+TARGET_AVX2 static size_t compute_avx2(const SplatSortPositions &positions, const KernelParams &k, size_t count,
+                                       uint32_t *keys, uint32_t *indices, uint32_t *culled, KernelCounts *counts)
+{
+    const float *xs = positions.x.data(), *ys = positions.y.data(), *zs = positions.z.data();
+    const float *radii = positions.radius.data();
+    __m256 row[4];
+    for (int i = 0; i < 4; i++) {
+        row[i] = _mm256_set1_ps(k.depth_row[i]);
+    }
+    __m256 planes[6][4];
+    for (int p = 0; p < 6; p++) {
+        for (int i = 0; i < 4; i++) {
+            planes[p][i] = _mm256_set1_ps(k.planes[p][i]);
+        }
+    }
+    __m256 camera[3];
+    for (int i = 0; i < 3; i++) {
+        camera[i] = _mm256_set1_ps(k.camera[i]);
+    }
+    __m256 radius_scale = _mm256_set1_ps(-k.radius_scale);
+    __m256i index = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i step = _mm256_set1_epi32(8);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_loadu_ps(xs + i), y = _mm256_loadu_ps(ys + i), z = _mm256_loadu_ps(zs + i);
+        __m256 depth = _mm256_fmadd_ps(row[0], x, _mm256_fmadd_ps(row[1], y, _mm256_fmadd_ps(row[2], z, row[3])));
+        if (k.distance) {
+            __m256 dx = _mm256_sub_ps(x, camera[0]), dy = _mm256_sub_ps(y, camera[1]), dz = _mm256_sub_ps(z, camera[2]);
+            depth = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+        }
+        __m256i key = depth_keys_avx2(depth);
+        if (!k.cull) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(keys + i), key);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(indices + i), index);
+            index = _mm256_add_epi32(index, step);
+            continue;
+        }
+
+        __m256 min_distance = _mm256_mul_ps(_mm256_loadu_ps(radii + i), radius_scale);
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m256 distance = _mm256_fmadd_ps(planes[p][0], x, _mm256_fmadd_ps(planes[p][1], y,
+                                              _mm256_fmadd_ps(planes[p][2], z, planes[p][3])));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, min_distance, _CMP_GE_OQ));
+        }
+        int mask = _mm256_movemask_ps(inside);
+        compress_store_avx2(keys + counts->visible, key, mask);
+        compress_store_avx2(indices + counts->visible, index, mask);
+        compress_store_avx2(culled + counts->culled, index, ~mask & 0xff);
+        int visible = __builtin_popcount(unsigned(mask));
+        counts->visible += size_t(visible);
+        counts->culled += size_t(8 - visible);
+        index = _mm256_add_epi32(index, step);
+    }
+    if (!k.cull) {
+        counts->visible = i;
+    }
+    return i;
+}
+
+TARGET_AVX512 static size_t compute_avx512(const SplatSortPositions &positions, const KernelParams &k, size_t count,
+                                           uint32_t *keys, uint32_t *indices, uint32_t *culled, KernelCounts *counts)
+{
+    const float *xs = positions.x.data(), *ys = positions.y.data(), *zs = positions.z.data();
+    const float *radii = positions.radius.data();
+    __m512 row[4];
+    for (int i = 0; i < 4; i++) {
+        row[i] = _mm512_set1_ps(k.depth_row[i]);
+    }
+    __m512 planes[6][4];
+    for (int p = 0; p < 6; p++) {
+        for (int i = 0; i < 4; i++) {
+            planes[p][i] = _mm512_set1_ps(k.planes[p][i]);
+        }
+    }
+    __m512 camera[3];
+    for (int i = 0; i < 3; i++) {
+        camera[i] = _mm512_set1_ps(k.camera[i]);
+    }
+    __m512 radius_scale = _mm512_set1_ps(-k.radius_scale);
+    __m512i index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i step = _mm512_set1_epi32(16);
+    const __m512i magnitude = _mm512_set1_epi32(0x7fffffff);
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m512 x = _mm512_loadu_ps(xs + i), y = _mm512_loadu_ps(ys + i), z = _mm512_loadu_ps(zs + i);
+        __m512 depth = _mm512_fmadd_ps(row[0], x, _mm512_fmadd_ps(row[1], y, _mm512_fmadd_ps(row[2], z, row[3])));
+        if (k.distance) {
+            __m512 dx = _mm512_sub_ps(x, camera[0]), dy = _mm512_sub_ps(y, camera[1]), dz = _mm512_sub_ps(z, camera[2]);
+            depth = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dz, dz)));
+        }
+        __m512i bits = _mm512_castps_si512(depth);
+        __m512i key = _mm512_xor_si512(bits, _mm512_andnot_si512(_mm512_srai_epi32(bits, 31), magnitude));
+
+        __mmask16 inside = 0xffff;
+        if (k.cull) {
+            __m512 min_distance = _mm512_mul_ps(_mm512_loadu_ps(radii + i), radius_scale);
+            for (int p = 0; p < 6; p++) {
+                __m512 distance = _mm512_fmadd_ps(planes[p][0], x, _mm512_fmadd_ps(planes[p][1], y,
+                                                  _mm512_fmadd_ps(planes[p][2], z, planes[p][3])));
+                inside = _mm512_mask_cmp_ps_mask(inside, distance, min_distance, _CMP_GE_OQ);
+            }
+        }
+        _mm512_mask_compressstoreu_epi32(keys + counts->visible, inside, key);
+        _mm512_mask_compressstoreu_epi32(indices + counts->visible, inside, index);
+        int visible = __builtin_popcount(unsigned(inside));
+        if (visible != 16) {
+            _mm512_mask_compressstoreu_epi32(culled + counts->culled, __mmask16(~inside), index);
+        }
+        counts->visible += size_t(visible);
+        counts->culled += size_t(16 - visible);
+        index = _mm512_add_epi32(index, step);
+    }
+    return i;
+}
+
+typedef enum {
+    KERNEL_SCALAR = 0,
+    KERNEL_AVX2,
+    KERNEL_AVX512,
+} Kernel;
+
+static Kernel best_kernel()
+{
+    static const Kernel kernel = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            return KERNEL_AVX512;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return KERNEL_AVX2;
+        }
+        return KERNEL_SCALAR;
+    }();
+    return kernel;
+}
+
+#endif
+
+size_t depth_keys_compute(const SplatSortPositions &positions, const DepthKeyParams &params,
+                          uint32_t *keys, uint32_t *indices, uint32_t *culled)
+{
+    KernelParams k = kernel_params(params);
+    KernelCounts counts;
+    size_t count = positions.x.size();
+    size_t done = 0;
+#ifdef DEPTH_KEYS_X86
+    switch (best_kernel()) {
+    case KERNEL_AVX512:
+        done = compute_avx512(positions, k, count, keys, indices, culled, &counts);
+        break;
+    case KERNEL_AVX2:
+        done = compute_avx2(positions, k, count, keys, indices, culled, &counts);
+        break;
+    case KERNEL_SCALAR:
+        break;
+    }
+#endif
+    compute_scalar(positions, k, done, count, keys, indices, culled, &counts);
+    return counts.visible;
+}
+
+const uint32_t *depth_keys_sort(uint32_t *keys, uint32_t *indices, size_t count,
+                                uint32_t *keys_scratch, uint32_t *indices_scratch)
+{
+    // Least significant byte first, with the histograms of all four bytes counted in one pass
+    size_t histograms[4][256] = {};
+    for (size_t i = 0; i < count; i++) {
+        uint32_t key = keys[i];
+        histograms[0][key & 0xff]++;
+        histograms[1][(key >> 8) & 0xff]++;
+        histograms[2][(key >> 16) & 0xff]++;
+        histograms[3][key >> 24]++;
+    }
+
+    for (int pass = 0; pass < 4; pass++) {
+        size_t *histogram = histograms[pass];
+        // Nothing to do when all keys share this byte, which is common for the high bytes
+        if (count == 0 || histogram[(keys[0] >> (pass * 8)) & 0xff] == count) {
+            continue;
+        }
+        size_t offset = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            size_t n = histogram[digit];
+            histogram[digit] = offset;
+            offset += n;
+        }
+        int shift = pass * 8;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t key = keys[i];
+            size_t destination = histogram[(key >> shift) & 0xff]++;
+            keys_scratch[destination] = key;
+            indices_scratch[destination] = indices[i];
+        }
+        std::swap(keys, keys_scratch);
+        std::swap(indices, indices_scratch);
+    }
+    return indices;
+}
+
+const uint32_t *depth_keys_bucket_sort(uint32_t *keys, uint32_t *indices, size_t count, uint32_t far_key,
+                                       uint32_t near_key, uint32_t exact_key, uint32_t buckets, uint32_t *histogram,
+                                       uint32_t *keys_scratch, uint32_t *indices_scratch, const uint32_t **sorted_keys)
+{
+    // Bucket of a key in 32.32 fixed point, to avoid a division per splat. Keys closer than the
+    // near plane go into an extra bucket after the others.
+    uint64_t range = uint64_t(near_key - far_key);
+    uint64_t scale = (uint64_t(buckets) << 32) / std::max<uint64_t>(range, 1);
+    auto bucket_of = [=](uint32_t key) -> uint32_t {
+        if (key <= far_key) {
+            return 0;
+        }
+        if (key >= near_key) {
+            return buckets;
+        }
+        return uint32_t((uint64_t(key - far_key) * scale) >> 32);
+    };
+
+    memset(histogram, 0, (buckets + 1) * sizeof(uint32_t));
+    for (size_t i = 0; i < count; i++) {
+        histogram[bucket_of(keys[i])]++;
+    }
+    uint32_t offset = 0;
+    for (uint32_t b = 0; b <= buckets; b++) {
+        uint32_t n = histogram[b];
+        histogram[b] = offset;
+        offset += n;
+    }
+    size_t exact_start = histogram[std::min(bucket_of(std::max(exact_key, far_key)), buckets)];
+    size_t exact_end = histogram[buckets];
+    for (size_t i = 0; i < count; i++) {
+        uint32_t key = keys[i];
+        uint32_t destination = histogram[bucket_of(key)]++;
+        keys_scratch[destination] = key;
+        indices_scratch[destination] = indices[i];
+    }
+
+    // Splats are drawn back to front, so the closest buckets are at the end
+    size_t exact = exact_end - exact_start;
+    const uint32_t *sorted = depth_keys_sort(keys_scratch + exact_start, indices_scratch + exact_start, exact,
+                                             keys + exact_start, indices + exact_start);
+    if (sorted != indices_scratch + exact_start) {
+        memcpy(indices_scratch + exact_start, sorted, exact * sizeof(uint32_t));
+        // The keys took the same route as the indices
+        memcpy(keys_scratch + exact_start, keys + exact_start, exact * sizeof(uint32_t));
+    }
+    *sorted_keys = keys_scratch;
+    return indices_scratch;
+}
+
+const char *depth_keys_instruction_set()
+{
+#ifdef DEPTH_KEYS_X86
+    switch (best_kernel()) {
+    case KERNEL_AVX512:
+        return "AVX-512";
+    case KERNEL_AVX2:
+        return "AVX2";
+    case KERNEL_SCALAR:
+        break;
+    }
+#endif
+    return "scalar";
+}
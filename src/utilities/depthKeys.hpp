@@ -0,0 +1,100 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "plyParser.hpp"
+
+// Depth sorting with integer keys. Only the view-space z of a splat is needed for its depth,
+// which is one dot product with a row of the view matrix, so the centers are kept as separate
+// x, y and z arrays and the keys are computed 8 (AVX2) or 16 (AVX-512) splats at a time. The
+// instruction set is picked at runtime, with a scalar fallback.
+//
+// The frustum test of the GPU culling is done in the same pass: splats whose bounding sphere is
+// outside the frustum are not sorted at all, and are put before the sorted ones in the drawing
+// order so they are still drawn if the order is reused for a slightly different view.
+//
+//     splat_sort_positions_build(&positions, splat);
+//     size_t visible = depth_keys_compute(positions, params, keys, indices, culled);
+//     const uint32_t *order = depth_keys_sort(keys, indices, visible, keys_scratch, indices_scratch);
+
+// Centers and bounding sphere radii as structure of arrays
+typedef struct {
+    std::vector<float> x, y, z, radius;
+} SplatSortPositions;
+
+typedef struct {
+    glm::mat4 view;
+    // Sort by the distance to camera_position instead of the view-space depth. The order then
+    // doesn't change when the camera only rotates, but is less exact towards the edges of the view.
+    bool distance = false;
+    glm::vec3 camera_position = glm::vec3(0.0f);
+    // Splats whose bounding sphere is entirely outside one of these planes are culled, see
+    // splat_frustum_planes()
+    bool cull = false;
+    glm::vec4 planes[6];
+    float radius_scale = 1.0f; // The scale multiplier of the splats
+} DepthKeyParams;
+
+// Takes the radii from the scales. Without scales, e.g. after they have been released, the radii
+// are infinite and nothing is culled.
+void splat_sort_positions_build(SplatSortPositions *positions, const GaussianSplat &splat);
+
+// Order preserving key of a view-space depth, or a squared distance: keys ascend as the depth descends, so sorting the
+// keys in ascending order gives back to front order
+inline uint32_t depth_key(float depth)
+{
+    uint32_t bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    // Positive floats order like their bits, negative ones in reverse
+    return bits ^ ((bits >> 31) ? 0u : 0x7fffffffu);
+}
+
+// Inverse of depth_key()
+inline float depth_from_key(uint32_t key)
+{
+    uint32_t bits = key ^ ((key >> 31) ? 0u : 0x7fffffffu);
+    float depth;
+    memcpy(&depth, &bits, sizeof(depth));
+    return depth;
+}
+
+// Key of one splat, as depth_keys_compute() computes it up to rounding
+inline uint32_t depth_key_of(const DepthKeyParams &params, glm::vec3 position)
+{
+    if (params.distance) {
+        glm::vec3 offset = position - params.camera_position;
+        return depth_key(glm::dot(offset, offset));
+    }
+    return depth_key(-(params.view * glm::vec4(position, 1.0f)).z);
+}
+
+// Writes the key and index of every splat that passes the frustum test to keys and indices, and
+// the indices of the culled ones to culled, in load order. Every array needs room for all splats,
+// culled is not touched without params.cull. Returns the number of splats that passed.
+size_t depth_keys_compute(const SplatSortPositions &positions, const DepthKeyParams &params,
+                          uint32_t *keys, uint32_t *indices, uint32_t *culled);
+
+// Radix sorts indices by keys in ascending order, using the scratch arrays of the same size. The
+// result ends up in either indices or indices_scratch, and is returned.
+const uint32_t *depth_keys_sort(uint32_t *keys, uint32_t *indices, size_t count,
+                                uint32_t *keys_scratch, uint32_t *indices_scratch);
+
+// Approximate version of depth_keys_sort() in one counting pass: the splats are counted into
+// `buckets` buckets between far_key and near_key, the keys of the far and near plane, and keep
+// their order within a bucket. Keys beyond the far plane go into the first bucket, the ones
+// closer than the near plane are clipped anyway and go last, unsorted. Since the bits of
+// positive floats grow with their logarithm, the buckets are spaced logarithmically in depth.
+// Buckets from the one holding exact_key on, the ones closest to the camera where errors
+// are easiest to see, are then sorted exactly.
+//
+// histogram needs room for buckets + 1 counts. Returns the sorted indices and sets *sorted_keys to
+// their keys, both in the scratch arrays.
+const uint32_t *depth_keys_bucket_sort(uint32_t *keys, uint32_t *indices, size_t count, uint32_t far_key,
+                                       uint32_t near_key, uint32_t exact_key, uint32_t buckets, uint32_t *histogram,
+                                       uint32_t *keys_scratch, uint32_t *indices_scratch, const uint32_t **sorted_keys);
+
+// Name of the kernel depth_keys_compute() uses on this CPU
+const char *depth_keys_instruction_set();
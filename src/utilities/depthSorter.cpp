@@ -0,0 +1,174 @@
+#include "depthSorter.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include "allocationCounter.hpp"
+#include "profiler.hpp"
+#include "timeutils.h"
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t QUALITY_SAMPLES = 4096;
+
+// Splats closer than the near plane are left out, they are clipped. In distance mode the keys
+// are of squared distances, which would double the relative error.
+static SortQuality measure_quality(const uint32_t *keys, size_t count, uint32_t near_key, bool distance)
+{
+    SortQuality quality;
+    if (count < 2) {
+        return quality;
+    }
+    size_t samples = std::min(count - 1, QUALITY_SAMPLES);
+    size_t swapped = 0;
+    for (size_t i = 0; i < samples; i++) {
+        size_t j = 1 + i * (count - 1) / samples;
+        if (keys[j] < near_key && keys[j - 1] > keys[j]) {
+            swapped++;
+            float further = depth_from_key(keys[j]), closer = depth_from_key(keys[j - 1]);
+            if (distance) {
+                further = std::sqrt(further);
+                closer = std::sqrt(closer);
+            }
+            if (further > 0.0f) {
+                quality.max_error = std::max(quality.max_error, (further - closer) / further);
+            }
+        }
+    }
+    quality.swapped = float(swapped) / float(samples);
+    return quality;
+}
+
+DepthSortResult depth_sort_run(const SplatSortPositions &positions, const DepthKeyParams &params,
+                               const ApproximateSort &approximate, SortArena *arena)
+{
+    DepthSortResult result;
+    uint64_t allocations = allocation_count();
+    Clock::time_point start = Clock::now();
+    PROFILE_ZONE_NAMED(depth_zone, "depth");
+    size_t count = positions.x.size();
+    size_t buckets = approximate.enabled ? approximate.buckets + 1 : 0;
+    sort_arena_reserve(arena, (5 * count + buckets) * sizeof(uint32_t));
+    sort_arena_reset(arena);
+    uint32_t *keys = sort_arena_alloc<uint32_t>(arena, count);
+    uint32_t *indices = sort_arena_alloc<uint32_t>(arena, count);
+    uint32_t *culled = sort_arena_alloc<uint32_t>(arena, count);
+    uint32_t *keys_scratch = sort_arena_alloc<uint32_t>(arena, count);
+    uint32_t *indices_scratch = sort_arena_alloc<uint32_t>(arena, count);
+    result.visible = depth_keys_compute(positions, params, keys, indices, culled);
+    result.culled = culled;
+    result.culled_count = count - result.visible;
+    result.depth_ms = elapsed_ms(start);
+    PROFILE_ZONE_END(depth_zone);
+
+    start = Clock::now();
+    PROFILE_ZONE("sort");
+    if (approximate.enabled) {
+        // Keys of squared distances in distance mode
+        auto key_of = [&](float depth) { return depth_key(params.distance ? depth * depth : depth); };
+        uint32_t near_key = key_of(approximate.near_depth);
+        uint32_t *histogram = sort_arena_alloc<uint32_t>(arena, buckets);
+        const uint32_t *sorted_keys;
+        result.sorted = depth_keys_bucket_sort(keys, indices, result.visible, key_of(approximate.far_depth), near_key,
+                                               key_of(approximate.exact_depth),
+                                               approximate.buckets, histogram, keys_scratch, indices_scratch,
+                                               &sorted_keys);
+        result.sort_ms = elapsed_ms(start);
+        result.approximate = true;
+        result.quality = measure_quality(sorted_keys, result.visible, near_key, params.distance);
+    } else {
+        result.sorted = depth_keys_sort(keys, indices, result.visible, keys_scratch, indices_scratch);
+        result.sort_ms = elapsed_ms(start);
+    }
+    result.allocations = allocation_count() - allocations;
+    return result;
+}
+
+static void worker_main(AsyncDepthSorter *sorter)
+{
+    std::unique_lock<std::mutex> lock(sorter->mutex);
+    while (true) {
+        sorter->wake.wait(lock, [sorter] { return sorter->stopping || sorter->requested; });
+        if (!sorter->requested) {
+            return;
+        }
+        sorter->requested = false;
+        const SplatSortPositions *positions = sorter->positions;
+        DepthKeyParams params = sorter->params;
+        ApproximateSort approximate = sorter->approximate;
+        SortArena *arena = sorter->arena;
+        lock.unlock();
+
+        DepthSortResult result = depth_sort_run(*positions, params, approximate, arena);
+
+        lock.lock();
+        sorter->result = result;
+        sorter->done = true;
+        sorter->wake.notify_all();
+    }
+}
+
+void async_depth_sorter_start(AsyncDepthSorter *sorter)
+{
+    sorter->stopping = false;
+    sorter->worker = std::thread(worker_main, sorter);
+}
+
+void async_depth_sorter_stop(AsyncDepthSorter *sorter)
+{
+    {
+        std::lock_guard<std::mutex> lock(sorter->mutex);
+        sorter->stopping = true;
+    }
+    sorter->wake.notify_all();
+    if (sorter->worker.joinable()) {
+        sorter->worker.join();
+    }
+    sorter->busy = false;
+    sorter->done = false;
+}
+
+void async_depth_sorter_request(AsyncDepthSorter *sorter, const SplatSortPositions *positions,
+                                const DepthKeyParams &params, const ApproximateSort &approximate,
+                                SortArena *arena)
+{
+    {
+        std::lock_guard<std::mutex> lock(sorter->mutex);
+        sorter->positions = positions;
+        sorter->params = params;
+        sorter->approximate = approximate;
+        sorter->arena = arena;
+        sorter->requested = true;
+        sorter->done = false;
+    }
+    sorter->busy = true;
+    sorter->wake.notify_all();
+}
+
+bool async_depth_sorter_poll(AsyncDepthSorter *sorter)
+{
+    if (!sorter->busy || !sorter->done) {
+        return false;
+    }
+    // Pairs with the store under the mutex, so the result is visible
+    std::lock_guard<std::mutex> lock(sorter->mutex);
+    sorter->busy = false;
+    sorter->done = false;
+    return true;
+}
+
+bool async_depth_sorter_busy(const AsyncDepthSorter *sorter)
+{
+    return sorter->busy;
+}
+
+void async_depth_sorter_cancel(AsyncDepthSorter *sorter)
+{
+    if (!sorter->busy) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(sorter->mutex);
+    sorter->wake.wait(lock, [sorter] { return sorter->done.load(); });
+    sorter->busy = false;
+    sorter->done = false;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "depthKeys.hpp"
+#include "sortArena.hpp"
+
+// Approximate sorting for scenes too large to radix sort often, see depth_keys_bucket_sort()
+typedef struct {
+    bool enabled = false;
+    uint32_t buckets = 1 << 14;
+    // Depth range of the buckets
+    float near_depth = 0.1f;
+    float far_depth = 200.0f;
+    // Splats closer than this are sorted exactly
+    float exact_depth = 4.0f;
+} ApproximateSort;
+
+// How far an approximate order is from the exact one, measured on evenly spaced neighbouring
+// pairs, which are never swapped in the exact order
+typedef struct {
+    float swapped = 0.0f;   // Fraction of the pairs that are swapped
+    float max_error = 0.0f; // Largest depth difference of a swapped pair, relative to its depth
+} SortQuality;
+
+// A finished depth sort. The arrays live in the arena it was run with.
+typedef struct {
+    const uint32_t *sorted = nullptr; // Splats in the frustum, back to front
+    size_t visible = 0;
+    const uint32_t *culled = nullptr; // The others, in load order
+    size_t culled_count = 0;
+    double depth_ms = 0.0;
+    double sort_ms = 0.0;
+    uint64_t allocations = 0; // Calls to operator new on the thread that ran the sort
+    bool approximate = false;
+    SortQuality quality; // Only for approximate sorts
+} DepthSortResult;
+
+// Computes the depth keys and sorts them, with all scratch memory taken from arena
+DepthSortResult depth_sort_run(const SplatSortPositions &positions, const DepthKeyParams &params,
+                               const ApproximateSort &approximate, SortArena *arena);
+
+// Runs depth_sort_run() on a thread of its own, so the renderer keeps drawing with the previous
+// order until the new one is done, instead of waiting for it. One sort runs at a time. While it
+// does, the worker owns the positions and the arena it was given, and the caller must leave them
+// alone.
+//
+//     async_depth_sorter_start(&sorter);
+//     ... every frame ...
+//     if (async_depth_sorter_poll(&sorter)) {
+//         ... upload sorter.result ...
+//     }
+//     if (!async_depth_sorter_busy(&sorter) && ...) {
+//         async_depth_sorter_request(&sorter, &positions, params, approximate, &arena);
+//     }
+//     ...
+//     async_depth_sorter_stop(&sorter);
+typedef struct async_depth_sorter_t {
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    bool requested = false;
+
+    // The job, handed over under the mutex
+    const SplatSortPositions *positions = nullptr;
+    DepthKeyParams params;
+    ApproximateSort approximate;
+    SortArena *arena = nullptr;
+
+    // Set by the worker once result is written. Only touched by the caller between then and the
+    // next request.
+    std::atomic<bool> done{ false };
+    bool busy = false; // Requested and not yet polled
+    DepthSortResult result;
+} AsyncDepthSorter;
+
+void async_depth_sorter_start(AsyncDepthSorter *sorter);
+// Waits for a running sort
+void async_depth_sorter_stop(AsyncDepthSorter *sorter);
+// Starts a sort. The sorter must not be busy.
+void async_depth_sorter_request(AsyncDepthSorter *sorter, const SplatSortPositions *positions,
+                                const DepthKeyParams &params, const ApproximateSort &approximate,
+                                SortArena *arena);
+// True once, when the requested sort is done. sorter->result is valid until the next request.
+bool async_depth_sorter_poll(AsyncDepthSorter *sorter);
+bool async_depth_sorter_busy(const AsyncDepthSorter *sorter);
+// Waits for a running sort and throws its result away, e.g. before freeing its positions
+void async_depth_sorter_cancel(AsyncDepthSorter *sorter);
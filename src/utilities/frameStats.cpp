@@ -0,0 +1,157 @@
+#include "frameStats.hpp"
+
+static uint64_t combine(const uint32_t words[2])
+{
+    return uint64_t(words[0]) | (uint64_t(words[1]) << 32);
+}
+
+bool frame_stats_begin(FrameStatsCounter *counter, GLuint indirect, size_t instance_count_offset)
+{
+    if (counter->buffers[0] == 0) {
+        glGenBuffers(FRAME_STATS_RING_SIZE, counter->buffers);
+        for (size_t i = 0; i < FRAME_STATS_RING_SIZE; i++) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, counter->buffers[i]);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(FrameCounters), nullptr, GL_DYNAMIC_READ);
+        }
+    }
+
+    // The GPU is more than a ring behind. Skip this frame rather than waiting for it.
+    if (counter->fences[counter->next]) {
+        counter->active = false;
+        return false;
+    }
+
+    GLuint buffer = counter->buffers[counter->next];
+    FrameCounters zero = {};
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zero), &zero);
+    // The instance count was written by a compute shader
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glBindBuffer(GL_COPY_READ_BUFFER, indirect);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GLintptr(instance_count_offset),
+                        offsetof(FrameCounters, visible), sizeof(uint32_t));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, FRAME_STATS_BINDING, buffer);
+    counter->active = true;
+    return true;
+}
+
+void frame_stats_end(FrameStatsCounter *counter)
+{
+    if (!counter->active) {
+        return;
+    }
+
+    // Makes the atomics of the draw visible to glGetBufferSubData
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    counter->fences[counter->next] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    counter->next = (counter->next + 1) % FRAME_STATS_RING_SIZE;
+    counter->active = false;
+}
+
+size_t frame_stats_collect(FrameStatsCounter *counter)
+{
+    size_t collected = 0;
+    // Fences signal in order, so stop at the first one that hasn't
+    while (GLsync fence = counter->fences[counter->oldest]) {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+
+        FrameCounters counters;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, counter->buffers[counter->oldest]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counters), &counters);
+        FrameStats &stats = counter->latest;
+        stats.visible_splats = counters.visible;
+        stats.average_quad_area = counters.quads > 0 ? double(combine(counters.quad_area)) / counters.quads : 0.0;
+        stats.fragments_shaded = combine(counters.shaded);
+        stats.fragments_discarded = combine(counters.discarded);
+
+        glDeleteSync(fence);
+        counter->fences[counter->oldest] = 0;
+        counter->oldest = (counter->oldest + 1) % FRAME_STATS_RING_SIZE;
+        collected++;
+    }
+    return collected;
+}
+
+void frame_stats_free(FrameStatsCounter *counter)
+{
+    for (size_t i = 0; i < FRAME_STATS_RING_SIZE; i++) {
+        if (counter->fences[i]) {
+            glDeleteSync(counter->fences[i]);
+        }
+    }
+    if (counter->buffers[0] != 0) {
+        glDeleteBuffers(FRAME_STATS_RING_SIZE, counter->buffers);
+    }
+    *counter = FrameStatsCounter();
+}
+
+void overdraw_map_create_shaders(OverdrawMap *map)
+{
+    map->resolve_shader = new Gloom::Shader();
+    map->resolve_shader->makeBasicShader("../res/shaders/overdraw.vert", "../res/shaders/overdraw.frag");
+    glGenVertexArrays(1, &map->vao);
+}
+
+void overdraw_map_begin(OverdrawMap *map, int width, int height)
+{
+    if (map->counts == 0 || map->width != width || map->height != height) {
+        if (map->counts != 0) {
+            glDeleteTextures(1, &map->counts);
+        }
+        glGenTextures(1, &map->counts);
+        glBindTexture(GL_TEXTURE_2D, map->counts);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, width, height);
+        map->width = width;
+        map->height = height;
+
+        if (map->fbo == 0) {
+            glGenFramebuffers(1, &map->fbo);
+        }
+        GLint previous = 0;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, map->fbo);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, map->counts, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previous));
+    }
+
+    // GL 4.3 has no glClearTexImage, so the counts are cleared as a framebuffer
+    GLint previous = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, map->fbo);
+    const GLuint zero[4] = {};
+    glClearBufferuiv(GL_COLOR, 0, zero);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, GLuint(previous));
+
+    glBindImageTexture(OVERDRAW_IMAGE_UNIT, map->counts, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
+}
+
+void overdraw_map_resolve(OverdrawMap *map, float max_overdraw)
+{
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    map->resolve_shader->activate();
+    glUniform1f(0, max_overdraw);
+    glBindVertexArray(map->vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void overdraw_map_free(OverdrawMap *map)
+{
+    if (map->counts != 0) {
+        glDeleteTextures(1, &map->counts);
+    }
+    if (map->fbo != 0) {
+        glDeleteFramebuffers(1, &map->fbo);
+    }
+    if (map->vao != 0) {
+        glDeleteVertexArrays(1, &map->vao);
+    }
+    if (map->resolve_shader != nullptr) {
+        map->resolve_shader->destroy();
+        delete map->resolve_shader;
+    }
+    *map = OverdrawMap();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include "shader.hpp"
+
+// Shader storage binding of the counters in gaussian.vert and gaussian.frag. Bindings 0 to 7 are
+// the chunk origins and the culling.
+#define FRAME_STATS_BINDING 8
+// Image unit of the per-pixel counts of the overdraw draw mode
+#define OVERDRAW_IMAGE_UNIT 0
+// Number of frames the counters can be in flight before a frame is skipped
+#define FRAME_STATS_RING_SIZE 4
+
+// The FrameCounters block of gaussian.vert and gaussian.frag. GLSL 4.30 has no 64 bit atomics, so
+// the sums that can pass 2^32 are kept as a low and a high word.
+typedef struct {
+    uint32_t visible;       // Instance count of the draw, copied from the culling
+    uint32_t quads;         // Quads that reached the vertex shader
+    uint32_t quad_area[2];  // In pixels
+    uint32_t shaded[2];     // Fragment shader invocations
+    uint32_t discarded[2];  // Of those, discarded as transparent
+} FrameCounters;
+
+typedef struct {
+    uint64_t visible_splats = 0; // After culling
+    double average_quad_area = 0.0;
+    uint64_t fragments_shaded = 0;
+    uint64_t fragments_discarded = 0;
+} FrameStats;
+
+// Counts what the splat draw does on the GPU, to tell whether a view is bound by the vertices,
+// the fragments or the sort. The shaders only count while the count_stats uniform is set, since
+// every fragment then does an atomic add. Like GpuTimer, every frame uses the next buffer of a
+// ring and results are only read once a fence says they are done, a couple of frames later.
+//
+// Buffers are created on first use, so a zero-initialised counter is ready to use.
+typedef struct frame_stats_counter_t {
+    GLuint buffers[FRAME_STATS_RING_SIZE] = {};
+    GLsync fences[FRAME_STATS_RING_SIZE] = {}; // Set while a slot is pending
+    size_t next = 0;     // Ring slot used by the next begin
+    size_t oldest = 0;   // Oldest slot that may still be pending
+    bool active = false; // Between a begin and end that bound counters
+
+    FrameStats latest;
+} FrameStatsCounter;
+
+// Binds zeroed counters for the draw that follows, and copies the instance count the culling
+// wrote at instance_count_offset in indirect. Returns false, and nothing should be counted, when
+// the GPU is more than a ring behind.
+bool frame_stats_begin(FrameStatsCounter *counter, GLuint indirect, size_t instance_count_offset);
+void frame_stats_end(FrameStatsCounter *counter);
+// Reads all results that are ready without waiting. Returns the number of results read.
+size_t frame_stats_collect(FrameStatsCounter *counter);
+void frame_stats_free(FrameStatsCounter *counter);
+
+// Per-pixel fragment counts for the overdraw draw mode. gaussian.frag adds one for every fragment
+// it shades to the counts image, and overdraw_map_resolve() draws them over the frame as a
+// heatmap, from black through blue, green, yellow and red to white.
+typedef struct overdraw_map_t {
+    Gloom::Shader *resolve_shader = nullptr;
+    GLuint vao = 0;    // Empty, the resolve pass makes its triangle from gl_VertexID
+    GLuint counts = 0; // GL_R32UI
+    GLuint fbo = 0;    // Only used to clear counts
+    int width = 0;
+    int height = 0;
+} OverdrawMap;
+
+void overdraw_map_create_shaders(OverdrawMap *map);
+// Zeroes the counts, resized to width x height, and binds them to OVERDRAW_IMAGE_UNIT
+void overdraw_map_begin(OverdrawMap *map, int width, int height);
+// Draws the counts into the current framebuffer. max_overdraw fragments per pixel are white.
+void overdraw_map_resolve(OverdrawMap *map, float max_overdraw);
+void overdraw_map_free(OverdrawMap *map);
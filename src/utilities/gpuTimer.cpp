@@ -0,0 +1,63 @@
+#include "gpuTimer.hpp"
+
+
+void gpu_timer_begin(GpuTimer *timer)
+{
+    if (timer->queries[0][0] == 0) {
+        glGenQueries(GPU_TIMER_QUERY_RING_SIZE * 2, &timer->queries[0][0]);
+    }
+
+    // The GPU is more than a ring behind. Skip this measurement rather than waiting for it.
+    if (timer->pending[timer->next]) {
+        timer->active = false;
+        return;
+    }
+
+    glQueryCounter(timer->queries[timer->next][0], GL_TIMESTAMP);
+    timer->active = true;
+}
+
+void gpu_timer_end(GpuTimer *timer)
+{
+    if (!timer->active) {
+        return;
+    }
+
+    glQueryCounter(timer->queries[timer->next][1], GL_TIMESTAMP);
+    timer->pending[timer->next] = true;
+    timer->next = (timer->next + 1) % GPU_TIMER_QUERY_RING_SIZE;
+    timer->active = false;
+}
+
+size_t gpu_timer_collect(GpuTimer *timer)
+{
+    size_t collected = 0;
+    // Queries complete in order, so stop at the first one that isn't ready
+    while (timer->pending[timer->oldest]) {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(timer->queries[timer->oldest][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+
+        GLuint64 start_ns, end_ns;
+        glGetQueryObjectui64v(timer->queries[timer->oldest][0], GL_QUERY_RESULT, &start_ns);
+        glGetQueryObjectui64v(timer->queries[timer->oldest][1], GL_QUERY_RESULT, &end_ns);
+        timer->latest_ms = double(end_ns - start_ns) / 1e6;
+        timer->history[timer->history_offset] = float(timer->latest_ms);
+        timer->history_offset = (timer->history_offset + 1) % GPU_TIMER_HISTORY_SIZE;
+
+        timer->pending[timer->oldest] = false;
+        timer->oldest = (timer->oldest + 1) % GPU_TIMER_QUERY_RING_SIZE;
+        collected++;
+    }
+    return collected;
+}
+
+void gpu_timer_free(GpuTimer *timer)
+{
+    if (timer->queries[0][0] != 0) {
+        glDeleteQueries(GPU_TIMER_QUERY_RING_SIZE * 2, &timer->queries[0][0]);
+    }
+    *timer = GpuTimer();
+}
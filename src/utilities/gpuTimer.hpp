@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+
+// Number of frames a pass can be in flight before its timer skips a measurement
+#define GPU_TIMER_QUERY_RING_SIZE 4
+// Number of results kept for the rolling graphs
+#define GPU_TIMER_HISTORY_SIZE 120
+
+// Measures the GPU time of a pass with a pair of GL_TIMESTAMP queries around it. Every begin/end
+// uses the next pair in a ring, and results are only read once the GPU reports them as available,
+// so measuring never stalls the CPU. Results arrive a couple of frames after the pass was issued.
+//
+// Query objects are created on first use, so a zero-initialised timer is ready to use.
+typedef struct gpu_timer_t {
+    GLuint queries[GPU_TIMER_QUERY_RING_SIZE][2] = {};
+    bool pending[GPU_TIMER_QUERY_RING_SIZE] = {};
+    size_t next = 0;     // Ring slot used by the next begin
+    size_t oldest = 0;   // Oldest slot that may still be pending
+    bool active = false; // Between a begin and end that issued queries
+
+    double latest_ms = 0.0;
+    float history[GPU_TIMER_HISTORY_SIZE] = {};
+    size_t history_offset = 0;
+} GpuTimer;
+
+void gpu_timer_begin(GpuTimer *timer);
+void gpu_timer_end(GpuTimer *timer);
+// Reads all results that are ready without waiting. Returns the number of results read.
+size_t gpu_timer_collect(GpuTimer *timer);
+void gpu_timer_free(GpuTimer *timer);
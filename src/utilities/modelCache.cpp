@@ -0,0 +1,159 @@
+#include "modelCache.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include "compressedSplat.hpp"
+#include "pagedSplat.hpp"
+#include "shCodebook.hpp"
+
+
+template <typename T>
+static size_t vector_bytes(const std::vector<T> &v)
+{
+    return v.capacity() * sizeof(T);
+}
+
+size_t gaussian_splat_memory_size(const GaussianSplat &splat)
+{
+    size_t bytes = sizeof(GaussianSplat);
+    bytes += vector_bytes(splat.ws_positions);
+    bytes += vector_bytes(splat.normals);
+    bytes += vector_bytes(splat.colors);
+    bytes += vector_bytes(splat.shs);
+    bytes += vector_bytes(splat.sh_indices);
+    if (splat.sh_codebook) {
+        bytes += vector_bytes(splat.sh_codebook->entries);
+    }
+    bytes += vector_bytes(splat.opacities);
+    bytes += vector_bytes(splat.scales);
+    bytes += vector_bytes(splat.rotations);
+    for (const std::string &message : splat.warning_and_error_messages) {
+        bytes += message.capacity();
+    }
+    return bytes;
+}
+
+static void evict_to_fit(ModelCache *cache, size_t budget_bytes)
+{
+    while (cache->used_bytes > budget_bytes && !cache->entries.empty()) {
+        cache->used_bytes -= cache->entries.back().bytes;
+        cache->entries.pop_back();
+    }
+}
+
+static std::list<ModelCacheEntry>::iterator find_path(ModelCache *cache, const std::string &path)
+{
+    return std::find_if(cache->entries.begin(), cache->entries.end(),
+                        [&path](const ModelCacheEntry &entry) { return entry.path == path; });
+}
+
+std::shared_ptr<GaussianSplat> model_cache_get(ModelCache *cache, const std::string &path)
+{
+    auto it = find_path(cache, path);
+    if (it == cache->entries.end()) {
+        cache->misses++;
+        return nullptr;
+    }
+    cache->hits++;
+    cache->entries.splice(cache->entries.begin(), cache->entries, it);
+    return it->model;
+}
+
+void model_cache_put(ModelCache *cache, const std::string &path, std::shared_ptr<GaussianSplat> model)
+{
+    auto it = find_path(cache, path);
+    if (it != cache->entries.end()) {
+        cache->used_bytes -= it->bytes;
+        cache->entries.erase(it);
+    }
+
+    if (!model || model->had_error || model->attributes_released) {
+        return;
+    }
+    size_t bytes = gaussian_splat_memory_size(*model);
+    if (bytes > cache->budget_bytes) {
+        return;
+    }
+
+    evict_to_fit(cache, cache->budget_bytes - bytes);
+    cache->entries.push_front({ path, std::move(model), bytes });
+    cache->used_bytes += bytes;
+}
+
+bool model_cache_put_if_fits(ModelCache *cache, const std::string &path, std::shared_ptr<GaussianSplat> model)
+{
+    if (!model || model->had_error || model->attributes_released || model_cache_contains_path(cache, path)) {
+        return false;
+    }
+    size_t bytes = gaussian_splat_memory_size(*model);
+    if (cache->used_bytes + bytes > cache->budget_bytes) {
+        return false;
+    }
+    cache->entries.push_back({ path, std::move(model), bytes });
+    cache->used_bytes += bytes;
+    return true;
+}
+
+bool model_cache_contains(const ModelCache *cache, const GaussianSplat *model)
+{
+    for (const ModelCacheEntry &entry : cache->entries) {
+        if (entry.model.get() == model) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool model_cache_contains_path(const ModelCache *cache, const std::string &path)
+{
+    for (const ModelCacheEntry &entry : cache->entries) {
+        if (entry.path == path) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t model_cache_estimate_bytes(const std::string &path)
+{
+    std::error_code error;
+    uintmax_t file_bytes = std::filesystem::file_size(path, error);
+    if (error) {
+        return 0;
+    }
+    std::string extension = std::filesystem::path(path).extension().string();
+    // Decoded: position, color, SH, opacity, scale and rotation = 236 bytes per splat
+    if (extension == ".ply") {
+        // 62 floats per vertex in the usual files
+        return size_t(file_bytes / 248 * 236);
+    }
+    if (extension == ".splat") {
+        // 32 bytes per splat, no SH
+        return size_t(file_bytes / 32 * 56);
+    }
+    if (extension == PAGED_SPLAT_EXTENSION) {
+        // Only the page table is loaded, and opening it is quick enough to not need prefetching
+        return 0;
+    }
+    if (extension == COMPRESSED_SPLAT_EXTENSION) {
+        // Compression varies too much to go by the file size, the header has the count
+        CompressedSplatFile file;
+        std::string open_error;
+        if (compressed_splat_open(path, &file, &open_error)) {
+            return file.splat_count * (file.with_shs ? 236 : 56);
+        }
+    }
+    return size_t(file_bytes);
+}
+
+void model_cache_set_budget(ModelCache *cache, size_t budget_bytes)
+{
+    cache->budget_bytes = budget_bytes;
+    evict_to_fit(cache, budget_bytes);
+}
+
+void model_cache_clear(ModelCache *cache)
+{
+    cache->entries.clear();
+    cache->used_bytes = 0;
+}
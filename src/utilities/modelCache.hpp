@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include "plyParser.hpp"
+
+// Default budget of the model cache, --model-cache on the command line
+#define MODEL_CACHE_DEFAULT_MEGABYTES 2048
+
+typedef struct {
+    std::string path;
+    std::shared_ptr<GaussianSplat> model;
+    size_t bytes;
+} ModelCacheEntry;
+
+// Decoded models by path, so switching back to a recent model skips reading and decoding the
+// file. Least recently used models are evicted once the models take more than budget_bytes.
+// The renderer does not release the CPU arrays of cached models, see setup_gaussians().
+//
+// Only used from the render thread, so there is no locking.
+typedef struct model_cache_t {
+    size_t budget_bytes = size_t(MODEL_CACHE_DEFAULT_MEGABYTES) * 1024 * 1024;
+    size_t used_bytes = 0;
+    // Most recently used first. There are only ever a handful of models, so lookups are linear.
+    std::list<ModelCacheEntry> entries;
+    size_t hits = 0;
+    size_t misses = 0;
+} ModelCache;
+
+// Bytes held by the per-splat arrays and messages of a model
+size_t gaussian_splat_memory_size(const GaussianSplat &splat);
+
+// Returns the model and marks it as most recently used, or null
+std::shared_ptr<GaussianSplat> model_cache_get(ModelCache *cache, const std::string &path);
+// Adds or replaces the model for path. Models that had errors, have released their arrays or
+// are bigger than the whole budget are not cached.
+void model_cache_put(ModelCache *cache, const std::string &path, std::shared_ptr<GaussianSplat> model);
+// Like model_cache_put(), but never evicts. Adds the model as least recently used if it fits in
+// the unused part of the budget, used for prefetched models. Returns whether it was added.
+bool model_cache_put_if_fits(ModelCache *cache, const std::string &path, std::shared_ptr<GaussianSplat> model);
+bool model_cache_contains(const ModelCache *cache, const GaussianSplat *model);
+bool model_cache_contains_path(const ModelCache *cache, const std::string &path);
+// Estimated memory size of a model once decoded, from the size of its file. 0 if unknown.
+size_t model_cache_estimate_bytes(const std::string &path);
+// Evicts until the models fit in the new budget
+void model_cache_set_budget(ModelCache *cache, size_t budget_bytes);
+void model_cache_clear(ModelCache *cache);
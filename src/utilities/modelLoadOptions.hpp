@@ -0,0 +1,10 @@
+#pragma once
+
+#include "shCodebook.hpp"
+#include "splatPrune.hpp"
+
+// Processing applied to a model after decoding, in this order. Paged models get neither.
+typedef struct {
+    SplatPruneOptions prune;
+    ShCodebookOptions sh_codebook;
+} ModelLoadOptions;
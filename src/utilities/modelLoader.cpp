@@ -0,0 +1,293 @@
+#include "modelLoader.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include "profiler.hpp"
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+
+std::shared_ptr<GaussianSplat> load_model(std::string model_path, LoadProgress *progress, const ModelLoadOptions *options)
+{
+    GaussianSplat new_model;
+    if (model_path == "test") {
+        std::vector<glm::vec3> ws_positions = {
+            {0.0f, 0.0f, 0.0f},
+            {1.0f, 0.0f, 0.0f},
+            // {0.0f, 1.0f, 0.0f},
+            // {0.0f, 0.0f, 1.0f}
+        };
+        std::vector<glm::vec4> rotations = {
+            {1.0f, 0.0f, 0.0f, 0.0f},
+            {1.0f, 0.0f, 0.0f, 0.0f},
+            // {1.0f, 0.0f, 0.0f, 0.0f},
+            // {1.0f, 0.0f, 0.0f, 0.0f}
+        };
+        std::vector<glm::vec3> scales = {
+            {0.03f, 0.03f, 0.03f},
+            {0.2f,  0.03f, 0.03f},
+            // {0.03f, 0.2f,  0.03f},
+            // {0.03f, 0.03f, 0.2f}
+        };
+        std::vector<glm::vec3> colors = {
+            {(0.0f - 0.5f) / 0.28209f, (0.0f - 0.5f) / 0.28209f, (1.0f - 0.5f) / 0.28209f},
+            {(1.0f - 0.5f) / 0.28209f, (0.0f - 0.5f) / 0.28209f, (0.0f - 0.5f) / 0.28209f},
+            // {(0.0f - 0.5f) / 0.28209f, (1.0f - 0.5f) / 0.28209f, (0.0f - 0.5f) / 0.28209f},
+            // {(0.0f - 0.5f) / 0.28209f, (0.0f - 0.5f) / 0.28209f, (1.0f - 0.5f) / 0.28209f}
+        };
+        std::vector<float> opacities = {1.0f, 1.0f};//, 1.0f, 1.0f};
+        new_model.filename = "test";
+        new_model.had_error = false;
+        new_model.count = 2;
+        new_model.ws_positions = std::move(ws_positions);
+        new_model.scales = std::move(scales);
+        new_model.rotations = std::move(rotations);
+        new_model.colors = std::move(colors);
+        new_model.opacities = std::move(opacities);
+    } else {
+        new_model = gaussian_splat_from_file(model_path, progress);
+    }
+
+    bool process = options && !new_model.had_error && !new_model.paged;
+    if (process && splat_prune_is_enabled(options->prune) && (!progress || !progress->cancelled)) {
+        SplatPruneStats stats;
+        gaussian_splat_prune(new_model, options->prune, &stats);
+        new_model.pruned_count = splat_prune_removed(stats);
+        std::cout << splat_prune_describe(stats) << std::endl;
+    }
+    if (process && !new_model.shs.empty() && (!progress || !progress->cancelled)) {
+        gaussian_splat_quantize_sh(new_model, options->sh_codebook);
+    }
+
+    if (!progress || !progress->cancelled) {
+        std::cout << "Loaded new model:" << std::endl;
+        gaussian_splat_print(new_model);
+    }
+    // Moved, never copied
+    return std::make_shared<GaussianSplat>(std::move(new_model));
+}
+
+// Publishes a finished model, unless a newer one is already waiting. The mutex keeps
+// model_loader_poll() and the other worker from freeing the waiting model while its id is read.
+static void publish(ModelLoader *loader, LoadedModel *result)
+{
+    LoadedModel *unused = result;
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        LoadedModel *current = loader->ready.load();
+        if (!current || current->id < result->id) {
+            // Replaced before the render thread got to it
+            unused = loader->ready.exchange(result);
+        }
+    }
+    // Outside the lock, freeing a model takes a while
+    delete unused;
+}
+
+static void worker_main(ModelLoader *loader)
+{
+    while (true) {
+        ModelLoadJob job;
+        {
+            std::unique_lock<std::mutex> lock(loader->mutex);
+            loader->wake.wait(lock, [loader]() { return loader->stopping || !loader->queue.empty(); });
+            if (loader->stopping) {
+                return;
+            }
+            job = std::move(loader->queue.front());
+            loader->queue.pop_front();
+        }
+
+        if (!job.progress->cancelled) {
+            PROFILE_ZONE("model loader job");
+            std::shared_ptr<GaussianSplat> model = load_model(job.path, job.progress.get(), &loader->load_options);
+            if (!job.progress->cancelled) {
+                publish(loader, new LoadedModel{ job.id, job.path, std::move(model) });
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        auto &in_flight = loader->in_flight;
+        in_flight.erase(std::remove(in_flight.begin(), in_flight.end(), job.progress), in_flight.end());
+    }
+}
+
+static void prefetch_worker_main(ModelLoader *loader)
+{
+#ifdef __linux__
+    // Lowest priority for this thread only, so it only gets CPU time nobody else wants
+    setpriority(PRIO_PROCESS, id_t(syscall(SYS_gettid)), 19);
+#endif
+
+    while (true) {
+        std::string path;
+        std::shared_ptr<LoadProgress> progress;
+        {
+            std::unique_lock<std::mutex> lock(loader->mutex);
+            // Also woken up regularly, as the conditions can change without a notify
+            auto can_start = [loader]() {
+                return !loader->prefetch_queue.empty() && loader->in_flight.empty() &&
+                       loader->prefetched.load() == nullptr && Clock::now() >= loader->prefetch_not_before;
+            };
+            while (!loader->stopping && !can_start()) {
+                loader->prefetch_wake.wait_for(lock, std::chrono::milliseconds(100));
+            }
+            if (loader->stopping) {
+                return;
+            }
+            path = loader->prefetch_queue.front();
+            loader->prefetch_queue.pop_front();
+            progress = std::make_shared<LoadProgress>();
+            loader->prefetch_progress = progress;
+        }
+
+        PROFILE_ZONE("model prefetch job");
+        std::shared_ptr<GaussianSplat> model = load_model(path, progress.get(), &loader->load_options);
+
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        if (!progress->cancelled) {
+            delete loader->prefetched.exchange(new LoadedModel{ 0, path, std::move(model) });
+        }
+        loader->prefetch_progress = nullptr;
+    }
+}
+
+void model_loader_start(ModelLoader *loader)
+{
+    for (int i = 0; i < MODEL_LOADER_WORKERS; i++) {
+        loader->workers.emplace_back(worker_main, loader);
+    }
+    loader->prefetch_worker = std::thread(prefetch_worker_main, loader);
+}
+
+void model_loader_stop(ModelLoader *loader)
+{
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        loader->stopping = true;
+        for (auto &progress : loader->in_flight) {
+            progress->cancelled = true;
+        }
+        loader->queue.clear();
+        loader->in_flight.clear();
+        if (loader->prefetch_progress) {
+            loader->prefetch_progress->cancelled = true;
+        }
+        loader->prefetch_queue.clear();
+    }
+    loader->wake.notify_all();
+    loader->prefetch_wake.notify_all();
+    for (std::thread &worker : loader->workers) {
+        worker.join();
+    }
+    loader->workers.clear();
+    if (loader->prefetch_worker.joinable()) {
+        loader->prefetch_worker.join();
+    }
+    delete loader->ready.exchange(nullptr);
+    delete loader->prefetched.exchange(nullptr);
+}
+
+// Must be called with the mutex held
+static void cancel_locked(ModelLoader *loader)
+{
+    for (auto &progress : loader->in_flight) {
+        progress->cancelled = true;
+    }
+    for (const ModelLoadJob &queued : loader->queue) {
+        auto &in_flight = loader->in_flight;
+        in_flight.erase(std::remove(in_flight.begin(), in_flight.end(), queued.progress), in_flight.end());
+    }
+    loader->queue.clear();
+}
+
+void model_loader_cancel(ModelLoader *loader)
+{
+    std::lock_guard<std::mutex> lock(loader->mutex);
+    cancel_locked(loader);
+    // Anything finished before this is stale now
+    ++loader->latest_id;
+    loader->latest_progress = nullptr;
+}
+
+uint64_t model_loader_request(ModelLoader *loader, const std::string &path)
+{
+    ModelLoadJob job;
+    job.path = path;
+    job.progress = std::make_shared<LoadProgress>();
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        // Only the newest model is wanted, stop working on the others. That includes prefetching,
+        // which would otherwise compete with this load.
+        cancel_locked(loader);
+        if (loader->prefetch_progress) {
+            loader->prefetch_progress->cancelled = true;
+        }
+
+        job.id = ++loader->latest_id;
+        loader->in_flight.push_back(job.progress);
+        loader->latest_progress = job.progress;
+        loader->queue.push_back(job);
+    }
+    loader->wake.notify_one();
+    return job.id;
+}
+
+std::unique_ptr<LoadedModel> model_loader_poll(ModelLoader *loader)
+{
+    if (!loader->ready.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    std::unique_ptr<LoadedModel> result;
+    {
+        std::lock_guard<std::mutex> lock(loader->mutex);
+        result.reset(loader->ready.exchange(nullptr));
+    }
+    // An older load can finish after a newer one was requested
+    if (result && result->id != loader->latest_id) {
+        return nullptr;
+    }
+    return result;
+}
+
+bool model_loader_busy(ModelLoader *loader)
+{
+    if (loader->ready.load() != nullptr) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(loader->mutex);
+    return loader->latest_progress && std::find(loader->in_flight.begin(), loader->in_flight.end(),
+                                                loader->latest_progress) != loader->in_flight.end();
+}
+
+void model_loader_prefetch(ModelLoader *loader, const std::vector<std::string> &paths)
+{
+    std::lock_guard<std::mutex> lock(loader->mutex);
+    loader->prefetch_queue.assign(paths.begin(), paths.end());
+    loader->prefetch_not_before = Clock::now() + std::chrono::milliseconds(MODEL_PREFETCH_DELAY_MS);
+    // Anything being prefetched is no longer wanted. It may be in the new list, but then it starts
+    // over after the delay, which is rare enough.
+    if (loader->prefetch_progress) {
+        loader->prefetch_progress->cancelled = true;
+    }
+}
+
+std::unique_ptr<LoadedModel> model_loader_poll_prefetched(ModelLoader *loader)
+{
+    if (!loader->prefetched.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return std::unique_ptr<LoadedModel>(loader->prefetched.exchange(nullptr));
+}
+
+std::shared_ptr<LoadProgress> model_loader_progress(ModelLoader *loader)
+{
+    std::lock_guard<std::mutex> lock(loader->mutex);
+    return loader->latest_progress;
+}
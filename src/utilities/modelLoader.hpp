@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "modelLoadOptions.hpp"
+#include "plyParser.hpp"
+
+// Number of loading threads. One is enough for a single load, the second lets a new load start
+// right away while a cancelled one is still winding down.
+#define MODEL_LOADER_WORKERS 2
+// Prefetching starts this long after the last prefetch request, so stepping quickly through the
+// models doesn't start a decode for every model passed
+#define MODEL_PREFETCH_DELAY_MS 500
+
+typedef struct {
+    uint64_t id;
+    std::string path;
+    std::shared_ptr<GaussianSplat> model;
+} LoadedModel;
+
+typedef struct {
+    uint64_t id;
+    std::string path;
+    std::shared_ptr<LoadProgress> progress;
+} ModelLoadJob;
+
+// Loads models on a pool of worker threads. Only the newest request matters: a new request
+// cancels every load that is queued or in progress. Finished models are handed to the render
+// thread through an atomic pointer, so polling never blocks on a loading thread.
+//
+// Models that will probably be wanted soon can be prefetched. They are decoded one at a time on
+// a separate thread with the lowest scheduling priority, and only while no requested load is
+// running, so prefetching never competes with the frame loop or with the model the user asked
+// for. Prefetched models come out of model_loader_poll_prefetched().
+//
+//     model_loader_start(&loader);
+//     model_loader_request(&loader, "model.ply");
+//     ... every frame ...
+//     if (std::unique_ptr<LoadedModel> loaded = model_loader_poll(&loader)) { ... }
+//     ...
+//     model_loader_stop(&loader);
+typedef struct model_loader_t {
+    std::vector<std::thread> workers;
+
+    // Guards everything below up to the handoff
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<ModelLoadJob> queue;
+    std::vector<std::shared_ptr<LoadProgress>> in_flight; // Queued or loading
+    std::shared_ptr<LoadProgress> latest_progress;
+    bool stopping = false;
+    // Applied to every model loaded. Set before model_loader_start(), the cache doesn't know about it.
+    ModelLoadOptions load_options;
+
+    std::thread prefetch_worker;
+    // Separate from wake, so a notify meant for the load workers can't be swallowed by it
+    std::condition_variable prefetch_wake;
+    std::deque<std::string> prefetch_queue;
+    std::shared_ptr<LoadProgress> prefetch_progress; // Of the prefetch in progress, if any
+    std::chrono::steady_clock::time_point prefetch_not_before;
+
+    std::atomic<uint64_t> latest_id{0};
+    // Finished model waiting for the render thread. Only ever replaced by a newer one, and only
+    // taken or replaced with the mutex held.
+    std::atomic<LoadedModel *> ready{nullptr};
+    // Prefetched model waiting for the render thread. The next prefetch waits until it is taken.
+    std::atomic<LoadedModel *> prefetched{nullptr};
+} ModelLoader;
+
+// Loads a .ply/.splat file, or the "test" model. Used by the workers, and directly when blocking
+// is fine. progress and options are optional.
+std::shared_ptr<GaussianSplat> load_model(std::string model_path, LoadProgress *progress = nullptr,
+                                          const ModelLoadOptions *options = nullptr);
+
+void model_loader_start(ModelLoader *loader);
+// Cancels all loads and joins the workers
+void model_loader_stop(ModelLoader *loader);
+// Queues a load and cancels all earlier ones. Returns the id of the request.
+uint64_t model_loader_request(ModelLoader *loader, const std::string &path);
+// Cancels every load, and drops any result that has not been polled yet
+void model_loader_cancel(ModelLoader *loader);
+// Takes the result of the newest request once it is done, or returns null
+std::unique_ptr<LoadedModel> model_loader_poll(ModelLoader *loader);
+// True while a request has not been polled yet
+bool model_loader_busy(ModelLoader *loader);
+// Replaces the models waiting to be prefetched, in order of priority
+void model_loader_prefetch(ModelLoader *loader, const std::vector<std::string> &paths);
+// Takes a prefetched model, or returns null
+std::unique_ptr<LoadedModel> model_loader_poll_prefetched(ModelLoader *loader);
+// Progress of the newest request, null if nothing was requested yet
+std::shared_ptr<LoadProgress> model_loader_progress(ModelLoader *loader);
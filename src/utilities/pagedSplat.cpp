@@ -0,0 +1,356 @@
+#include "pagedSplat.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <numeric>
+#include "profiler.hpp"
+
+static const char paged_splat_magic[4] = { 'S', 'P', 'L', 'P' };
+
+typedef struct {
+    size_t begin;
+    size_t end;
+} PageRange;
+
+// Median splits along the longest axis of the centers, until every page fits
+static void split_pages(const std::vector<glm::vec3> &positions, std::vector<uint32_t> &indices,
+                        size_t begin, size_t end, std::vector<PageRange> &pages)
+{
+    if (end - begin <= PAGED_SPLAT_PAGE_CAPACITY) {
+        pages.push_back({ begin, end });
+        return;
+    }
+
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    for (size_t i = begin; i < end; i++) {
+        lo = glm::min(lo, positions[indices[i]]);
+        hi = glm::max(hi, positions[indices[i]]);
+    }
+    glm::vec3 extent = hi - lo;
+    int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+    size_t mid = begin + (end - begin) / 2;
+    std::nth_element(indices.begin() + begin, indices.begin() + mid, indices.begin() + end,
+                     [&positions, axis](uint32_t a, uint32_t b) { return positions[a][axis] < positions[b][axis]; });
+    split_pages(positions, indices, begin, mid, pages);
+    split_pages(positions, indices, mid, end, pages);
+}
+
+template <typename T>
+static void append(GaussianSplat &dst, std::vector<T> GaussianSplat::*field, const GaussianSplat &src, uint32_t index)
+{
+    (dst.*field).push_back((src.*field)[index]);
+}
+
+// One big splat standing in for a whole page while it is not resident. Covers the spread of the
+// splat centers, with the average color and opacity.
+static void append_summary(GaussianSplat &dst, const GaussianSplat &page)
+{
+    size_t count = page.ws_positions.size();
+    double weight = 0.0;
+    glm::dvec3 mean(0.0);
+    glm::dvec3 color(0.0);
+    double opacity = 0.0;
+    for (size_t s = 0; s < count; s++) {
+        // Faint splats shouldn't pull the summary around
+        double w = std::max(double(page.opacities[s]), 1e-6);
+        weight += w;
+        mean += w * glm::dvec3(page.ws_positions[s]);
+        color += w * glm::dvec3(page.colors[s]);
+        opacity += page.opacities[s];
+    }
+    mean /= weight;
+    color /= weight;
+
+    glm::dvec3 variance(0.0);
+    for (size_t s = 0; s < count; s++) {
+        double w = std::max(double(page.opacities[s]), 1e-6);
+        glm::dvec3 d = glm::dvec3(page.ws_positions[s]) - mean;
+        glm::dvec3 own = glm::dvec3(page.scales[s]);
+        variance += w * (d * d + own * own);
+    }
+    variance /= weight;
+
+    dst.ws_positions.push_back(glm::vec3(mean));
+    dst.colors.push_back(glm::vec3(color));
+    dst.opacities.push_back(float(opacity / double(count)));
+    dst.scales.push_back(glm::vec3(glm::sqrt(variance)));
+    dst.rotations.push_back(glm::vec4(1.0f, 0.0f, 0.0f, 0.0f));
+}
+
+static void write_bytes(std::ofstream &file, const void *data, size_t size)
+{
+    file.write(reinterpret_cast<const char *>(data), std::streamsize(size));
+}
+
+bool paged_splat_writer_open(PagedSplatWriter *writer, const std::string &path, SplatFormat format,
+                             size_t page_count, std::string *error)
+{
+    if (format.separate) {
+        *error = "Error: Paged files store interleaved records, use the float32 or compact layout";
+        return false;
+    }
+    if (format.position == SPLAT_POSITION_FLOAT16_CHUNKED && page_count > 65536) {
+        *error = "Error: Too many pages for the 16-bit chunk index of chunked positions, use float32 positions";
+        return false;
+    }
+
+    writer->path = path;
+    writer->format = format;
+    writer->layout = splat_layout_make(format);
+    writer->page_count = page_count;
+    writer->splat_count = 0;
+    writer->pages.clear();
+    writer->pages.reserve(page_count);
+    writer->origins.assign(page_count, glm::vec4(0.0f));
+    writer->summaries = GaussianSplat();
+    writer->summary_cull.clear();
+
+    writer->file.open(path, std::ios::binary | std::ios::trunc);
+    if (!writer->file.is_open()) {
+        *error = "Error: Could not open " + path + " for writing";
+        return false;
+    }
+    // Everything in front of the pages is written by close, once it is known
+    size_t front = sizeof(PagedSplatHeader) + page_count * (sizeof(PagedSplatPage) + sizeof(glm::vec4) +
+                                                            writer->layout.stride + sizeof(CullSplat));
+    std::vector<char> zeros(front, 0);
+    write_bytes(writer->file, zeros.data(), zeros.size());
+    return bool(writer->file);
+}
+
+bool paged_splat_writer_add_page(PagedSplatWriter *writer, const GaussianSplat &page, std::string *error)
+{
+    size_t count = page.ws_positions.size();
+    size_t p = writer->pages.size();
+    if (count == 0 || count > PAGED_SPLAT_PAGE_CAPACITY || p >= writer->page_count) {
+        *error = "Error: Invalid page " + std::to_string(p) + " with " + std::to_string(count) + " splats";
+        return false;
+    }
+
+    std::vector<CullSplat> cull(count);
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    glm::vec3 center_lo = lo;
+    glm::vec3 center_hi = hi;
+    for (size_t s = 0; s < count; s++) {
+        glm::vec3 position = page.ws_positions[s];
+        cull[s] = splat_cull_data(position, page.scales[s], page.opacities[s]);
+        center_lo = glm::min(center_lo, position);
+        center_hi = glm::max(center_hi, position);
+        lo = glm::min(lo, position - glm::vec3(cull[s].radius));
+        hi = glm::max(hi, position + glm::vec3(cull[s].radius));
+    }
+    writer->origins[p] = glm::vec4((center_lo + center_hi) * 0.5f, 0.0f);
+
+    PagedSplatPage info = {};
+    memcpy(info.bounds_min, &lo.x, sizeof(info.bounds_min));
+    memcpy(info.bounds_max, &hi.x, sizeof(info.bounds_max));
+    info.count = uint32_t(count);
+    info.offset = uint64_t(writer->file.tellp());
+    writer->pages.push_back(info);
+    writer->splat_count += count;
+
+    // With chunked positions the chunk of every splat is its page
+    std::vector<uint16_t> chunk_of(count, uint16_t(p));
+    std::vector<unsigned char> records;
+    splat_layout_pack_chunks(writer->layout, page, chunk_of, writer->origins, records);
+    write_bytes(writer->file, records.data(), records.size());
+    write_bytes(writer->file, cull.data(), cull.size() * sizeof(CullSplat));
+
+    append_summary(writer->summaries, page);
+    size_t last = writer->summaries.ws_positions.size() - 1;
+    writer->summary_cull.push_back(splat_cull_data(writer->summaries.ws_positions[last], writer->summaries.scales[last],
+                                                   writer->summaries.opacities[last]));
+
+    if (!writer->file) {
+        *error = "Error: Failed writing " + writer->path;
+        return false;
+    }
+    return true;
+}
+
+bool paged_splat_writer_close(PagedSplatWriter *writer, std::string *error)
+{
+    if (writer->pages.size() != writer->page_count) {
+        *error = "Error: Expected " + std::to_string(writer->page_count) + " pages but got " +
+                 std::to_string(writer->pages.size());
+        writer->file.close();
+        return false;
+    }
+
+    PagedSplatHeader header = {};
+    memcpy(header.magic, paged_splat_magic, sizeof(header.magic));
+    header.version = PAGED_SPLAT_VERSION;
+    header.position_format = writer->format.position;
+    header.color_format = writer->format.color;
+    header.scale_format = writer->format.scale;
+    header.rotation_format = writer->format.rotation;
+    header.stride = uint32_t(writer->layout.stride);
+    header.page_count = uint32_t(writer->page_count);
+    header.splat_count = writer->splat_count;
+
+    // Summaries use the origin of their page
+    std::vector<uint16_t> chunk_of(writer->page_count);
+    std::iota(chunk_of.begin(), chunk_of.end(), uint16_t(0));
+    std::vector<unsigned char> summary_records;
+    splat_layout_pack_chunks(writer->layout, writer->summaries, chunk_of, writer->origins, summary_records);
+
+    writer->file.seekp(0);
+    write_bytes(writer->file, &header, sizeof(header));
+    write_bytes(writer->file, writer->pages.data(), writer->pages.size() * sizeof(PagedSplatPage));
+    write_bytes(writer->file, writer->origins.data(), writer->origins.size() * sizeof(glm::vec4));
+    write_bytes(writer->file, summary_records.data(), summary_records.size());
+    write_bytes(writer->file, writer->summary_cull.data(), writer->summary_cull.size() * sizeof(CullSplat));
+    writer->file.close();
+    if (!writer->file) {
+        *error = "Error: Failed writing " + writer->path;
+        return false;
+    }
+    return true;
+}
+
+bool paged_splat_write(const std::string &path, const GaussianSplat &splat, SplatFormat format, std::string *error)
+{
+    PROFILE_ZONE("write paged splat");
+    size_t count = splat.ws_positions.size();
+    if (count == 0 || splat.colors.size() != count || splat.opacities.size() != count ||
+        splat.scales.size() != count || splat.rotations.size() != count) {
+        *error = "Error: The model has no splats, or its attributes were released";
+        return false;
+    }
+
+    std::vector<uint32_t> indices(count);
+    std::iota(indices.begin(), indices.end(), 0u);
+    std::vector<PageRange> ranges;
+    split_pages(splat.ws_positions, indices, 0, count, ranges);
+
+    PagedSplatWriter writer;
+    if (!paged_splat_writer_open(&writer, path, format, ranges.size(), error)) {
+        return false;
+    }
+    GaussianSplat page;
+    for (const PageRange &range : ranges) {
+        page = GaussianSplat();
+        for (size_t i = range.begin; i < range.end; i++) {
+            uint32_t s = indices[i];
+            append(page, &GaussianSplat::ws_positions, splat, s);
+            append(page, &GaussianSplat::colors, splat, s);
+            append(page, &GaussianSplat::opacities, splat, s);
+            append(page, &GaussianSplat::scales, splat, s);
+            append(page, &GaussianSplat::rotations, splat, s);
+        }
+        if (!paged_splat_writer_add_page(&writer, page, error)) {
+            return false;
+        }
+    }
+    return paged_splat_writer_close(&writer, error);
+}
+
+std::shared_ptr<PagedSplatFile> paged_splat_open(const std::string &path, std::string *error)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        *error = "Error: Could not open file " + path;
+        return nullptr;
+    }
+    std::error_code size_error;
+    uint64_t file_size = std::filesystem::file_size(path, size_error);
+    if (size_error) {
+        *error = "Error: Could not get the size of " + path + ": " + size_error.message();
+        return nullptr;
+    }
+
+    PagedSplatHeader header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        memcmp(header.magic, paged_splat_magic, sizeof(header.magic)) != 0) {
+        *error = "Error: Not a paged splat file";
+        return nullptr;
+    }
+    if (header.version != PAGED_SPLAT_VERSION) {
+        *error = "Error: Unsupported paged splat version " + std::to_string(header.version);
+        return nullptr;
+    }
+    if (header.position_format >= SPLAT_POSITION_FORMAT_COUNT || header.color_format >= SPLAT_COLOR_FORMAT_COUNT ||
+        header.scale_format >= SPLAT_PRECISION_COUNT || header.rotation_format >= SPLAT_PRECISION_COUNT) {
+        *error = "Error: Unknown splat format in paged splat file";
+        return nullptr;
+    }
+
+    auto paged = std::make_shared<PagedSplatFile>();
+    paged->path = path;
+    paged->layout = splat_layout_make({ SplatPositionFormat(header.position_format), SplatColorFormat(header.color_format),
+                                        SplatPrecision(header.scale_format), SplatPrecision(header.rotation_format),
+                                        false });
+    paged->splat_count = size_t(header.splat_count);
+    if (paged->layout.stride != header.stride) {
+        *error = "Error: Record size in paged splat file does not match its format";
+        return nullptr;
+    }
+
+    // The page table, origins, summary records and summary cull data follow the header. Checked
+    // before sizing anything from the page count, so a damaged header can't allocate beyond the file.
+    uint64_t table_bytes_per_page = sizeof(PagedSplatPage) + sizeof(glm::vec4) + header.stride + sizeof(CullSplat);
+    if (file_size < sizeof(header) || header.page_count > (file_size - sizeof(header)) / table_bytes_per_page) {
+        *error = "Error: Paged splat file is truncated";
+        return nullptr;
+    }
+    size_t page_count = header.page_count;
+    paged->pages.resize(page_count);
+    paged->origins.resize(page_count);
+    paged->summary_records.resize(page_count * header.stride);
+    paged->summary_cull.resize(page_count);
+    file.read(reinterpret_cast<char *>(paged->pages.data()), std::streamsize(page_count * sizeof(PagedSplatPage)));
+    file.read(reinterpret_cast<char *>(paged->origins.data()), std::streamsize(page_count * sizeof(glm::vec4)));
+    file.read(reinterpret_cast<char *>(paged->summary_records.data()), std::streamsize(paged->summary_records.size()));
+    file.read(reinterpret_cast<char *>(paged->summary_cull.data()), std::streamsize(page_count * sizeof(CullSplat)));
+    if (!file) {
+        *error = "Error: Paged splat file is truncated";
+        return nullptr;
+    }
+
+    for (const PagedSplatPage &page : paged->pages) {
+        uint64_t size = uint64_t(page.count) * (header.stride + sizeof(CullSplat));
+        if (page.count > PAGED_SPLAT_PAGE_CAPACITY || page.offset > file_size || size > file_size - page.offset) {
+            *error = "Error: Invalid page in paged splat file";
+            return nullptr;
+        }
+    }
+    return paged;
+}
+
+bool paged_splat_read_page(std::ifstream &file, const PagedSplatFile &paged, size_t page,
+                           std::vector<unsigned char> &records, std::vector<CullSplat> &cull)
+{
+    const PagedSplatPage &info = paged.pages[page];
+    records.resize(info.count * paged.layout.stride);
+    cull.resize(info.count);
+    file.clear();
+    file.seekg(std::streamoff(info.offset));
+    file.read(reinterpret_cast<char *>(records.data()), std::streamsize(records.size()));
+    file.read(reinterpret_cast<char *>(cull.data()), std::streamsize(cull.size() * sizeof(CullSplat)));
+    return bool(file);
+}
+
+GaussianSplat gaussian_splat_from_paged_file(std::string filename)
+{
+    GaussianSplat splat;
+    splat.filename = std::filesystem::path(filename).filename().string();
+    splat.had_error = false;
+    splat.from_ply = false;
+    splat.count = 0;
+
+    std::string error;
+    splat.paged = paged_splat_open(filename, &error);
+    if (!splat.paged) {
+        splat.had_error = true;
+        splat.warning_and_error_messages.push_back(error);
+        return splat;
+    }
+    splat.count = splat.paged->splat_count;
+    return splat;
+}
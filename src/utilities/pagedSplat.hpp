@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "plyParser.hpp"
+#include "splatCulling.hpp"
+#include "splatLayout.hpp"
+
+#define PAGED_SPLAT_EXTENSION ".psplat"
+#define PAGED_SPLAT_VERSION 1
+// Most splats in one page, which is also the size of a slot in the GPU page pool. Pages are split
+// until they are at most this big, so they hold between half of this and this many splats.
+#define PAGED_SPLAT_PAGE_CAPACITY 65536
+
+// A paged (.psplat) file splits a scene into spatial pages that are streamed in and out of a
+// fixed size GPU pool while rendering, see splatPager.hpp. Only the page table and one summary
+// splat per page are loaded up front, so scenes don't need to fit in RAM or VRAM.
+//
+// Layout, everything little endian:
+//   PagedSplatHeader
+//   PagedSplatPage * page_count
+//   glm::vec4 * page_count         Center of every page
+//   record * page_count            LOD summary of every page, one splat in the file's format
+//   CullSplat * page_count         Cull data of the summaries
+//   Per page: record * count, then CullSplat * count
+//
+// Records are stored in the GPU format, so a page is uploaded without any conversion. With
+// chunked positions the chunk of every splat is its page, so precision follows the page size.
+typedef struct {
+    char magic[4]; // "SPLP"
+    uint32_t version;
+    uint32_t position_format;
+    uint32_t color_format;
+    uint32_t scale_format;
+    uint32_t rotation_format;
+    uint32_t stride;
+    uint32_t page_count;
+    uint64_t splat_count;
+} PagedSplatHeader;
+
+typedef struct {
+    // Bounds of the splat extents, not just the centers
+    float bounds_min[3];
+    float bounds_max[3];
+    uint32_t count;
+    uint32_t padding;
+    uint64_t offset; // Of the first record in the file
+} PagedSplatPage;
+
+// Everything of a paged file except the pages themselves
+typedef struct paged_splat_file_t {
+    std::string path;
+    SplatLayout layout;
+    size_t splat_count;
+    std::vector<PagedSplatPage> pages;
+    std::vector<glm::vec4> origins;
+    std::vector<unsigned char> summary_records;
+    std::vector<CullSplat> summary_cull;
+} PagedSplatFile;
+
+// Writes a paged file one page at a time, so scenes that don't fit in memory can be converted.
+// The number of pages must be known up front. The page table and the summaries are kept in
+// memory and written in front of the pages by paged_splat_writer_close().
+typedef struct {
+    std::ofstream file;
+    std::string path;
+    SplatFormat format;
+    SplatLayout layout;
+    size_t page_count = 0;
+    uint64_t splat_count = 0;
+    std::vector<PagedSplatPage> pages;
+    std::vector<glm::vec4> origins;
+    GaussianSplat summaries;
+    std::vector<CullSplat> summary_cull;
+} PagedSplatWriter;
+
+bool paged_splat_writer_open(PagedSplatWriter *writer, const std::string &path, SplatFormat format,
+                             size_t page_count, std::string *error);
+// Appends the next page, at most PAGED_SPLAT_PAGE_CAPACITY splats. Only positions, colors,
+// opacities, scales and rotations are used.
+bool paged_splat_writer_add_page(PagedSplatWriter *writer, const GaussianSplat &page, std::string *error);
+// Fills in the header, page table and summaries
+bool paged_splat_writer_close(PagedSplatWriter *writer, std::string *error);
+
+// Splits the splat into pages along the median of the longest axis and writes it in the given
+// GPU format. The whole splat must be in memory, converting is done once up front.
+bool paged_splat_write(const std::string &path, const GaussianSplat &splat, SplatFormat format, std::string *error);
+// Reads the header, page table and summaries
+std::shared_ptr<PagedSplatFile> paged_splat_open(const std::string &path, std::string *error);
+// Reads the records and cull data of one page. `file` must have been opened in binary mode.
+bool paged_splat_read_page(std::ifstream &file, const PagedSplatFile &paged, size_t page,
+                           std::vector<unsigned char> &records, std::vector<CullSplat> &cull);
+
+// A splat without any per-splat arrays, with `paged` set. Used by gaussian_splat_from_file().
+GaussianSplat gaussian_splat_from_paged_file(std::string filename);
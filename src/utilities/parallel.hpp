@@ -0,0 +1,28 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// One thread per core
+inline int parallel_thread_count()
+{
+    return std::max(int(std::thread::hardware_concurrency()), 1);
+}
+
+// Runs fn(begin, end) on `threads` threads, splitting [0, count) evenly. The calling thread takes
+// the first range.
+template <typename F>
+void parallel_for(size_t count, int threads, F fn)
+{
+    size_t per_thread = (count + size_t(threads) - 1) / size_t(threads);
+    std::vector<std::thread> pool;
+    for (size_t begin = per_thread; begin < count; begin += per_thread) {
+        pool.emplace_back(fn, begin, std::min(count, begin + per_thread));
+    }
+    fn(0, std::min(count, per_thread));
+    for (std::thread &thread : pool) {
+        thread.join();
+    }
+}
@@ -16,6 +16,9 @@
  */
 
 #include "plyParser.hpp"
+#include "compressedSplat.hpp"
+#include "pagedSplat.hpp"
+#include "profiler.hpp"
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -24,6 +27,13 @@
 #include <iterator>
 #include <filesystem>
 #include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#define SPLAT_DECODE_SSE2
+#endif
 
 
 #define EXPECTED_PROPERTIES_COUNT 62
@@ -103,8 +113,15 @@ static std::vector<std::string> next_line_tokens(std::ifstream &file) {
 }
 
 
+/*
+ * A zero quaternion stays zero instead of becoming NaNs, same as in decode_splat_records(), so
+ * splat_prune_test() can still tell it is invalid. The vertex shader draws it unrotated.
+ */
 static glm::vec4 normalize_quaternion(glm::vec4 r) {
     float ss = r.x * r.x + r.y * r.y + r.z * r.z + r.w * r.w;
+    if (ss == 0.0f) {
+        return r;
+    }
     float norm = std::sqrt(ss);
     return glm::vec4(r.x / norm, r.y / norm, r.z / norm, r.w / norm);
 }
@@ -122,9 +139,28 @@ glm::vec3 zero_deg_sh(glm::vec3 color) {
 	return 0.5f + C0 * color;
 }
 
+bool report_progress(LoadProgress *progress, size_t splats_decoded, size_t bytes_read)
+{
+    if (!progress) {
+        return true;
+    }
+    progress->splats_decoded.store(splats_decoded, std::memory_order_relaxed);
+    progress->bytes_read.store(bytes_read, std::memory_order_relaxed);
+    return !progress->cancelled.load(std::memory_order_relaxed);
+}
 
-GaussianSplat gaussian_splat_from_file(std::string filename)
+void set_progress_totals(LoadProgress *progress, size_t splats_total, size_t bytes_total)
 {
+    if (progress) {
+        progress->splats_total.store(splats_total, std::memory_order_relaxed);
+        progress->bytes_total.store(bytes_total, std::memory_order_relaxed);
+    }
+}
+
+
+GaussianSplat gaussian_splat_from_file(std::string filename, LoadProgress *progress)
+{
+    PROFILE_ZONE("load model");
     auto start_time = std::chrono::high_resolution_clock::now();
     
     GaussianSplat splat;
@@ -132,14 +168,18 @@ GaussianSplat gaussian_splat_from_file(std::string filename)
     std::transform(file_extension.begin(), file_extension.end(), file_extension.begin(), ::tolower);
     
     if (file_extension == ".ply") {
-        splat = gaussian_splat_from_ply_file(filename);
+        splat = gaussian_splat_from_ply_file(filename, progress);
         splat.from_ply = true;
     }  else if (file_extension == ".splat") {
-        splat = gaussian_splat_from_splat_file(filename);
+        splat = gaussian_splat_from_splat_file(filename, progress);
         splat.from_ply = false;
+    } else if (file_extension == PAGED_SPLAT_EXTENSION) {
+        splat = gaussian_splat_from_paged_file(filename);
+    } else if (file_extension == COMPRESSED_SPLAT_EXTENSION) {
+        splat = gaussian_splat_from_compressed_file(filename, progress);
     } else {
         splat.had_error = true;
-        splat.warning_and_error_messages.push_back("Error: Unsupported file format. Supported formats are .ply and .splat");
+        splat.warning_and_error_messages.push_back("Error: Unsupported file format. Supported formats are .ply, .splat, .psplat and .csplat");
     }
     
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -150,27 +190,17 @@ GaussianSplat gaussian_splat_from_file(std::string filename)
 }
 
 
-GaussianSplat gaussian_splat_from_ply_file(std::string filename)
+/* Parses the header of a .ply file, leaving the file at the first vertex. Returns false on errors. */
+static bool parse_ply_header(SplatFileReader *reader)
 {
-    bool strange_format = false; // Some .ply files have scale_2 after all the rots
-
-    GaussianSplat splat;
-    splat.filename = std::filesystem::path(filename).filename().string();
-    splat.had_error = false;
-
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        splat.warning_and_error_messages.push_back("Error: Could not open file " + filename);
-        splat.had_error = true;
-        return splat;
-    }
+    std::ifstream &file = reader->file;
+    std::vector<std::string> &messages = reader->warning_and_error_messages;
 
     /* Expect first line to be "ply" */
     std::vector<std::string> tokens = next_line_tokens(file);
     if (tokens[0] != "ply") {
-        splat.warning_and_error_messages.push_back("Error: Unable to parse .ply file as it does not start with 'ply'");
-        splat.had_error = true;
-        return splat;
+        messages.push_back("Error: Unable to parse .ply file as it does not start with 'ply'");
+        return false;
     }
 
     /* Parse rest of header */
@@ -181,39 +211,39 @@ GaussianSplat gaussian_splat_from_ply_file(std::string filename)
         std::string specifier = tokens[0];
         if (specifier == "end_header") { break; }
         if (specifier == "error") {
-            splat.warning_and_error_messages.push_back("Expected whitespace in line in header");
-            splat.had_error = true;
-            return splat;
+            messages.push_back("Expected whitespace in line in header");
+            return false;
         }
         if (tokens.size() != 3) { 
-            splat.warning_and_error_messages.push_back("Error: expected each line in the header to have 3 words separated by whitespace.");
-            splat.had_error = true;
-            return splat;
+            messages.push_back("Error: expected each line in the header to have 3 words separated by whitespace.");
+            return false;
         }
 
         if (specifier == "format") {
             auto format = tokens[1];
             if (format != "binary_little_endian") {
-                splat.warning_and_error_messages.push_back("Error: Only binary_little_endian .ply format, not " + format);
-                splat.had_error = true;
-                return splat;
+                messages.push_back("Error: Only binary_little_endian .ply format, not " + format);
+                return false;
             }
         } else if (specifier == "element") {
             auto element_kind = tokens[1];
             if (element_kind == "vertex") {
                 vertices = std::stoi(tokens[2]);
             } else {
-                splat.warning_and_error_messages.push_back("Warning: Unrecognized element kind " + element_kind);
+                messages.push_back("Warning: Unrecognized element kind " + element_kind);
             }
         } else if (specifier == "property") {
             auto datatype = tokens[1];
             auto property_name = tokens[2];
             /* We expect all properties to be of type float */
             if (datatype != "float") {
-                splat.warning_and_error_messages.push_back("Error: Unrecognized property, ignoring " + property_name);
-                splat.had_error = true;
-                return splat;
+                messages.push_back("Error: Unrecognized property, ignoring " + property_name);
+                return false;
             } 
+            if (property_count >= EXPECTED_PROPERTIES_COUNT) {
+                property_count++;
+                continue;
+            }
 
             auto expected_property_name = expected_properties[property_count];
             /* 
@@ -224,9 +254,9 @@ GaussianSplat gaussian_splat_from_ply_file(std::string filename)
                 std::stringstream ss;
                 ss << "Warning: Expected property " << property_count << " to have name "
                    << expected_property_name << " but got " << property_name;
-                splat.warning_and_error_messages.push_back(ss.str());
+                messages.push_back(ss.str());
                 if (property_count == 57 && property_name == "rot_0") {
-                    strange_format = true;
+                    reader->strange_format = true;
                 }
             }
             property_count++;
@@ -235,171 +265,287 @@ GaussianSplat gaussian_splat_from_ply_file(std::string filename)
 
     /* Make sure we parsed a vertices count and that we have the expected number of properties */
     if (vertices == -1) {
-        splat.warning_and_error_messages.push_back("Error: .ply does not contain a vertex number");
-        splat.had_error = true;
-        return splat;
+        messages.push_back("Error: .ply does not contain a vertex number");
+        return false;
     }
     if (property_count !=  EXPECTED_PROPERTIES_COUNT) {
         std::stringstream ss;
         ss << "Error: expected " << EXPECTED_PROPERTIES_COUNT << " but got " << property_count;
-        splat.warning_and_error_messages.push_back(ss.str());
+        messages.push_back(ss.str());
     }
 
-    splat.count = vertices;
-    splat.ws_positions.reserve(vertices);
-    // splat.normals.reserve(vertices);
-    splat.colors.reserve(vertices);
-    splat.shs.reserve(vertices);
-    splat.opacities.reserve(vertices);
-    splat.scales.reserve(vertices);
-    splat.rotations.reserve(vertices);
+    reader->count = size_t(vertices);
+    reader->record_size = sizeof(float) * EXPECTED_PROPERTIES_COUNT;
+    reader->data_offset = size_t(file.tellg());
+    return true;
+}
 
-    float data[EXPECTED_PROPERTIES_COUNT];
-    /* Parse binary data */
-    for (int i = 0; i < vertices; i++) {
-        file.read(reinterpret_cast<char*>(data), sizeof(float) * EXPECTED_PROPERTIES_COUNT);
-        if (!file) {
-            std::stringstream ss;
-            ss << "Error: Failed to read vertex data at index " << i;
-            splat.warning_and_error_messages.push_back(ss.str());
-            splat.had_error = true;
-            return splat;
+bool splat_file_reader_open(SplatFileReader *reader, const std::string &filename)
+{
+    PROFILE_ZONE("open splat file");
+    reader->filename = filename;
+    std::string file_extension = std::filesystem::path(filename).extension().string();
+    std::transform(file_extension.begin(), file_extension.end(), file_extension.begin(), ::tolower);
+    if (file_extension != ".ply" && file_extension != ".splat") {
+        reader->warning_and_error_messages.push_back("Error: Unsupported file format. Supported formats are .ply and .splat");
+        reader->had_error = true;
+        return false;
+    }
+
+    reader->file.open(filename, std::ios::binary);
+    if (!reader->file.is_open()) {
+        reader->warning_and_error_messages.push_back("Error: Could not open file " + filename);
+        reader->had_error = true;
+        return false;
+    }
+
+    if (file_extension == ".ply") {
+        reader->from_ply = true;
+        if (!parse_ply_header(reader)) {
+            reader->had_error = true;
+            return false;
         }
+        return true;
+    }
+
+    // The .splat file format is "Reverse engineered" from:
+    // https://github.com/antimatter15/splat/blob/main/convert.py
+    //
+    // Each vertex in the .splat format consists of:
+    // - 3 floats for position
+    // - 3 floats for scales
+    // - 4 bytes for colors (final is opacity)
+    // - 4 bytes for rotation
+    const size_t bytes_per_vertex = 12 + 12 + 4 + 4;
+
+    // Get file size to determine number of vertices
+    reader->file.seekg(0, std::ios::end);
+    size_t file_size = size_t(reader->file.tellg());
+    reader->file.seekg(0, std::ios::beg);
+    if (file_size % bytes_per_vertex != 0) {
+        reader->warning_and_error_messages.push_back("Error: File size is not a multiple of vertex size");
+        reader->had_error = true;
+        return false;
+    }
+
+    reader->from_ply = false;
+    reader->count = file_size / bytes_per_vertex;
+    reader->record_size = bytes_per_vertex;
+    reader->data_offset = 0;
+    return true;
+}
+
+size_t splat_file_reader_read(SplatFileReader *reader, size_t max_count, std::vector<unsigned char> &records)
+{
+    if (reader->had_error) {
+        return 0;
+    }
+    size_t n = std::min(max_count, reader->count - reader->next);
+    records.resize(n * reader->record_size);
+    if (n == 0) {
+        return 0;
+    }
+    if (!reader->file.read(reinterpret_cast<char*>(records.data()), std::streamsize(records.size()))) {
+        std::stringstream ss;
+        ss << "Error: Failed to read vertex data at index " << reader->next + size_t(reader->file.gcount()) / reader->record_size;
+        reader->warning_and_error_messages.push_back(ss.str());
+        reader->had_error = true;
+        return 0;
+    }
+    reader->next += n;
+    return n;
+}
+
+void gaussian_splat_resize(GaussianSplat &splat, size_t count, bool with_shs)
+{
+    splat.count = count;
+    splat.ws_positions.resize(count);
+    splat.colors.resize(count);
+    splat.shs.resize(with_shs ? count : 0);
+    splat.opacities.resize(count);
+    splat.scales.resize(count);
+    splat.rotations.resize(count);
+}
+
+/* Decodes n .ply vertices of EXPECTED_PROPERTIES_COUNT floats each */
+static void decode_ply_records(const uint8_t *records, size_t n, bool strange_format, GaussianSplat &splat, size_t first)
+{
+    float data[EXPECTED_PROPERTIES_COUNT];
+    for (size_t i = 0; i < n; i++) {
+        memcpy(data, records + i * sizeof(data), sizeof(data));
+        size_t v = first + i;
 
         /* 
          * If we don't take the -x and -y values, the scene will be upside down for these axes'.
          * Seems as though it stored in a left-handed system?
          */
-        splat.ws_positions.push_back(glm::vec3(-data[0], -data[1], data[2]));
-        // splat.normals.push_back(glm::vec3(data[3], data[4], data[5]));
-        splat.colors.push_back(zero_deg_sh(glm::vec3(data[6], data[7], data[8])));
+        splat.ws_positions[v] = glm::vec3(-data[0], -data[1], data[2]);
+        splat.colors[v] = zero_deg_sh(glm::vec3(data[6], data[7], data[8]));
 
-        SphericalHarmonics sh;
+        SphericalHarmonics &sh = splat.shs[v];
         for (int j = 0; j < SPHERICAL_HARMONICS_COEFFS_COUNT; j++) {
             sh.coeffs[j] = data[9 + j];
         }
-        splat.shs.push_back(sh);
-        splat.opacities.push_back(sigmoid(data[54]));
+        splat.opacities[v] = sigmoid(data[54]);
         if (!strange_format) {
-            splat.scales.push_back(glm::exp(glm::vec3(data[55], data[56], data[57])));
-            splat.rotations.push_back(normalize_quaternion(glm::vec4(data[58], data[59], data[60], data[61])));
-            //splat.rotations.push_back((-glm::vec4(1000 * data[58], 1000 * data[59], 100* data[60], 20 * data[61])));
-            //splat.rotations.push_back(normalize_quaternion(glm::vec4(data[61], data[58], data[59], data[60])));
-            //splat.rotations.push_back(glm::vec4(data[58], data[59], data[60], data[61]));
-            //splat.rotations.push_back(normalize_quaternion(glm::vec4(data[57], data[58], data[59], data[60])));
-            //splat.rotations.push_back(normalize_quaternion(glm::vec4(0.f, 0.f, 0.f, 0.f)));
+            splat.scales[v] = glm::exp(glm::vec3(data[55], data[56], data[57]));
+            splat.rotations[v] = normalize_quaternion(glm::vec4(data[58], data[59], data[60], data[61]));
         } else {
-            splat.scales.push_back(glm::exp(glm::vec3(data[55], data[56], data[61])));
-            splat.rotations.push_back(normalize_quaternion(glm::vec4(data[57], data[58], data[59], data[60])));
+            splat.scales[v] = glm::exp(glm::vec3(data[55], data[56], data[61]));
+            splat.rotations[v] = normalize_quaternion(glm::vec4(data[57], data[58], data[59], data[60]));
         }
     }
+}
 
-    file.close();
+/* Vertices read and decoded at a time by gaussian_splat_from_file(), about 2 MB */
+#define SPLAT_READ_BLOCK 65536
+#define PLY_READ_BLOCK 8192
 
-    // TODO: Optional print flag maybe
-    for (auto message : splat.warning_and_error_messages) {
-        std::cout << message << std::endl;
-    }
-
-    return splat;
+static inline int32_t load_u32(const uint8_t *p)
+{
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
 }
 
-GaussianSplat gaussian_splat_from_splat_file(std::string filename)
+/*
+ * Transposes n 32-byte .splat records (see splat_file_reader_open()) into the attribute
+ * arrays. Colors and opacity are mapped to [0, 1], rotations to [-1, 1] and normalized. A zero
+ * rotation stays zero, see normalize_quaternion().
+ */
+static void decode_splat_records(const uint8_t *records, size_t n, glm::vec3 *positions, glm::vec3 *scales,
+                                 glm::vec3 *colors, float *opacities, glm::vec4 *rotations)
 {
-    // The .splat file format is "Reverse engineered" from:
-    // https://github.com/antimatter15/splat/blob/main/convert.py
-    GaussianSplat splat;
-    splat.filename = std::filesystem::path(filename).filename().string();
-    splat.had_error = false;
+    size_t i = 0;
+#ifdef SPLAT_DECODE_SSE2
+    /* NOTE: Same as .ply files, coordinate system seems to be left handed */
+    const __m128 flip = _mm_setr_ps(-1.0f, -1.0f, 1.0f, 1.0f);
+    const __m128 unorm = _mm_set1_ps(1.0f / 255.0f);
+    const __m128 snorm = _mm_set1_ps(1.0f / 128.0f);
+    const __m128 bias = _mm_set1_ps(128.0f);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128i zero = _mm_setzero_si128();
+
+    /* Four records at a time. The 16 byte stores of vec3s spill into the next element, so the
+     * last record is always left for the scalar loop. */
+    for (; i + 4 < n; i += 4) {
+        const uint8_t *r = records + i * 32;
+
+        for (int k = 0; k < 4; k++) {
+            __m128 position = _mm_loadu_ps(reinterpret_cast<const float *>(r + k * 32));
+            __m128 scale = _mm_loadu_ps(reinterpret_cast<const float *>(r + k * 32 + 12));
+            _mm_storeu_ps(&positions[i + k].x, _mm_mul_ps(position, flip));
+            _mm_storeu_ps(&scales[i + k].x, scale);
+        }
 
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
-        splat.warning_and_error_messages.push_back("Error: Could not open file " + filename);
-        splat.had_error = true;
-        return splat;
+        /* Bytes to one float vector per record */
+        __m128i color_bytes = _mm_setr_epi32(load_u32(r + 24), load_u32(r + 56), load_u32(r + 88), load_u32(r + 120));
+        __m128i color_lo = _mm_unpacklo_epi8(color_bytes, zero);
+        __m128i color_hi = _mm_unpackhi_epi8(color_bytes, zero);
+        __m128 c0 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(color_lo, zero)), unorm);
+        __m128 c1 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(color_lo, zero)), unorm);
+        __m128 c2 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(color_hi, zero)), unorm);
+        __m128 c3 = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(color_hi, zero)), unorm);
+        _mm_storeu_ps(&colors[i + 0].x, c0);
+        _mm_storeu_ps(&colors[i + 1].x, c1);
+        _mm_storeu_ps(&colors[i + 2].x, c2);
+        _mm_storeu_ps(&colors[i + 3].x, c3);
+        /* Opacity. Already calculated :: 1 / (1 + e^(-opacity)) */
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+        _mm_storeu_ps(opacities + i, c3);
+
+        __m128i rotation_bytes = _mm_setr_epi32(load_u32(r + 28), load_u32(r + 60), load_u32(r + 92), load_u32(r + 124));
+        __m128i rotation_lo = _mm_unpacklo_epi8(rotation_bytes, zero);
+        __m128i rotation_hi = _mm_unpackhi_epi8(rotation_bytes, zero);
+        __m128 q0 = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(rotation_lo, zero)), bias), snorm);
+        __m128 q1 = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(rotation_lo, zero)), bias), snorm);
+        __m128 q2 = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(rotation_hi, zero)), bias), snorm);
+        __m128 q3 = _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(rotation_hi, zero)), bias), snorm);
+        /* One component of all four quaternions per vector */
+        _MM_TRANSPOSE4_PS(q0, q1, q2, q3);
+        __m128 length_squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(q0, q0), _mm_mul_ps(q1, q1)),
+                                           _mm_add_ps(_mm_mul_ps(q2, q2), _mm_mul_ps(q3, q3)));
+        __m128 is_zero = _mm_cmpeq_ps(length_squared, _mm_setzero_ps());
+        __m128 inverse_length = _mm_div_ps(one, _mm_sqrt_ps(length_squared));
+        q0 = _mm_andnot_ps(is_zero, _mm_mul_ps(q0, inverse_length));
+        q1 = _mm_andnot_ps(is_zero, _mm_mul_ps(q1, inverse_length));
+        q2 = _mm_andnot_ps(is_zero, _mm_mul_ps(q2, inverse_length));
+        q3 = _mm_andnot_ps(is_zero, _mm_mul_ps(q3, inverse_length));
+        _MM_TRANSPOSE4_PS(q0, q1, q2, q3);
+        _mm_storeu_ps(&rotations[i + 0].x, q0);
+        _mm_storeu_ps(&rotations[i + 1].x, q1);
+        _mm_storeu_ps(&rotations[i + 2].x, q2);
+        _mm_storeu_ps(&rotations[i + 3].x, q3);
     }
+#endif
 
-    // Get file size to determine number of vertices
-    file.seekg(0, std::ios::end);
-    std::streamsize file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
+    for (; i < n; i++) {
+        const uint8_t *r = records + i * 32;
+        float f[6];
+        memcpy(f, r, sizeof(f));
+        positions[i] = glm::vec3(-f[0], -f[1], f[2]);
+        scales[i] = glm::vec3(f[3], f[4], f[5]);
 
-    // Each vertex in the .splat format consists of:
-    // - 3 floats for position
-    // - 3 floats for scales
-    // - 4 bytes for colors (final is opacity)
-    // - 4 bytes for rotation
-    const size_t bytes_per_vertex = 12 + 12 + 4 + 4;
-    
-    if (file_size % bytes_per_vertex != 0) {
-        splat.warning_and_error_messages.push_back("Error: File size is not a multiple of vertex size");
-        splat.had_error = true;
-        return splat;
+        colors[i] = glm::vec3(r[24], r[25], r[26]) * (1.0f / 255.0f);
+        opacities[i] = float(r[27]) * (1.0f / 255.0f);
+
+        glm::vec4 rotation = (glm::vec4(r[28], r[29], r[30], r[31]) - 128.0f) * (1.0f / 128.0f);
+        float length_squared = glm::dot(rotation, rotation);
+        rotations[i] = length_squared == 0.0f ? rotation : rotation * (1.0f / std::sqrt(length_squared));
+    }
+}
+
+void splat_file_reader_decode(const SplatFileReader *reader, const unsigned char *records, size_t n,
+                              GaussianSplat &splat, size_t first)
+{
+    if (reader->from_ply) {
+        decode_ply_records(records, n, reader->strange_format, splat, first);
+    } else {
+        decode_splat_records(records, n, &splat.ws_positions[first], &splat.scales[first],
+                             &splat.colors[first], &splat.opacities[first], &splat.rotations[first]);
     }
+}
+
+/* Reads a whole .ply or .splat file through a SplatFileReader */
+static GaussianSplat gaussian_splat_from_reader(std::string filename, LoadProgress *progress)
+{
+    GaussianSplat splat;
+    splat.filename = std::filesystem::path(filename).filename().string();
+    splat.had_error = false;
 
-    size_t vertex_count = file_size / bytes_per_vertex;
-    splat.count = vertex_count;
-
-    // Reserve space
-    splat.ws_positions.reserve(vertex_count);
-    //splat.normals.reserve(vertex_count);
-    splat.colors.reserve(vertex_count);
-    //splat.shs.reserve(vertex_count);
-    splat.opacities.reserve(vertex_count);
-    splat.scales.reserve(vertex_count);
-    splat.rotations.reserve(vertex_count);
-
-    float position[3];
-    float scales[3];
-    uint8_t color_data[4];
-    uint8_t rotation_data[4];
-    for (size_t i = 0; i < vertex_count; i++) {
-        file.read(reinterpret_cast<char*>(position), sizeof(float) * 3);
-        // NOTE: Same as .ply files, coordinate system seems to be left handed
-        splat.ws_positions.push_back(glm::vec3(-position[0], -position[1], position[2]));
-
-        // Read scales
-        file.read(reinterpret_cast<char*>(scales), sizeof(float) * 3);
-        splat.scales.push_back(glm::vec3(scales[0], scales[1], scales[2]));
-
-        // Read color. Normalize it between 0-1
-        file.read(reinterpret_cast<char*>(color_data), sizeof(uint8_t) * 4);
-        splat.colors.push_back(glm::vec3(
-            color_data[0] / 255.0f,
-            color_data[1] / 255.0f,
-            color_data[2] / 255.0f
-        ));
-        // Opacity. Already calculated :: 1 / (1 + e^(-opacity)). Normalize it as well.
-        splat.opacities.push_back(float(color_data[3]) / 255.0f);
-
-        // Read rotation. Normalize each component between -1 to 1.
-        file.read(reinterpret_cast<char*>(rotation_data), sizeof(uint8_t) * 4);
-        glm::vec4 rot(
-            //rotation_data[0],
-            //rotation_data[1],
-            //rotation_data[2],
-            //rotation_data[3]
-            (float(rotation_data[0]) - 128.0f) / 128.0f,
-            (float(rotation_data[1]) - 128.0f) / 128.0f,
-            (float(rotation_data[2]) - 128.0f) / 128.0f,
-            (float(rotation_data[3]) - 128.0f) / 128.0f
-        );
-        
-        splat.rotations.push_back(rot);
-        //splat.rotations.push_back(rot);
-        //splat.rotations.push_back(glm::vec4(0));
-
-        if (!file) {
-            std::stringstream ss;
-            ss << "Error: Failed to read vertex data at index " << i;
-            splat.warning_and_error_messages.push_back(ss.str());
-            splat.had_error = true;
-            return splat;
+    SplatFileReader reader;
+    if (splat_file_reader_open(&reader, filename)) {
+        PROFILE_ZONE("decode vertices");
+        splat.from_ply = reader.from_ply;
+        // Filled in place by splat_file_reader_decode()
+        gaussian_splat_resize(splat, reader.count, reader.from_ply);
+        set_progress_totals(progress, reader.count, reader.data_offset + reader.count * reader.record_size);
+
+        // Read in big blocks, so loading is bound by the disk and not by the number of reads
+        size_t block_vertices = reader.from_ply ? PLY_READ_BLOCK : SPLAT_READ_BLOCK;
+        std::vector<uint8_t> block;
+        while (reader.next < reader.count) {
+            size_t first = reader.next;
+            if (!report_progress(progress, first, reader.data_offset + first * reader.record_size)) {
+                reader.warning_and_error_messages.push_back("Error: Loading was cancelled");
+                reader.had_error = true;
+                break;
+            }
+            size_t n = splat_file_reader_read(&reader, block_vertices, block);
+            if (n == 0) {
+                break;
+            }
+            splat_file_reader_decode(&reader, block.data(), n, splat, first);
+        }
+        if (!reader.had_error) {
+            report_progress(progress, reader.count, reader.data_offset + reader.count * reader.record_size);
         }
     }
 
-    file.close();
+    splat.had_error = reader.had_error;
+    splat.warning_and_error_messages = std::move(reader.warning_and_error_messages);
 
+    // TODO: Optional print flag maybe
     for (auto message : splat.warning_and_error_messages) {
         std::cout << message << std::endl;
     }
@@ -407,6 +553,15 @@ GaussianSplat gaussian_splat_from_splat_file(std::string filename)
     return splat;
 }
 
+GaussianSplat gaussian_splat_from_ply_file(std::string filename, LoadProgress *progress)
+{
+    return gaussian_splat_from_reader(filename, progress);
+}
+
+GaussianSplat gaussian_splat_from_splat_file(std::string filename, LoadProgress *progress)
+{
+    return gaussian_splat_from_reader(filename, progress);
+}
 
 void gaussian_splat_print(GaussianSplat &splat)
 {
@@ -431,3 +586,23 @@ void gaussian_splat_print(GaussianSplat &splat)
     // }
 }
 
+template <typename T>
+static void release_vector(std::vector<T> &v)
+{
+    // clear() keeps the capacity
+    std::vector<T>().swap(v);
+}
+
+void gaussian_splat_release_attributes(GaussianSplat &splat)
+{
+    release_vector(splat.ws_positions);
+    release_vector(splat.normals);
+    release_vector(splat.colors);
+    release_vector(splat.shs);
+    release_vector(splat.sh_indices);
+    splat.sh_codebook.reset();
+    release_vector(splat.opacities);
+    release_vector(splat.scales);
+    release_vector(splat.rotations);
+    splat.attributes_released = true;
+}
@@ -18,6 +18,10 @@
 
 #pragma once 
 
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
 #include <vector>
 #include <string>
 #include <glm/glm.hpp>
@@ -28,6 +32,9 @@ typedef struct {
     float coeffs[SPHERICAL_HARMONICS_COEFFS_COUNT];
 } SphericalHarmonics;
 
+struct paged_splat_file_t;
+struct sh_codebook_t;
+
 typedef struct gaussian_splat_t {
     std::string filename;
     bool had_error;
@@ -42,17 +49,82 @@ typedef struct gaussian_splat_t {
     std::vector<glm::vec3> normals; // nx, ny, nz
     std::vector<glm::vec3> colors; // f_dc_0, f_dc_1, f_dc_2
     std::vector<SphericalHarmonics> shs; // f_rest_0 .. f_rest_44
+    /* Replace shs once quantized, see shCodebook.hpp and gaussian_splat_sh() */
+    std::shared_ptr<struct sh_codebook_t> sh_codebook;
+    std::vector<uint16_t> sh_indices;
     // Between 0 and 1, mapped by the sigmoid function
     std::vector<float> opacities; // opacity
     // Raised to e
     std::vector<glm::vec3> scales; // scale_0, scale_1, scale_2
     /* Quaternion with magnitude of 1 */
     std::vector<glm::vec4> rotations; // rot_0 .. rot_3
+
+    /* Set once the per-splat arrays have been freed, see gaussian_splat_release_attributes() */
+    bool attributes_released = false;
+    /* Set for paged files, see pagedSplat.hpp. The per-splat arrays are then empty and the
+     * splats are streamed from the file while rendering. */
+    std::shared_ptr<struct paged_splat_file_t> paged;
+    /* Splats removed when loading, see splatPrune.hpp */
+    size_t pruned_count = 0;
 } GaussianSplat;
 
-GaussianSplat gaussian_splat_from_file(std::string filename);
-GaussianSplat gaussian_splat_from_ply_file(std::string filename);
-GaussianSplat gaussian_splat_from_splat_file(std::string filename);
+/*
+ * Written by the loading thread while decoding and read by anyone. Setting cancelled makes the
+ * loader stop early and return a splat with had_error set.
+ */
+typedef struct load_progress_t {
+    std::atomic<size_t> bytes_read{0};
+    std::atomic<size_t> bytes_total{0};
+    std::atomic<size_t> splats_decoded{0};
+    std::atomic<size_t> splats_total{0};
+    std::atomic<bool> cancelled{false};
+} LoadProgress;
+
+/* Both do nothing if progress is null. report_progress() returns false if the load has been cancelled. */
+bool report_progress(LoadProgress *progress, size_t splats_decoded, size_t bytes_read);
+void set_progress_totals(LoadProgress *progress, size_t splats_total, size_t bytes_total);
+
+/* progress is optional */
+GaussianSplat gaussian_splat_from_file(std::string filename, LoadProgress *progress = nullptr);
+GaussianSplat gaussian_splat_from_ply_file(std::string filename, LoadProgress *progress = nullptr);
+GaussianSplat gaussian_splat_from_splat_file(std::string filename, LoadProgress *progress = nullptr);
+
+/*
+ * Reads .ply and .splat files a block of vertices at a time, for files that don't fit in memory.
+ * Reading is sequential, but decoding only touches the given range of the destination, so a
+ * block can be decoded by several threads at once. gaussian_splat_from_file() is built on it.
+ *
+ *     SplatFileReader reader;
+ *     if (!splat_file_reader_open(&reader, path)) { ... reader.warning_and_error_messages ... }
+ *     while (size_t n = splat_file_reader_read(&reader, 65536, records)) {
+ *         gaussian_splat_resize(block, n, reader.from_ply);
+ *         splat_file_reader_decode(&reader, records.data(), n, block, 0);
+ *     }
+ */
+typedef struct splat_file_reader_t {
+    std::string filename;
+    std::ifstream file;
+    bool from_ply = false;
+    bool strange_format = false; // Some .ply files have scale_2 after all the rots
+    size_t count = 0;            // Vertices in the file
+    size_t next = 0;             // Next vertex to be read
+    size_t record_size = 0;      // Bytes per vertex
+    size_t data_offset = 0;      // Of the first vertex
+    bool had_error = false;
+    std::vector<std::string> warning_and_error_messages;
+} SplatFileReader;
+
+/* Opens a .ply or .splat file and parses the header */
+bool splat_file_reader_open(SplatFileReader *reader, const std::string &filename);
+/* Reads the raw records of up to max_count vertices. Returns how many, 0 at the end or on errors. */
+size_t splat_file_reader_read(SplatFileReader *reader, size_t max_count, std::vector<unsigned char> &records);
+/* Decodes n records into splat, starting at vertex first. The arrays must already be big enough. */
+void splat_file_reader_decode(const SplatFileReader *reader, const unsigned char *records, size_t n,
+                              GaussianSplat &splat, size_t first);
+/* Sizes all per-splat arrays for count vertices. shs is left empty unless with_shs is set. */
+void gaussian_splat_resize(GaussianSplat &splat, size_t count, bool with_shs);
 
 void gaussian_splat_print(GaussianSplat &splat);
+/* Frees the per-splat arrays. count, filename and the messages are kept. */
+void gaussian_splat_release_attributes(GaussianSplat &splat);
 
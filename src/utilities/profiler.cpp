@@ -0,0 +1,160 @@
+#include "profiler.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+typedef struct {
+    const char *name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+} ProfileEvent;
+
+// A ring slot. The exporter reads slots while their thread may overwrite them, so the fields are
+// atomics, all accessed relaxed. Whether a copy is whole is decided by the head, like a seqlock.
+typedef struct {
+    std::atomic<const char *> name;
+    std::atomic<uint64_t> start_ns;
+    std::atomic<uint64_t> end_ns;
+} ProfileSlot;
+
+typedef struct {
+    uint32_t thread_id;
+    // Total number of events recorded, the ring index is head % PROFILER_EVENTS_PER_THREAD. Only
+    // ever written by the owning thread.
+    std::atomic<uint64_t> head;
+    // Events before this one were dropped by profiler_clear(). Only accessed under buffers_mutex.
+    uint64_t cleared;
+    std::unique_ptr<ProfileSlot[]> events;
+} ProfileThreadBuffer;
+
+std::atomic<bool> profiler_is_enabled(false);
+
+// Buffers are never freed, so zones recorded by threads that have since exited can still be exported
+static std::mutex buffers_mutex;
+static std::vector<std::unique_ptr<ProfileThreadBuffer>> buffers;
+static thread_local ProfileThreadBuffer *thread_buffer = nullptr;
+
+static const std::chrono::steady_clock::time_point profiler_epoch = std::chrono::steady_clock::now();
+
+
+uint64_t profiler_now_ns()
+{
+    auto elapsed = std::chrono::steady_clock::now() - profiler_epoch;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+static ProfileThreadBuffer *register_thread()
+{
+    auto buffer = std::make_unique<ProfileThreadBuffer>();
+    buffer->head.store(0);
+    buffer->cleared = 0;
+    buffer->events = std::make_unique<ProfileSlot[]>(PROFILER_EVENTS_PER_THREAD);
+
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    buffer->thread_id = uint32_t(buffers.size()) + 1;
+    buffers.push_back(std::move(buffer));
+    return buffers.back().get();
+}
+
+void profiler_record(const char *name, uint64_t start_ns, uint64_t end_ns)
+{
+    if (!thread_buffer) {
+        thread_buffer = register_thread();
+    }
+
+    // Only this thread writes to its buffer, the release store publishes the event to exporters.
+    // The fence pairs with the one in the exporter: an exporter that read any field of this event
+    // also sees a head of at least `head`, and so knows the slot was being overwritten.
+    uint64_t head = thread_buffer->head.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    ProfileSlot &slot = thread_buffer->events[head % PROFILER_EVENTS_PER_THREAD];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start_ns.store(start_ns, std::memory_order_relaxed);
+    slot.end_ns.store(end_ns, std::memory_order_relaxed);
+    thread_buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void profiler_set_enabled(bool enabled)
+{
+    profiler_is_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void profiler_clear()
+{
+    // Resetting the heads would race with threads inside profiler_record(), so the events before
+    // the current heads are skipped by the exporter instead
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    for (auto &buffer : buffers) {
+        buffer->cleared = buffer->head.load(std::memory_order_acquire);
+    }
+}
+
+// Zone names come from our own string literals, but escape them anyway to always produce valid JSON
+static void write_json_string(FILE *file, const char *str)
+{
+    fputc('"', file);
+    for (const char *c = str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+        }
+        fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+bool profiler_export_chrome_trace(const std::string &filename)
+{
+    FILE *file = fopen(filename.c_str(), "w");
+    if (!file) {
+        fprintf(stderr, "ERROR: Could not open %s for writing\n", filename.c_str());
+        return false;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    bool first = true;
+    size_t event_count = 0;
+
+    std::vector<ProfileEvent> events;
+    std::lock_guard<std::mutex> lock(buffers_mutex);
+    for (auto &buffer : buffers) {
+        // The owning thread may keep recording while we copy, overwriting the oldest slots. Copy
+        // first, then drop every event whose slot the thread could have reached in the meantime.
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t recorded = head - buffer->cleared;
+        uint64_t count = recorded < PROFILER_EVENTS_PER_THREAD ? recorded : PROFILER_EVENTS_PER_THREAD;
+        events.clear();
+        for (uint64_t i = head - count; i < head; i++) {
+            const ProfileSlot &slot = buffer->events[i % PROFILER_EVENTS_PER_THREAD];
+            events.push_back({ slot.name.load(std::memory_order_relaxed), slot.start_ns.load(std::memory_order_relaxed),
+                               slot.end_ns.load(std::memory_order_relaxed) });
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t head_after = buffer->head.load(std::memory_order_relaxed);
+        // The event at head_after may be half written, so its slot is unsafe too
+        uint64_t first_safe = head_after + 1 > PROFILER_EVENTS_PER_THREAD ? head_after + 1 - PROFILER_EVENTS_PER_THREAD : 0;
+        for (uint64_t i = head - count; i < head; i++) {
+            if (i < first_safe) {
+                continue;
+            }
+            const ProfileEvent &event = events[i - (head - count)];
+            // trace_event timestamps are in microseconds, keep the nanoseconds as decimals
+            fprintf(file, "%s{\"name\": ", first ? "" : ",\n");
+            write_json_string(file, event.name);
+            fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+                    buffer->thread_id, event.start_ns / 1000.0, (event.end_ns - event.start_ns) / 1000.0);
+            first = false;
+            event_count++;
+        }
+    }
+
+    fprintf(file, "\n]}\n");
+    bool ok = ferror(file) == 0;
+    fclose(file);
+    if (ok) {
+        printf("Wrote %zu trace events to %s\n", event_count, filename.c_str());
+    }
+    return ok;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+// Lightweight instrumentation of the hot paths.
+//
+//     void depth_sort() {
+//         PROFILE_ZONE("depth sort");
+//         ...
+//     }
+//
+// A zone records nanosecond start and end timestamps into a ring buffer owned by the calling
+// thread, so recording never takes a lock. While the profiler is disabled a zone costs a single
+// relaxed atomic load. Captured zones can be exported as Chrome trace_event JSON, which can be
+// opened in Perfetto (https://ui.perfetto.dev) or chrome://tracing.
+//
+// Zones that end before their scope does are named, and ended with PROFILE_ZONE_END:
+//
+//     PROFILE_ZONE_NAMED(depth_zone, "depth");
+//     ...
+//     PROFILE_ZONE_END(depth_zone);
+//
+// Define GLOWBOX_DISABLE_PROFILER to compile all zones out.
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Number of zones kept per thread. Older zones are overwritten when a thread records more.
+#define PROFILER_EVENTS_PER_THREAD (1 << 16)
+
+extern std::atomic<bool> profiler_is_enabled;
+
+uint64_t profiler_now_ns();
+void profiler_record(const char *name, uint64_t start_ns, uint64_t end_ns);
+
+void profiler_set_enabled(bool enabled);
+// Drops all recorded zones. Safe while other threads record, zones that end afterwards are kept.
+void profiler_clear();
+// Writes all recorded zones as Chrome trace_event JSON. Returns false if the file couldn't be written.
+bool profiler_export_chrome_trace(const std::string &filename);
+
+class ProfileZone
+{
+public:
+    // `name` must outlive the profiler, in practice a string literal
+    explicit ProfileZone(const char *name)
+    {
+        if (profiler_is_enabled.load(std::memory_order_relaxed)) {
+            zoneName = name;
+            startNs = profiler_now_ns();
+        }
+    }
+
+    ~ProfileZone() { end(); }
+
+    /* Ends the zone before the end of the scope. Useful for sequential stages in one function. */
+    void end()
+    {
+        if (zoneName) {
+            profiler_record(zoneName, startNs, profiler_now_ns());
+            zoneName = nullptr;
+        }
+    }
+
+private:
+    ProfileZone(ProfileZone const &) = delete;
+    ProfileZone & operator =(ProfileZone const &) = delete;
+
+    const char *zoneName = nullptr;
+    uint64_t startNs = 0;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifndef GLOWBOX_DISABLE_PROFILER
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#define PROFILE_ZONE_NAMED(variable, name) ProfileZone variable(name)
+#define PROFILE_ZONE_END(variable) variable.end()
+#else
+#define PROFILE_ZONE(name) do {} while (0)
+#define PROFILE_ZONE_NAMED(variable, name) do {} while (0)
+#define PROFILE_ZONE_END(variable) do {} while (0)
+#endif
@@ -0,0 +1,182 @@
+#include "shCodebook.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include "parallel.hpp"
+#include "profiler.hpp"
+#include "timeutils.h"
+
+#define SH_DIMENSIONS SPHERICAL_HARMONICS_COEFFS_COUNT
+
+using Clock = std::chrono::steady_clock;
+
+static float distance_squared(const float *a, const float *b)
+{
+    float sum = 0.0f;
+    for (int d = 0; d < SH_DIMENSIONS; d++) {
+        float difference = a[d] - b[d];
+        sum += difference * difference;
+    }
+    return sum;
+}
+
+static uint32_t nearest(const SphericalHarmonics &v, const SphericalHarmonics *centroids, size_t count)
+{
+    uint32_t best = 0;
+    float best_distance = distance_squared(v.coeffs, centroids[0].coeffs);
+    for (size_t c = 1; c < count; c++) {
+        float distance = distance_squared(v.coeffs, centroids[c].coeffs);
+        if (distance < best_distance) {
+            best_distance = distance;
+            best = uint32_t(c);
+        }
+    }
+    return best;
+}
+
+// Lloyd's k-means over data[points], writing k centroids. Starts from points spread evenly over
+// the list. Centroids that lose all their points keep their last position.
+static void kmeans(const std::vector<SphericalHarmonics> &data, const std::vector<uint32_t> &points, size_t k,
+                   int iterations, int threads, SphericalHarmonics *centroids)
+{
+    for (size_t c = 0; c < k; c++) {
+        centroids[c] = data[points[c * points.size() / k]];
+    }
+
+    std::vector<uint32_t> assignment(points.size());
+    std::vector<double> sums(k * SH_DIMENSIONS);
+    std::vector<size_t> counts(k);
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        parallel_for(points.size(), threads, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                assignment[i] = nearest(data[points[i]], centroids, k);
+            }
+        });
+
+        std::fill(sums.begin(), sums.end(), 0.0);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = 0; i < points.size(); i++) {
+            const float *v = data[points[i]].coeffs;
+            double *sum = &sums[assignment[i] * SH_DIMENSIONS];
+            for (int d = 0; d < SH_DIMENSIONS; d++) {
+                sum[d] += v[d];
+            }
+            counts[assignment[i]]++;
+        }
+        for (size_t c = 0; c < k; c++) {
+            if (counts[c] == 0) {
+                continue;
+            }
+            for (int d = 0; d < SH_DIMENSIONS; d++) {
+                centroids[c].coeffs[d] = float(sums[c * SH_DIMENSIONS + d] / double(counts[c]));
+            }
+        }
+    }
+}
+
+void gaussian_splat_quantize_sh(GaussianSplat &splat, const ShCodebookOptions &options)
+{
+    size_t count = splat.shs.size();
+    if (options.size <= 0 || count == 0) {
+        return;
+    }
+    PROFILE_ZONE("quantize sh");
+    Clock::time_point start = Clock::now();
+    int threads = options.threads > 0 ? options.threads : parallel_thread_count();
+
+    // Split the size in two powers of two, for the coarse and the fine level
+    int bits = 0;
+    while (bits < 16 && (size_t(1) << (bits + 1)) <= size_t(options.size)) {
+        bits++;
+    }
+    size_t coarse_size = size_t(1) << (bits / 2);
+    size_t fine_size = size_t(1) << (bits - bits / 2);
+    size_t size = coarse_size * fine_size;
+
+    // Sampled evenly over the file, which is roughly spread over the scene
+    size_t training = options.training_splats == 0 ? count : std::min(count, options.training_splats);
+    std::vector<uint32_t> sample(training);
+    for (size_t i = 0; i < training; i++) {
+        sample[i] = uint32_t(i * count / training);
+    }
+
+    auto codebook = std::make_shared<ShCodebook>();
+    codebook->entries.resize(size);
+    std::vector<SphericalHarmonics> coarse(coarse_size);
+    kmeans(splat.shs, sample, coarse_size, options.iterations, threads, coarse.data());
+
+    std::vector<uint32_t> coarse_of(training);
+    parallel_for(training, threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            coarse_of[i] = nearest(splat.shs[sample[i]], coarse.data(), coarse_size);
+        }
+    });
+    std::vector<std::vector<uint32_t>> members(coarse_size);
+    for (size_t i = 0; i < training; i++) {
+        members[coarse_of[i]].push_back(sample[i]);
+    }
+    // The clusters are independent, so they are trained in parallel
+    parallel_for(coarse_size, threads, [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            SphericalHarmonics *fine = &codebook->entries[c * fine_size];
+            if (members[c].empty()) {
+                std::fill(fine, fine + fine_size, coarse[c]);
+            } else {
+                kmeans(splat.shs, members[c], fine_size, options.iterations, 1, fine);
+            }
+        }
+    });
+    codebook->stats.training_splats = training;
+    codebook->stats.build_ms = elapsed_ms(start);
+
+    // Every splat goes to the nearest fine entry of its nearest coarse cluster
+    start = Clock::now();
+    splat.sh_indices.resize(count);
+    parallel_for(count, threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint32_t c = nearest(splat.shs[i], coarse.data(), coarse_size);
+            uint32_t f = nearest(splat.shs[i], &codebook->entries[c * fine_size], fine_size);
+            splat.sh_indices[i] = uint16_t(c * fine_size + f);
+        }
+    });
+
+    // The training set only saw a sample, refitting to all splats lowers the error for free
+    std::vector<double> sums(size * SH_DIMENSIONS, 0.0);
+    std::vector<size_t> counts(size, 0);
+    for (size_t i = 0; i < count; i++) {
+        double *sum = &sums[size_t(splat.sh_indices[i]) * SH_DIMENSIONS];
+        for (int d = 0; d < SH_DIMENSIONS; d++) {
+            sum[d] += splat.shs[i].coeffs[d];
+        }
+        counts[splat.sh_indices[i]]++;
+    }
+    for (size_t e = 0; e < size; e++) {
+        for (int d = 0; counts[e] > 0 && d < SH_DIMENSIONS; d++) {
+            codebook->entries[e].coeffs[d] = float(sums[e * SH_DIMENSIONS + d] / double(counts[e]));
+        }
+    }
+
+    double error = 0.0;
+    double value = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        const SphericalHarmonics &entry = codebook->entries[splat.sh_indices[i]];
+        error += distance_squared(splat.shs[i].coeffs, entry.coeffs);
+        for (int d = 0; d < SH_DIMENSIONS; d++) {
+            value += double(splat.shs[i].coeffs[d]) * splat.shs[i].coeffs[d];
+        }
+    }
+    codebook->stats.rms_error = std::sqrt(error / double(count * SH_DIMENSIONS));
+    codebook->stats.rms_value = std::sqrt(value / double(count * SH_DIMENSIONS));
+    codebook->stats.assign_ms = elapsed_ms(start);
+
+    std::vector<SphericalHarmonics>().swap(splat.shs);
+    splat.sh_codebook = codebook;
+
+    const ShCodebookStats &stats = codebook->stats;
+    std::cout << "SH codebook: " << size << " entries trained on " << stats.training_splats << " splats in "
+              << stats.build_ms << " ms, assigned in " << stats.assign_ms << " ms, RMS error " << stats.rms_error
+              << " (coefficients " << stats.rms_value << ")" << std::endl;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "plyParser.hpp"
+
+// Largest codebook, the indices are 16-bit
+#define SH_CODEBOOK_MAX_SIZE 65536
+// Default number of splats the codebook is trained on, --sh-training on the command line
+#define SH_CODEBOOK_DEFAULT_TRAINING 131072
+
+// The 45 spherical harmonics coefficients take 180 of the 236 bytes of a decoded .ply splat.
+// Vector quantization replaces them with a 16-bit index into a shared codebook, which makes a
+// model's SH more than 50 times smaller for codebooks of up to a few thousand entries.
+//
+// The codebook is a two level tree: a coarse k-means over the training set, then a fine
+// k-means within every coarse cluster. Finding the entry for a splat then takes
+// sqrt(size) * 2 distance computations instead of size, which is what makes assigning millions
+// of splats fast enough to do while loading. The entries are finally refit to the mean of all
+// splats assigned to them.
+typedef struct {
+    // Entries, a power of two up to SH_CODEBOOK_MAX_SIZE. 0 keeps the full coefficients.
+    int size = 0;
+    // Splats sampled evenly to train on, 0 trains on all of them
+    size_t training_splats = SH_CODEBOOK_DEFAULT_TRAINING;
+    int iterations = 8;
+    // 0 uses one thread per core
+    int threads = 0;
+} ShCodebookOptions;
+
+typedef struct {
+    size_t training_splats = 0;
+    double build_ms = 0.0;  // Training both levels
+    double assign_ms = 0.0; // Assigning every splat and refitting the entries
+    // Root mean square over all coefficients of all splats, of the error and of the coefficients
+    // themselves, to put the error in relation
+    double rms_error = 0.0;
+    double rms_value = 0.0;
+} ShCodebookStats;
+
+typedef struct sh_codebook_t {
+    std::vector<SphericalHarmonics> entries;
+    ShCodebookStats stats;
+} ShCodebook;
+
+// Builds a codebook for splat.shs, fills splat.sh_indices and frees splat.shs. Does nothing if
+// the options are disabled or the splat has no spherical harmonics.
+void gaussian_splat_quantize_sh(GaussianSplat &splat, const ShCodebookOptions &options);
+
+// The coefficients of splat i, from the codebook if there is one
+inline const SphericalHarmonics &gaussian_splat_sh(const GaussianSplat &splat, size_t i)
+{
+    return splat.sh_codebook ? splat.sh_codebook->entries[splat.sh_indices[i]] : splat.shs[i];
+}
@@ -0,0 +1,70 @@
+#include "sortArena.hpp"
+
+#include <new>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Room for this many buffers to be padded to the alignment
+#define SORT_ARENA_BUFFERS 8
+#define HUGE_PAGE_SIZE (size_t(2) << 20)
+
+void sort_arena_reserve(SortArena *arena, size_t bytes)
+{
+    bytes += SORT_ARENA_BUFFERS * SORT_ARENA_ALIGNMENT;
+    if (bytes <= arena->capacity) {
+        return;
+    }
+    sort_arena_free(arena);
+#ifdef __linux__
+    size_t size = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED) {
+        // Only a hint, without transparent huge pages enabled this fails and small pages are used
+        arena->huge_pages = madvise(memory, size, MADV_HUGEPAGE) == 0;
+        arena->memory = static_cast<unsigned char *>(memory);
+        arena->capacity = size;
+        arena->mapped = true;
+    }
+#endif
+    if (!arena->memory) {
+        arena->memory = static_cast<unsigned char *>(::operator new(bytes, std::align_val_t(SORT_ARENA_ALIGNMENT)));
+        arena->capacity = bytes;
+    }
+    arena->used = 0;
+    arena->reservations++;
+}
+
+void sort_arena_reset(SortArena *arena)
+{
+    arena->used = 0;
+}
+
+void sort_arena_free(SortArena *arena)
+{
+    if (!arena->memory) {
+        return;
+    }
+#ifdef __linux__
+    if (arena->mapped) {
+        munmap(arena->memory, arena->capacity);
+    } else
+#endif
+    {
+        ::operator delete(arena->memory, std::align_val_t(SORT_ARENA_ALIGNMENT));
+    }
+    arena->memory = nullptr;
+    arena->capacity = arena->used = 0;
+    arena->mapped = arena->huge_pages = false;
+}
+
+void *sort_arena_alloc_bytes(SortArena *arena, size_t bytes)
+{
+    size_t start = (arena->used + SORT_ARENA_ALIGNMENT - 1) / SORT_ARENA_ALIGNMENT * SORT_ARENA_ALIGNMENT;
+    if (start > arena->capacity || bytes > arena->capacity - start) {
+        return nullptr;
+    }
+    arena->used = start + bytes;
+    return arena->memory + start;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Scratch memory for the depth sorts: keys, indices and whatever else a sort needs for the whole
+// model. It is reserved once, for the biggest sort of the current model, and handed out again for
+// every sort after that, so frames that sort don't call malloc or touch fresh pages.
+//
+// On Linux the memory is mapped directly and marked for transparent huge pages, which saves most
+// of the page faults and TLB misses when hundreds of MB are reserved. Elsewhere it is a plain
+// aligned allocation.
+//
+//     sort_arena_reserve(&arena, count * (sizeof(Key) + sizeof(uint32_t)));
+//     Key *keys = sort_arena_alloc<Key>(&arena, count);
+//     uint32_t *indices = sort_arena_alloc<uint32_t>(&arena, count);
+//     ... sort ...
+//     sort_arena_reset(&arena);
+typedef struct {
+    unsigned char *memory = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    bool mapped = false; // With mmap rather than operator new
+    bool huge_pages = false;
+    size_t reservations = 0; // Times memory was actually allocated
+} SortArena;
+
+// Alignment of every allocation, so each buffer starts on its own cache line
+#define SORT_ARENA_ALIGNMENT 64
+
+// Makes sure at least bytes fit, plus the alignment padding of a few buffers. Only reallocates
+// when growing, which invalidates everything allocated from the arena.
+void sort_arena_reserve(SortArena *arena, size_t bytes);
+// Makes all the memory available again, without releasing it
+void sort_arena_reset(SortArena *arena);
+// Releases the memory, e.g. when the model changes
+void sort_arena_free(SortArena *arena);
+// Uninitialized room for bytes bytes, or nullptr if the reservation was too small
+void *sort_arena_alloc_bytes(SortArena *arena, size_t bytes);
+
+template <typename T>
+T *sort_arena_alloc(SortArena *arena, size_t count)
+{
+    return static_cast<T *>(sort_arena_alloc_bytes(arena, count * sizeof(T)));
+}
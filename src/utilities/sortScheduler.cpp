@@ -0,0 +1,116 @@
+#include "sortScheduler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <glm/gtc/matrix_transform.hpp>
+#include "splatCulling.hpp"
+
+static glm::vec3 camera_position(const glm::mat4 &view)
+{
+    return glm::vec3(glm::inverse(view)[3]);
+}
+
+// Angle of the rotation between two views, in degrees
+static float rotation_between(const glm::mat4 &a, const glm::mat4 &b)
+{
+    glm::mat3 relative = glm::mat3(b) * glm::transpose(glm::mat3(a));
+    float trace = relative[0][0] + relative[1][1] + relative[2][2];
+    return glm::degrees(std::acos(glm::clamp((trace - 1.0f) * 0.5f, -1.0f, 1.0f)));
+}
+
+DepthKeyParams sort_scheduler_key_params(const SortSchedule &schedule, const glm::mat4 &view)
+{
+    DepthKeyParams params;
+    params.view = view;
+    params.distance = schedule.order == SORT_ORDER_DISTANCE;
+    params.camera_position = camera_position(view);
+    return params;
+}
+
+bool sort_scheduler_should_sort(SortScheduler *scheduler, const SortSchedule &schedule, const glm::mat4 &view)
+{
+    SortSchedulerStats &stats = scheduler->stats;
+    if (!scheduler->valid || scheduler->order != schedule.order) {
+        return true;
+    }
+    bool unchanged = view == scheduler->view;
+    stats.translation = glm::length(camera_position(view) - scheduler->position);
+    stats.rotation = unchanged ? 0.0f : rotation_between(scheduler->view, view);
+    stats.error = 0.0f;
+    if (unchanged) {
+        return false;
+    }
+    // Turning doesn't change distances, and the distance sort culls nothing that could come into view
+    bool limit_rotation = schedule.order != SORT_ORDER_DISTANCE;
+    if (stats.translation > schedule.max_translation || (limit_rotation && stats.rotation > schedule.max_rotation)) {
+        return true;
+    }
+
+    // Neighbouring samples that are no longer back to front
+    DepthKeyParams params = sort_scheduler_key_params(schedule, view);
+    const std::vector<glm::vec3> &samples = scheduler->samples;
+    size_t swapped = 0;
+    for (size_t i = 1; i < samples.size(); i++) {
+        swapped += depth_key_of(params, samples[i - 1]) > depth_key_of(params, samples[i]);
+    }
+    stats.error = samples.size() > 1 ? float(swapped) / float(samples.size() - 1) : 0.0f;
+    if (stats.error > schedule.max_error) {
+        return true;
+    }
+    stats.skips++;
+    return false;
+}
+
+void sort_scheduler_sorted(SortScheduler *scheduler, const SortSchedule &schedule, const glm::mat4 &view,
+                           const SplatSortPositions &positions, const uint32_t *order, size_t count)
+{
+    scheduler->valid = true;
+    scheduler->order = schedule.order;
+    scheduler->view = view;
+    scheduler->position = camera_position(view);
+    scheduler->stats.translation = scheduler->stats.rotation = scheduler->stats.error = 0.0f;
+    scheduler->stats.sorts++;
+
+    size_t sample_count = std::min<size_t>(count, SORT_SCHEDULER_SAMPLES);
+    scheduler->samples.resize(sample_count);
+    for (size_t i = 0; i < sample_count; i++) {
+        uint32_t splat = order[i * count / sample_count];
+        scheduler->samples[i] = glm::vec3(positions.x[splat], positions.y[splat], positions.z[splat]);
+    }
+}
+
+void sort_scheduler_reset(SortScheduler *scheduler)
+{
+    scheduler->valid = false;
+}
+
+bool sort_scheduler_cull_planes(const SortSchedule &schedule, float field_of_view, float aspect_ratio,
+                                float far_plane, const glm::mat4 &view, glm::vec4 planes[6])
+{
+    if (schedule.order == SORT_ORDER_DISTANCE) {
+        return false;
+    }
+    // Turning the camera by up to the margin keeps every direction in view within the margin of
+    // the frustum it was sorted for, so each side plane is turned outwards by it
+    float margin = glm::radians(schedule.max_rotation);
+    float half_y = field_of_view * 0.5f + margin;
+    float half_x = std::atan(aspect_ratio * std::tan(field_of_view * 0.5f)) + margin;
+    const float widest = glm::radians(85.0f);
+    if (half_x > widest || half_y > widest) {
+        return false;
+    }
+    float tan_x = std::tan(half_x), tan_y = std::tan(half_y);
+    glm::mat4 projection = glm::perspective(2.0f * half_y, tan_x / tan_y, 0.1f, far_plane);
+    splat_frustum_planes(projection * view, planes);
+
+    // Moving the camera moves the planes by as much
+    for (int i = 0; i < 6; i++) {
+        planes[i].w += schedule.max_translation;
+    }
+    // Splats behind the camera are outside a side plane already, and turning tilts the near plane
+    planes[4].w = std::numeric_limits<float>::infinity();
+    // The far plane tilts by the margin too, so far corners of the new view can be further away
+    planes[5].w += far_plane * std::sin(margin) * std::sqrt(tan_x * tan_x + tan_y * tan_y);
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "depthKeys.hpp"
+
+// Splats of each sorted order that are kept to check how out of order it is for a later view
+#define SORT_SCHEDULER_SAMPLES 1024
+
+typedef enum {
+    SORT_ORDER_VIEW_DEPTH = 0,
+    // Distance to the camera, which doesn't change when the camera only turns
+    SORT_ORDER_DISTANCE,
+} SortOrder;
+
+typedef struct {
+    SortOrder order = SORT_ORDER_VIEW_DEPTH;
+    // The order of the latest sort is reused until the camera has moved or turned this much since.
+    // Turning is not limited when sorting by distance.
+    float max_translation = 0.1f; // World units
+    float max_rotation = 2.0f;    // Degrees
+    // ... or until this fraction of neighbouring samples is out of order, compared by view depth or
+    // by distance to match the order. With all three limits at zero every camera change sorts.
+    float max_error = 0.002f;
+} SortSchedule;
+
+typedef struct {
+    // Of the camera since the latest sort, as of the latest check
+    float translation = 0.0f;
+    float rotation = 0.0f; // Degrees
+    float error = 0.0f;    // Fraction of the sampled neighbours that are out of order
+    size_t sorts = 0;
+    size_t skips = 0;      // Frames that reused the order after the camera changed
+} SortSchedulerStats;
+
+// Decides when the depth sort has to run again, instead of sorting on every camera change.
+//
+// How much a camera change disturbs the order depends on the sort order. The view-space depth of
+// all splats changes by the same amount when the camera moves without turning, so the order stays
+// the same, but turning the camera tilts the depth axis and reorders splats that are far apart
+// sideways. The distance to the camera is the other way around. Rather than modelling this, the
+// scheduler keeps an evenly spaced sample of the sorted splats and counts how many neighbouring
+// samples have swapped places for the current view.
+//
+// Translation and rotation are limited as well, since the depth keys are only computed for the
+// splats in the frustum, see sort_scheduler_cull_planes(). Sorting by distance doesn't cull, so
+// the camera can turn freely.
+typedef struct {
+    bool valid = false;
+    SortOrder order = SORT_ORDER_VIEW_DEPTH;
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::vec3 position = glm::vec3(0.0f);
+    std::vector<glm::vec3> samples; // Back to front
+    SortSchedulerStats stats;
+} SortScheduler;
+
+// Call before every potential sort. Counts a skip when it returns false and the camera changed.
+bool sort_scheduler_should_sort(SortScheduler *scheduler, const SortSchedule &schedule, const glm::mat4 &view);
+// Records the view and samples the visible part of the order, back to front
+void sort_scheduler_sorted(SortScheduler *scheduler, const SortSchedule &schedule, const glm::mat4 &view,
+                           const SplatSortPositions &positions, const uint32_t *order, size_t count);
+// Makes the next check sort, e.g. when the model or the projection changes
+void sort_scheduler_reset(SortScheduler *scheduler);
+
+// Parameters of the depth keys for a view in the order of the schedule
+DepthKeyParams sort_scheduler_key_params(const SortSchedule &schedule, const glm::mat4 &view);
+// Planes of the frustum widened by the rotation and translation the schedule allows, so culling
+// with them keeps every splat that can come into view before the next sort. Returns false if the
+// widened frustum is too wide to cull anything, and when sorting by distance, where turning is
+// not limited.
+bool sort_scheduler_cull_planes(const SortSchedule &schedule, float field_of_view, float aspect_ratio,
+                                float far_plane, const glm::mat4 &view, glm::vec4 planes[6]);
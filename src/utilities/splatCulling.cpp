@@ -0,0 +1,171 @@
+#include "splatCulling.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "profiler.hpp"
+
+// Largest workgroup count in one dimension every implementation supports. Bigger models are
+// dispatched as a 2D grid.
+#define MAX_DISPATCH_GROUPS 65535
+
+
+CullSplat splat_cull_data(glm::vec3 position, glm::vec3 scale, float opacity)
+{
+    // The vertex shader covers three standard deviations along each axis of the 2D covariance,
+    // so three times the largest scale bounds the splat in world space
+    return { position.x, position.y, position.z, 3.0f * std::max(scale.x, std::max(scale.y, scale.z)), opacity };
+}
+
+void splat_culler_create_shaders(SplatCuller *culler)
+{
+    culler->cull_shader = new Gloom::Shader();
+    culler->cull_shader->attach("../res/shaders/cull.comp");
+    culler->cull_shader->link();
+    culler->scan_shader = new Gloom::Shader();
+    culler->scan_shader->attach("../res/shaders/cull_scan.comp");
+    culler->scan_shader->link();
+    culler->scatter_shader = new Gloom::Shader();
+    culler->scatter_shader->attach("../res/shaders/cull_scatter.comp");
+    culler->scatter_shader->link();
+}
+
+static GLuint create_storage(size_t size, const void *data, GLenum usage)
+{
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    // GL doesn't like zero sized buffers when binding them
+    glBufferData(GL_SHADER_STORAGE_BUFFER, GLsizeiptr(std::max<size_t>(size, 4)), data, usage);
+    return buffer;
+}
+
+static void create_buffers(SplatCuller *culler, size_t count, const SplatLayout &layout,
+                           const CullSplat *cull_data, GLenum cull_data_usage)
+{
+    culler->count = count;
+    culler->group_count = (count + SPLAT_CULL_GROUP_SIZE - 1) / SPLAT_CULL_GROUP_SIZE;
+    culler->stream_count = layout.stream_count;
+    for (size_t s = 0; s < layout.stream_count; s++) {
+        culler->stream_words[s] = uint32_t(layout.streams[s].size / sizeof(uint32_t));
+    }
+
+    culler->cull_data = create_storage(count * sizeof(CullSplat), cull_data, cull_data_usage);
+    culler->local_offsets = create_storage(count * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+    culler->group_sums = create_storage(culler->group_count * sizeof(uint32_t), nullptr, GL_DYNAMIC_COPY);
+    culler->instances = create_storage(count * layout.stride, nullptr, GL_DYNAMIC_COPY);
+
+    // Only the instance counts are written by the GPU
+    uint32_t commands[12] = {};
+    commands[SPLAT_CULL_ELEMENTS_COMMAND_OFFSET / 4 + 0] = 6; // Indices per quad
+    commands[SPLAT_CULL_ARRAYS_COMMAND_OFFSET / 4 + 0] = 1;   // One point
+    culler->indirect = create_storage(sizeof(commands), commands, GL_DYNAMIC_COPY);
+}
+
+void splat_culler_init(SplatCuller *culler, const GaussianSplat &splat, const SplatLayout &layout)
+{
+    size_t count = splat.ws_positions.size();
+    std::vector<CullSplat> cull_data(count);
+    for (size_t i = 0; i < count; i++) {
+        cull_data[i] = splat_cull_data(splat.ws_positions[i], splat.scales[i], splat.opacities[i]);
+    }
+    create_buffers(culler, count, layout, cull_data.data(), GL_STATIC_DRAW);
+}
+
+void splat_culler_init_empty(SplatCuller *culler, size_t capacity, const SplatLayout &layout)
+{
+    create_buffers(culler, capacity, layout, nullptr, GL_DYNAMIC_DRAW);
+}
+
+void splat_culler_free(SplatCuller *culler)
+{
+    GLuint buffers[] = { culler->cull_data, culler->local_offsets, culler->group_sums,
+                         culler->indirect, culler->instances };
+    glDeleteBuffers(5, buffers);
+    culler->cull_data = culler->local_offsets = culler->group_sums = 0;
+    culler->indirect = culler->instances = 0;
+    culler->count = culler->group_count = 0;
+}
+
+// Gribb-Hartmann plane extraction
+void splat_frustum_planes(const glm::mat4 &m, glm::vec4 planes[6])
+{
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++) {
+        row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+    planes[0] = row[3] + row[0]; // Left
+    planes[1] = row[3] - row[0]; // Right
+    planes[2] = row[3] + row[1]; // Bottom
+    planes[3] = row[3] - row[1]; // Top
+    planes[4] = row[3] + row[2]; // Near
+    planes[5] = row[3] - row[2]; // Far
+    for (int i = 0; i < 6; i++) {
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+}
+
+void splat_culler_run(SplatCuller *culler, const SplatCullParams &params, GLuint records,
+                      GLuint order, size_t order_offset, size_t count)
+{
+    count = std::min(count, culler->count);
+    if (count == 0) {
+        // Nothing would overwrite the instance counts of the previous run
+        uint32_t zero = 0;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, culler->indirect);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, SPLAT_CULL_ELEMENTS_COMMAND_OFFSET + 4, 4, &zero);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, SPLAT_CULL_ARRAYS_COMMAND_OFFSET + 4, 4, &zero);
+        return;
+    }
+    PROFILE_ZONE("cull");
+
+    size_t group_count = (count + SPLAT_CULL_GROUP_SIZE - 1) / SPLAT_CULL_GROUP_SIZE;
+    GLuint groups_x = GLuint(std::min<size_t>(group_count, MAX_DISPATCH_GROUPS));
+    GLuint groups_y = GLuint((group_count + groups_x - 1) / groups_x);
+    bool use_order = order != 0;
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SPLAT_CULL_BINDING_CULL_DATA, culler->cull_data);
+    if (use_order) {
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, SPLAT_CULL_BINDING_ORDER, order,
+                          GLintptr(order_offset), GLsizeiptr(count * sizeof(uint32_t)));
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SPLAT_CULL_BINDING_LOCAL_OFFSETS, culler->local_offsets);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SPLAT_CULL_BINDING_GROUP_SUMS, culler->group_sums);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SPLAT_CULL_BINDING_COMMANDS, culler->indirect);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SPLAT_CULL_BINDING_RECORDS, records);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SPLAT_CULL_BINDING_INSTANCES, culler->instances);
+
+    // 1. Test and scan within workgroups
+    glm::vec4 planes[6];
+    splat_frustum_planes(params.view_projection, planes);
+    culler->cull_shader->activate();
+    glUniform1ui(0, GLuint(count));
+    glUniform1ui(1, GLuint(group_count));
+    glUniform1i(2, use_order);
+    glUniform1i(3, params.cull);
+    glUniform1f(4, params.scale_multiplier);
+    glUniform1f(5, params.focal_y);
+    glUniform1f(6, params.min_contribution);
+    glUniform3fv(7, 1, &params.camera_position.x);
+    glUniform3fv(8, 1, &params.camera_forward.x);
+    glUniform4fv(9, 6, &planes[0].x);
+    glDispatchCompute(groups_x, groups_y, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // 2. Scan the workgroup totals, a single workgroup loops over all of them
+    culler->scan_shader->activate();
+    glUniform1ui(0, GLuint(group_count));
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    // 3. Copy the survivors into place
+    culler->scatter_shader->activate();
+    glUniform1ui(0, GLuint(count));
+    glUniform1ui(1, GLuint(group_count));
+    glUniform1i(2, use_order);
+    glUniform1ui(3, GLuint(culler->stream_count));
+    glUniform1ui(4, GLuint(culler->count));
+    glUniform1uiv(5, GLsizei(culler->stream_count), culler->stream_words);
+    glDispatchCompute(groups_x, groups_y, 1);
+    glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include "plyParser.hpp"
+#include "shader.hpp"
+#include "splatLayout.hpp"
+
+// Shader storage bindings used by the culling compute shaders. Binding 0 is the chunk origins.
+#define SPLAT_CULL_BINDING_CULL_DATA     1
+#define SPLAT_CULL_BINDING_ORDER         2
+#define SPLAT_CULL_BINDING_LOCAL_OFFSETS 3
+#define SPLAT_CULL_BINDING_GROUP_SUMS    4
+#define SPLAT_CULL_BINDING_COMMANDS      5
+#define SPLAT_CULL_BINDING_RECORDS       6
+#define SPLAT_CULL_BINDING_INSTANCES     7
+
+// Must match local_size_x in cull.comp and cull_scatter.comp
+#define SPLAT_CULL_GROUP_SIZE 256
+
+// Byte offsets of the draw commands in SplatCuller::indirect
+#define SPLAT_CULL_ELEMENTS_COMMAND_OFFSET 0  // DrawElementsIndirectCommand for the quads
+#define SPLAT_CULL_ARRAYS_COMMAND_OFFSET   32 // DrawArraysIndirectCommand for the point cloud
+
+// Per-splat input of the culling, matches the std430 layout in cull.comp
+typedef struct {
+    float x, y, z;
+    float radius;
+    float opacity;
+} CullSplat;
+
+typedef struct {
+    glm::mat4 view_projection;
+    glm::vec3 camera_position;
+    glm::vec3 camera_forward;
+    float focal_y; // In pixels
+    float scale_multiplier;
+    // Splats whose total alpha over all covered pixels is below this are dropped
+    float min_contribution;
+    // Without culling every splat survives, but the passes still gather the records in order
+    bool cull;
+} SplatCullParams;
+
+// Frustum and contribution culling on the GPU. Three compute passes run over the splats in
+// drawing order (the depth sorted order, or load order):
+//   1. cull.comp tests every splat and scans the survivors within each workgroup
+//   2. cull_scan.comp scans the workgroup totals, and writes the instance count into the
+//      indirect draw commands
+//   3. cull_scatter.comp copies the records of the survivors into the instance buffer
+// The result is a compact instance buffer in back-to-front order, drawn with
+// glDrawElementsIndirect, so the CPU never needs to know how many splats survived. An atomic
+// append would be simpler, but would scramble the blending order.
+typedef struct splat_culler_t {
+    Gloom::Shader *cull_shader = nullptr;
+    Gloom::Shader *scan_shader = nullptr;
+    Gloom::Shader *scatter_shader = nullptr;
+
+    size_t count = 0;
+    size_t group_count = 0;
+    // Words per splat of every stream of the layout, see SplatStream
+    size_t stream_count = 0;
+    uint32_t stream_words[SPLAT_MAX_STREAMS] = {};
+    GLuint cull_data = 0;     // Position, radius and opacity per splat, in load order
+    GLuint local_offsets = 0; // Index among the survivors of the workgroup, or ~0 when culled
+    GLuint group_sums = 0;    // Survivors per workgroup, scanned in place into offsets
+    GLuint indirect = 0;
+    GLuint instances = 0;     // Surviving records in drawing order, read as vertex attributes
+} SplatCuller;
+
+// Bounding sphere of a splat for the culling
+CullSplat splat_cull_data(glm::vec3 position, glm::vec3 scale, float opacity);
+// Frustum planes of a view projection matrix, normalised so the distance is in world units
+void splat_frustum_planes(const glm::mat4 &view_projection, glm::vec4 planes[6]);
+
+void splat_culler_create_shaders(SplatCuller *culler);
+// Creates the buffers for a model. Any previous buffers must have been freed.
+void splat_culler_init(SplatCuller *culler, const GaussianSplat &splat, const SplatLayout &layout);
+// Creates the buffers for up to `capacity` splats, with the cull data left for the caller to fill
+void splat_culler_init_empty(SplatCuller *culler, size_t capacity, const SplatLayout &layout);
+void splat_culler_free(SplatCuller *culler);
+// Culls and compacts the first `count` splats in drawing order into culler->instances. `records`
+// holds the splat records in load order, and with separate attribute arrays must be sized for
+// culler->count splats like the instances. `order` holds the drawing order as one uint32 index per
+// splat starting at `order_offset`, or is 0 to draw in load order. The offset must respect
+// GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT.
+void splat_culler_run(SplatCuller *culler, const SplatCullParams &params, GLuint records,
+                      GLuint order, size_t order_offset, size_t count);
@@ -0,0 +1,277 @@
+#include "splatLayout.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <glm/gtc/packing.hpp>
+
+// Edge length of a position chunk, doubled until there are few enough chunks for a 16-bit index
+#define SPLAT_CHUNK_SIZE 2.0f
+#define SPLAT_MAX_CHUNKS 65536
+
+
+bool splat_format_equal(SplatFormat a, SplatFormat b)
+{
+    return a.position == b.position && a.color == b.color &&
+           a.scale == b.scale && a.rotation == b.rotation && a.separate == b.separate;
+}
+
+bool splat_format_from_name(const std::string &name, SplatFormat *format)
+{
+    if (name == "float32") {
+        *format = splat_format_float32;
+        return true;
+    }
+    if (name == "compact") {
+        *format = splat_format_compact;
+        return true;
+    }
+    if (name == "separate") {
+        *format = splat_format_separate;
+        return true;
+    }
+    return false;
+}
+
+std::string splat_format_describe(SplatFormat format)
+{
+    std::string s;
+    s += format.position == SPLAT_POSITION_FLOAT32 ? "pos f32" : "pos f16 chunked";
+    s += format.color == SPLAT_COLOR_FLOAT32 ? ", color f32" : ", color rgba8";
+    s += format.scale == SPLAT_PRECISION_FLOAT32 ? ", scale f32" : ", scale f16";
+    s += format.rotation == SPLAT_PRECISION_FLOAT32 ? ", rot f32" : ", rot f16";
+    if (format.separate) {
+        s += ", separate arrays";
+    }
+    return s;
+}
+
+SplatLayout splat_layout_make(SplatFormat format)
+{
+    SplatLayout layout = {};
+    layout.format = format;
+
+    // Every attribute starts on a 4-byte boundary. With separate arrays every placed range is a
+    // stream of its own.
+    size_t offset = 0;
+    auto place = [&offset, &layout](size_t size) {
+        size_t at = offset;
+        offset += (size + 3) & ~size_t(3);
+        if (layout.format.separate) {
+            layout.streams[layout.stream_count++] = { at, offset - at };
+        }
+        return at;
+    };
+
+    if (format.position == SPLAT_POSITION_FLOAT32) {
+        layout.position_offset = place(3 * sizeof(float));
+    } else {
+        // The chunk index fills the fourth half float slot
+        layout.position_offset = place(4 * sizeof(uint16_t));
+        layout.chunk_offset = layout.position_offset + 3 * sizeof(uint16_t);
+    }
+
+    if (format.color == SPLAT_COLOR_FLOAT32) {
+        layout.color_offset = place(3 * sizeof(float));
+        layout.alpha_offset = place(sizeof(float));
+    } else {
+        layout.color_offset = place(4);
+        layout.alpha_offset = layout.color_offset + 3;
+    }
+
+    layout.scale_offset = place(format.scale == SPLAT_PRECISION_FLOAT32 ? 3 * sizeof(float) : 3 * sizeof(uint16_t));
+    layout.rotation_offset = place(format.rotation == SPLAT_PRECISION_FLOAT32 ? 4 * sizeof(float) : 4 * sizeof(uint16_t));
+
+    if (format.separate) {
+        // Elements of an array are packed tightly, there is no record to align
+        layout.stride = offset;
+        return layout;
+    }
+    layout.stride = 8;
+    while (layout.stride < offset) {
+        layout.stride *= 2;
+    }
+    layout.stream_count = 1;
+    layout.streams[0] = { 0, layout.stride };
+    return layout;
+}
+
+static void pack_half(unsigned char *dst, const float *src, int n)
+{
+    uint16_t half[4];
+    for (int i = 0; i < n; i++) {
+        half[i] = glm::packHalf1x16(src[i]);
+    }
+    memcpy(dst, half, n * sizeof(uint16_t));
+}
+
+static void pack_floats(unsigned char *dst, const float *src, int n, SplatPrecision precision)
+{
+    if (precision == SPLAT_PRECISION_FLOAT32) {
+        memcpy(dst, src, n * sizeof(float));
+    } else {
+        pack_half(dst, src, n);
+    }
+}
+
+static unsigned char pack_unorm8(float value)
+{
+    return (unsigned char)std::lround(glm::clamp(value, 0.0f, 1.0f) * 255.0f);
+}
+
+// Assigns every splat to a cubic chunk. Returns the chunk index of every splat, and the center
+// of every chunk in `origins`.
+static std::vector<uint16_t> assign_chunks(const GaussianSplat &splat, std::vector<glm::vec4> &origins)
+{
+    size_t count = splat.ws_positions.size();
+    std::vector<uint16_t> chunk_of(count);
+
+    for (float chunk_size = SPLAT_CHUNK_SIZE; ; chunk_size *= 2.0f) {
+        std::unordered_map<uint64_t, uint16_t> chunks;
+        origins.clear();
+        bool too_many = false;
+
+        for (size_t i = 0; i < count && !too_many; i++) {
+            glm::vec3 cell = glm::floor(splat.ws_positions[i] / chunk_size);
+            // 21 bits per axis is plenty for any scene that fits in fp32
+            uint64_t key = (uint64_t(int64_t(cell.x) & 0x1fffff) << 42) |
+                           (uint64_t(int64_t(cell.y) & 0x1fffff) << 21) |
+                            uint64_t(int64_t(cell.z) & 0x1fffff);
+            auto it = chunks.find(key);
+            if (it == chunks.end()) {
+                if (origins.size() == SPLAT_MAX_CHUNKS) {
+                    too_many = true;
+                    break;
+                }
+                it = chunks.emplace(key, uint16_t(origins.size())).first;
+                origins.push_back(glm::vec4((cell + 0.5f) * chunk_size, 0.0f));
+            }
+            chunk_of[i] = it->second;
+        }
+
+        if (!too_many) {
+            return chunk_of;
+        }
+    }
+}
+
+void splat_layout_pack(const SplatLayout &layout, const GaussianSplat &splat,
+                       std::vector<unsigned char> &records, std::vector<glm::vec4> &chunk_origins)
+{
+    chunk_origins.clear();
+    std::vector<uint16_t> chunk_of;
+    if (layout.format.position == SPLAT_POSITION_FLOAT16_CHUNKED) {
+        chunk_of = assign_chunks(splat, chunk_origins);
+    }
+    splat_layout_pack_chunks(layout, splat, chunk_of, chunk_origins, records);
+}
+
+// Stream the attribute at `offset` of a record is stored in
+static size_t stream_of(const SplatLayout &layout, size_t offset)
+{
+    size_t s = 0;
+    while (s + 1 < layout.stream_count && offset >= layout.streams[s + 1].offset) {
+        s++;
+    }
+    return s;
+}
+
+void splat_layout_pack_chunks(const SplatLayout &layout, const GaussianSplat &splat,
+                              const std::vector<uint16_t> &chunk_of, const std::vector<glm::vec4> &chunk_origins,
+                              std::vector<unsigned char> &records)
+{
+    const SplatFormat &format = layout.format;
+    size_t count = splat.ws_positions.size();
+    // Zeroed, so padding is deterministic
+    records.assign(count * layout.stride, 0);
+
+    // Address of the attribute at `offset` of splat i
+    auto at = [&](size_t i, size_t offset) {
+        const SplatStream &stream = layout.streams[stream_of(layout, offset)];
+        return records.data() + stream.offset * count + i * stream.size + (offset - stream.offset);
+    };
+
+    for (size_t i = 0; i < count; i++) {
+        if (format.position == SPLAT_POSITION_FLOAT32) {
+            memcpy(at(i, layout.position_offset), &splat.ws_positions[i], 3 * sizeof(float));
+        } else {
+            glm::vec3 local = splat.ws_positions[i] - glm::vec3(chunk_origins[chunk_of[i]]);
+            pack_half(at(i, layout.position_offset), &local.x, 3);
+            memcpy(at(i, layout.chunk_offset), &chunk_of[i], sizeof(uint16_t));
+        }
+
+        if (format.color == SPLAT_COLOR_FLOAT32) {
+            memcpy(at(i, layout.color_offset), &splat.colors[i], 3 * sizeof(float));
+            memcpy(at(i, layout.alpha_offset), &splat.opacities[i], sizeof(float));
+        } else {
+            unsigned char *color = at(i, layout.color_offset);
+            color[0] = pack_unorm8(splat.colors[i].r);
+            color[1] = pack_unorm8(splat.colors[i].g);
+            color[2] = pack_unorm8(splat.colors[i].b);
+            *at(i, layout.alpha_offset) = pack_unorm8(splat.opacities[i]);
+        }
+
+        pack_floats(at(i, layout.scale_offset), &splat.scales[i].x, 3, format.scale);
+        pack_floats(at(i, layout.rotation_offset), &splat.rotations[i].x, 4, format.rotation);
+    }
+}
+
+// `offset` is within the record, and is made relative to the stream of the attribute
+static void setup_attribute(const SplatLayout &layout, GLuint location, GLint size, GLenum type,
+                            GLboolean normalized, size_t offset, GLuint binding)
+{
+    size_t stream = stream_of(layout, offset);
+    glEnableVertexAttribArray(location);
+    glVertexAttribFormat(location, size, type, normalized, GLuint(offset - layout.streams[stream].offset));
+    glVertexAttribBinding(location, binding + GLuint(stream));
+}
+
+static GLenum precision_type(SplatPrecision precision)
+{
+    return precision == SPLAT_PRECISION_FLOAT32 ? GL_FLOAT : GL_HALF_FLOAT;
+}
+
+void splat_layout_setup_attributes(const SplatLayout &layout, GLuint binding)
+{
+    const SplatFormat &format = layout.format;
+
+    if (format.position == SPLAT_POSITION_FLOAT32) {
+        setup_attribute(layout, SPLAT_ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, layout.position_offset, binding);
+        glDisableVertexAttribArray(SPLAT_ATTRIBUTE_CHUNK);
+    } else {
+        setup_attribute(layout, SPLAT_ATTRIBUTE_POSITION, 3, GL_HALF_FLOAT, GL_FALSE, layout.position_offset, binding);
+        // Stored with the position
+        size_t stream = stream_of(layout, layout.chunk_offset);
+        glEnableVertexAttribArray(SPLAT_ATTRIBUTE_CHUNK);
+        glVertexAttribIFormat(SPLAT_ATTRIBUTE_CHUNK, 1, GL_UNSIGNED_SHORT,
+                              GLuint(layout.chunk_offset - layout.streams[stream].offset));
+        glVertexAttribBinding(SPLAT_ATTRIBUTE_CHUNK, binding + GLuint(stream));
+    }
+
+    if (format.color == SPLAT_COLOR_FLOAT32) {
+        setup_attribute(layout, SPLAT_ATTRIBUTE_COLOR, 3, GL_FLOAT, GL_FALSE, layout.color_offset, binding);
+        setup_attribute(layout, SPLAT_ATTRIBUTE_ALPHA, 1, GL_FLOAT, GL_FALSE, layout.alpha_offset, binding);
+    } else {
+        setup_attribute(layout, SPLAT_ATTRIBUTE_COLOR, 3, GL_UNSIGNED_BYTE, GL_TRUE, layout.color_offset, binding);
+        setup_attribute(layout, SPLAT_ATTRIBUTE_ALPHA, 1, GL_UNSIGNED_BYTE, GL_TRUE, layout.alpha_offset, binding);
+    }
+
+    setup_attribute(layout, SPLAT_ATTRIBUTE_SCALE, 3, precision_type(format.scale), GL_FALSE,
+                    layout.scale_offset, binding);
+    setup_attribute(layout, SPLAT_ATTRIBUTE_ROTATION, 4, precision_type(format.rotation), GL_FALSE,
+                    layout.rotation_offset, binding);
+
+    // One record per instance
+    for (size_t s = 0; s < layout.stream_count; s++) {
+        glVertexBindingDivisor(binding + GLuint(s), 1);
+    }
+}
+
+void splat_layout_bind_buffer(const SplatLayout &layout, GLuint binding, GLuint buffer, size_t capacity)
+{
+    for (size_t s = 0; s < layout.stream_count; s++) {
+        const SplatStream &stream = layout.streams[s];
+        glBindVertexBuffer(binding + GLuint(s), buffer, GLintptr(stream.offset * capacity), GLsizei(stream.size));
+    }
+}
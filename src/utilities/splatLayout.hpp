@@ -0,0 +1,118 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "plyParser.hpp"
+
+// Vertex attribute locations of the per-splat attributes in gaussian.vert and point_cloud.vert
+#define SPLAT_ATTRIBUTE_POSITION 2
+#define SPLAT_ATTRIBUTE_COLOR    3
+#define SPLAT_ATTRIBUTE_SCALE    4
+#define SPLAT_ATTRIBUTE_ALPHA    5
+#define SPLAT_ATTRIBUTE_ROTATION 6
+#define SPLAT_ATTRIBUTE_CHUNK    7
+// Shader storage binding of the chunk origins used by SPLAT_POSITION_FLOAT16_CHUNKED
+#define SPLAT_CHUNK_ORIGINS_BINDING 0
+// Most vertex buffer bindings a layout uses, one per attribute array with separate arrays
+#define SPLAT_MAX_STREAMS 5
+
+// GPU side format of the splats. All attributes of a splat are interleaved in one record, so
+// the vertex shader fetches a single stream. Every attribute can be stored with less precision
+// to save VRAM and fetch bandwidth. The vertex fetch converts half floats and normalized
+// integers back to float, so only chunked positions need special handling in the shaders.
+//
+// With `separate` set, every attribute gets an array of its own instead, like the five vertex
+// buffers the renderer used before records were interleaved. It is kept to compare the vertex
+// fetch of both against each other.
+typedef enum {
+    SPLAT_POSITION_FLOAT32 = 0,
+    // Half floats relative to the center of a spatial chunk, plus a 16-bit chunk index. Chunks
+    // are small enough that the precision is around a millimeter for typical scenes.
+    SPLAT_POSITION_FLOAT16_CHUNKED,
+    SPLAT_POSITION_FORMAT_COUNT,
+} SplatPositionFormat;
+
+typedef enum {
+    SPLAT_COLOR_FLOAT32 = 0,
+    // Color and opacity as normalized bytes. Colors outside [0, 1] are clamped.
+    SPLAT_COLOR_RGBA8,
+    SPLAT_COLOR_FORMAT_COUNT,
+} SplatColorFormat;
+
+typedef enum {
+    SPLAT_PRECISION_FLOAT32 = 0,
+    SPLAT_PRECISION_FLOAT16,
+    SPLAT_PRECISION_COUNT,
+} SplatPrecision;
+
+typedef struct {
+    SplatPositionFormat position;
+    SplatColorFormat color; // Also decides the format of the opacity
+    SplatPrecision scale;
+    SplatPrecision rotation;
+    bool separate; // One array per attribute instead of one record per splat
+} SplatFormat;
+
+// Everything in fp32, 64 bytes per splat
+const SplatFormat splat_format_float32 = {
+    SPLAT_POSITION_FLOAT32, SPLAT_COLOR_FLOAT32, SPLAT_PRECISION_FLOAT32, SPLAT_PRECISION_FLOAT32, false
+};
+// Chunk relative fp16 positions, RGBA8 color and opacity, fp16 scale and rotation, 32 bytes per splat
+const SplatFormat splat_format_compact = {
+    SPLAT_POSITION_FLOAT16_CHUNKED, SPLAT_COLOR_RGBA8, SPLAT_PRECISION_FLOAT16, SPLAT_PRECISION_FLOAT16, false
+};
+// Everything in fp32, in separate position, color, opacity, scale and rotation arrays. 56 bytes
+// per splat.
+const SplatFormat splat_format_separate = {
+    SPLAT_POSITION_FLOAT32, SPLAT_COLOR_FLOAT32, SPLAT_PRECISION_FLOAT32, SPLAT_PRECISION_FLOAT32, true
+};
+
+// A range of the attributes that is stored together. With separate arrays, the array of a
+// stream starts at offset * count bytes into the buffer and has an element of size bytes per
+// splat. Interleaved layouts have a single stream covering the whole record.
+typedef struct {
+    size_t offset;
+    size_t size; // A multiple of 4
+} SplatStream;
+
+// Byte offsets of the attributes within a record
+typedef struct {
+    SplatFormat format;
+    size_t stride; // Bytes per splat, over all streams
+    size_t stream_count;
+    SplatStream streams[SPLAT_MAX_STREAMS];
+    size_t position_offset;
+    size_t chunk_offset;
+    size_t color_offset;
+    size_t alpha_offset;
+    size_t scale_offset;
+    size_t rotation_offset;
+} SplatLayout;
+
+bool splat_format_equal(SplatFormat a, SplatFormat b);
+// Preset names, "float32", "compact" and "separate". Returns false for unknown names.
+bool splat_format_from_name(const std::string &name, SplatFormat *format);
+// Short description like "pos f16 chunked, color rgba8, scale f16, rot f16"
+std::string splat_format_describe(SplatFormat format);
+
+// The stride of interleaved records is rounded up to 8, 16, 32 or 64 bytes, so a record never
+// straddles a cache line
+SplatLayout splat_layout_make(SplatFormat format);
+
+// Packs all splats into records, `records` is resized to splat.count records, or with separate
+// arrays to the same size split into the arrays. With chunked
+// positions `chunk_origins` gets the origin of every chunk, otherwise it is left empty.
+void splat_layout_pack(const SplatLayout &layout, const GaussianSplat &splat,
+                       std::vector<unsigned char> &records, std::vector<glm::vec4> &chunk_origins);
+// Same, with the chunks chosen by the caller. chunk_of is only used with chunked positions.
+void splat_layout_pack_chunks(const SplatLayout &layout, const GaussianSplat &splat,
+                              const std::vector<uint16_t> &chunk_of, const std::vector<glm::vec4> &chunk_origins,
+                              std::vector<unsigned char> &records);
+// Sets up the per-instance attributes of the bound VAO to read records from `binding`, and the
+// bindings after it for every further stream
+void splat_layout_setup_attributes(const SplatLayout &layout, GLuint binding);
+// Binds `buffer`, sized for `capacity` splats, to the bindings set up above
+void splat_layout_bind_buffer(const SplatLayout &layout, GLuint binding, GLuint buffer, size_t capacity);
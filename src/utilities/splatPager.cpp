@@ -0,0 +1,324 @@
+#include "splatPager.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include "profiler.hpp"
+
+#define NONE SIZE_MAX
+
+
+// Every GPU buffer that grows with the pool: the records, the culled instances, the cull data,
+// the culling offsets and the three slots of the order ring
+static size_t gpu_bytes_per_splat(const SplatLayout &layout)
+{
+    return 2 * layout.stride + sizeof(CullSplat) + sizeof(uint32_t) + STREAM_BUFFER_SLOTS * sizeof(uint32_t);
+}
+
+void splat_pager_init(SplatPager *pager, std::shared_ptr<PagedSplatFile> file, size_t pool_bytes)
+{
+    const SplatLayout &layout = file->layout;
+    size_t page_count = file->pages.size();
+    size_t per_splat = gpu_bytes_per_splat(layout);
+    size_t summary_bytes = page_count * per_splat;
+    size_t slot_bytes = PAGED_SPLAT_PAGE_CAPACITY * per_splat;
+
+    pager->file = file;
+    // At least one slot, even if that goes over a tiny budget
+    pager->slot_count = pool_bytes > summary_bytes ? (pool_bytes - summary_bytes) / slot_bytes : 0;
+    pager->slot_count = std::max<size_t>(1, std::min(pager->slot_count, page_count));
+    pager->capacity = pager->slot_count * PAGED_SPLAT_PAGE_CAPACITY + page_count;
+
+    pager->slot_page.assign(pager->slot_count, NONE);
+    pager->page_slot.assign(page_count, NONE);
+    pager->page_rank.assign(page_count, 0);
+    pager->page_visible.assign(page_count, false);
+    pager->page_failed.assign(page_count, false);
+    pager->positions.assign(pager->capacity, glm::vec3(0.0f));
+    size_t summaries = pager->slot_count * PAGED_SPLAT_PAGE_CAPACITY;
+    for (size_t p = 0; p < page_count; p++) {
+        const CullSplat &cull = file->summary_cull[p];
+        pager->positions[summaries + p] = glm::vec3(cull.x, cull.y, cull.z);
+    }
+
+    glGenBuffers(1, &pager->records);
+    glBindBuffer(GL_ARRAY_BUFFER, pager->records);
+    glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(pager->capacity * layout.stride), nullptr, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, GLintptr(summaries * layout.stride),
+                    GLsizeiptr(file->summary_records.size()), file->summary_records.data());
+
+    GLint alignment = 256;
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    size_t order_size = pager->capacity * sizeof(uint32_t);
+    stream_buffer_init(&pager->order, (order_size + alignment - 1) / alignment * alignment);
+    pager->order_count = 0;
+    pager->order_dirty = true;
+    pager->order_view = glm::mat4(0.0f);
+
+    pager->stats = SplatPagerStats();
+    pager->stats.pages = page_count;
+    pager->stats.slots = pager->slot_count;
+    pager->stats.pool_bytes = pager->capacity * per_splat;
+}
+
+static void reader_main(SplatPager *pager)
+{
+    std::ifstream file(pager->file->path, std::ios::binary);
+
+    while (true) {
+        SplatPageData data;
+        {
+            std::unique_lock<std::mutex> lock(pager->mutex);
+            pager->wake.wait(lock, [pager]() {
+                return pager->stopping || (!pager->requests.empty() && pager->ready.size() < SPLAT_PAGER_MAX_READY);
+            });
+            if (pager->stopping) {
+                return;
+            }
+            data.page = pager->requests.front();
+            pager->requests.pop_front();
+            pager->reading = data.page;
+        }
+
+        PROFILE_ZONE("read page");
+        bool ok = paged_splat_read_page(file, *pager->file, data.page, data.records, data.cull);
+
+        std::lock_guard<std::mutex> lock(pager->mutex);
+        pager->reading = NONE;
+        if (ok) {
+            pager->ready.push_back(std::move(data));
+        } else {
+            // Not requested again, the summary is drawn instead
+            pager->page_failed[data.page] = true;
+        }
+    }
+}
+
+void splat_pager_start(SplatPager *pager, GLuint cull_data)
+{
+    pager->cull_data = cull_data;
+    const std::vector<CullSplat> &summary_cull = pager->file->summary_cull;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cull_data);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, GLintptr(pager->slot_count * PAGED_SPLAT_PAGE_CAPACITY * sizeof(CullSplat)),
+                    GLsizeiptr(summary_cull.size() * sizeof(CullSplat)), summary_cull.data());
+
+    pager->stopping = false;
+    pager->reader = std::thread(reader_main, pager);
+}
+
+void splat_pager_free(SplatPager *pager)
+{
+    if (!pager->file) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(pager->mutex);
+        pager->stopping = true;
+        pager->requests.clear();
+        pager->ready.clear();
+    }
+    pager->wake.notify_all();
+    if (pager->reader.joinable()) {
+        pager->reader.join();
+    }
+
+    glDeleteBuffers(1, &pager->records);
+    stream_buffer_free(&pager->order);
+    sort_arena_free(&pager->order_arena);
+    pager->records = 0;
+    pager->cull_data = 0;
+    pager->file = nullptr;
+    pager->slot_count = pager->capacity = 0;
+    pager->slot_page.clear();
+    pager->page_slot.clear();
+    pager->page_rank.clear();
+    pager->page_visible.clear();
+    pager->page_failed.clear();
+    std::vector<glm::vec3>().swap(pager->positions);
+    pager->order_count = 0;
+    pager->stats = SplatPagerStats();
+}
+
+static bool box_in_frustum(const glm::vec4 planes[6], glm::vec3 lo, glm::vec3 hi)
+{
+    for (int i = 0; i < 6; i++) {
+        // The corner furthest along the plane normal
+        glm::vec3 corner(planes[i].x >= 0.0f ? hi.x : lo.x,
+                         planes[i].y >= 0.0f ? hi.y : lo.y,
+                         planes[i].z >= 0.0f ? hi.z : lo.z);
+        if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void upload_page(SplatPager *pager, size_t slot, const SplatPageData &data)
+{
+    PROFILE_ZONE("upload page");
+    size_t first = slot * PAGED_SPLAT_PAGE_CAPACITY;
+    size_t stride = pager->file->layout.stride;
+    glBindBuffer(GL_ARRAY_BUFFER, pager->records);
+    glBufferSubData(GL_ARRAY_BUFFER, GLintptr(first * stride), GLsizeiptr(data.records.size()), data.records.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, pager->cull_data);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, GLintptr(first * sizeof(CullSplat)),
+                    GLsizeiptr(data.cull.size() * sizeof(CullSplat)), data.cull.data());
+    for (size_t i = 0; i < data.cull.size(); i++) {
+        pager->positions[first + i] = glm::vec3(data.cull[i].x, data.cull[i].y, data.cull[i].z);
+    }
+
+    size_t old_page = pager->slot_page[slot];
+    if (old_page != NONE) {
+        pager->page_slot[old_page] = NONE;
+        pager->stats.evicted++;
+    }
+    pager->slot_page[slot] = data.page;
+    pager->page_slot[data.page] = slot;
+    pager->stats.loaded++;
+    pager->order_dirty = true;
+}
+
+// A free slot, or the slot of the least wanted resident page if that is wanted less than `page`
+static size_t find_slot(SplatPager *pager, size_t page)
+{
+    size_t victim = NONE;
+    for (size_t slot = 0; slot < pager->slot_count; slot++) {
+        size_t resident = pager->slot_page[slot];
+        if (resident == NONE) {
+            return slot;
+        }
+        if (pager->page_rank[resident] > pager->page_rank[page] &&
+            (victim == NONE || pager->page_rank[resident] > pager->page_rank[pager->slot_page[victim]])) {
+            victim = slot;
+        }
+    }
+    return victim;
+}
+
+void splat_pager_update(SplatPager *pager, const glm::mat4 &view_projection, glm::vec3 camera_position)
+{
+    PROFILE_ZONE("page splats");
+    const std::vector<PagedSplatPage> &pages = pager->file->pages;
+    size_t page_count = pages.size();
+
+    // Rank the pages, visible ones first and then by distance
+    glm::vec4 planes[6];
+    splat_frustum_planes(view_projection, planes);
+    std::vector<float> distance(page_count);
+    size_t visible = 0;
+    for (size_t p = 0; p < page_count; p++) {
+        glm::vec3 lo, hi;
+        memcpy(&lo.x, pages[p].bounds_min, sizeof(lo));
+        memcpy(&hi.x, pages[p].bounds_max, sizeof(hi));
+        pager->page_visible[p] = box_in_frustum(planes, lo, hi);
+        visible += pager->page_visible[p];
+        glm::vec3 outside = glm::max(glm::max(lo - camera_position, camera_position - hi), glm::vec3(0.0f));
+        distance[p] = glm::length(outside);
+    }
+    std::vector<size_t> ranked(page_count);
+    std::iota(ranked.begin(), ranked.end(), size_t(0));
+    std::sort(ranked.begin(), ranked.end(), [pager, &distance](size_t a, size_t b) {
+        if (pager->page_visible[a] != pager->page_visible[b]) {
+            return bool(pager->page_visible[a]);
+        }
+        return distance[a] < distance[b];
+    });
+    for (size_t rank = 0; rank < page_count; rank++) {
+        pager->page_rank[ranked[rank]] = rank;
+    }
+
+    // Take finished reads, and request the wanted pages that are missing
+    std::vector<SplatPageData> finished;
+    {
+        std::lock_guard<std::mutex> lock(pager->mutex);
+        while (!pager->ready.empty() && finished.size() < SPLAT_PAGER_UPLOADS_PER_FRAME) {
+            finished.push_back(std::move(pager->ready.front()));
+            pager->ready.pop_front();
+        }
+
+        pager->requests.clear();
+        for (size_t rank = 0; rank < pager->slot_count && rank < page_count; rank++) {
+            size_t p = ranked[rank];
+            bool queued = p == pager->reading || pager->page_failed[p] ||
+                          std::any_of(pager->ready.begin(), pager->ready.end(),
+                                      [p](const SplatPageData &data) { return data.page == p; }) ||
+                          std::any_of(finished.begin(), finished.end(),
+                                      [p](const SplatPageData &data) { return data.page == p; });
+            if (pager->page_slot[p] == NONE && !queued) {
+                pager->requests.push_back(p);
+            }
+        }
+        pager->stats.pending = pager->requests.size() + pager->ready.size() + (pager->reading != NONE);
+    }
+    pager->wake.notify_one();
+
+    for (const SplatPageData &data : finished) {
+        // The camera may have moved on while the page was read
+        if (pager->page_rank[data.page] >= pager->slot_count || pager->page_slot[data.page] != NONE) {
+            continue;
+        }
+        size_t slot = find_slot(pager, data.page);
+        if (slot != NONE) {
+            upload_page(pager, slot, data);
+        }
+    }
+
+    pager->stats.visible = visible;
+    pager->stats.resident = size_t(std::count_if(pager->slot_page.begin(), pager->slot_page.end(),
+                                                 [](size_t page) { return page != NONE; }));
+}
+
+bool splat_pager_build_order(SplatPager *pager, const glm::mat4 &view, bool depth_sort)
+{
+    bool view_changed = false;
+    for (int i = 0; i < 4 && !view_changed; i++) {
+        for (int j = 0; j < 4 && !view_changed; j++) {
+            view_changed = std::abs(view[i][j] - pager->order_view[i][j]) > 0.0001f;
+        }
+    }
+    if (!pager->order_dirty && !(depth_sort && view_changed)) {
+        return false;
+    }
+    PROFILE_ZONE("page order");
+    pager->order_dirty = false;
+    pager->order_view = view;
+
+    // Resident pages draw their splats, the others their summary
+    typedef std::pair<float, uint32_t> Depth;
+    sort_arena_reserve(&pager->order_arena, pager->capacity * (sizeof(uint32_t) + sizeof(Depth)));
+    sort_arena_reset(&pager->order_arena);
+    uint32_t *indices = sort_arena_alloc<uint32_t>(&pager->order_arena, pager->capacity);
+    size_t count = 0;
+    const std::vector<PagedSplatPage> &pages = pager->file->pages;
+    size_t summaries = pager->slot_count * PAGED_SPLAT_PAGE_CAPACITY;
+    for (size_t p = 0; p < pages.size(); p++) {
+        size_t slot = pager->page_slot[p];
+        if (slot == NONE) {
+            indices[count++] = uint32_t(summaries + p);
+            continue;
+        }
+        size_t first = slot * PAGED_SPLAT_PAGE_CAPACITY;
+        for (size_t i = 0; i < pages[p].count; i++) {
+            indices[count++] = uint32_t(first + i);
+        }
+    }
+
+    if (depth_sort) {
+        Depth *depths = sort_arena_alloc<Depth>(&pager->order_arena, count);
+        for (size_t i = 0; i < count; i++) {
+            glm::vec4 view_position = view * glm::vec4(pager->positions[indices[i]], 1.0f);
+            depths[i] = { -view_position.z, indices[i] };
+        }
+        std::sort(depths, depths + count, [](const Depth &a, const Depth &b) { return a.first > b.first; });
+        for (size_t i = 0; i < count; i++) {
+            indices[i] = depths[i].second;
+        }
+    }
+
+    unsigned char *dst = stream_buffer_begin_write(&pager->order);
+    memcpy(dst, indices, count * sizeof(uint32_t));
+    pager->order_offset = stream_buffer_end_write(&pager->order);
+    pager->order_count = count;
+    return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "pagedSplat.hpp"
+#include "splatCulling.hpp"
+#include "sortArena.hpp"
+#include "streamBuffer.hpp"
+
+// Default GPU memory budget of the page pool, --page-pool on the command line
+#define SPLAT_PAGER_DEFAULT_MEGABYTES 512
+// Pages read from disk but not uploaded yet. Bounds the CPU memory of the reading thread.
+#define SPLAT_PAGER_MAX_READY 4
+// Uploads per frame, so a burst of finished reads doesn't cause a hitch
+#define SPLAT_PAGER_UPLOADS_PER_FRAME 2
+
+typedef struct {
+    size_t page;
+    std::vector<unsigned char> records;
+    std::vector<CullSplat> cull;
+} SplatPageData;
+
+typedef struct {
+    size_t pages = 0;
+    size_t slots = 0;
+    size_t resident = 0;
+    size_t visible = 0;
+    size_t pending = 0; // Requested or being read
+    size_t pool_bytes = 0;
+    size_t loaded = 0;  // Pages uploaded since the model was opened
+    size_t evicted = 0;
+} SplatPagerStats;
+
+// Keeps the pages of a paged splat that matter most for the current view resident in a fixed
+// number of GPU slots. Every frame the pages are ranked, visible pages first and then by distance
+// to the camera, and the best ones that fit in the slots are wanted. Missing pages are read by a
+// background thread and uploaded a few per frame, evicting the least wanted resident page when no
+// slot is free. Pages that are not resident are drawn as their summary splat.
+//
+// `records` and the cull data are indexed the same way: PAGED_SPLAT_PAGE_CAPACITY splats per
+// slot, followed by the summaries of all pages. The drawing order written by
+// splat_pager_build_order() only references resident splats and summaries, so it is passed to
+// the culling as is.
+//
+//     splat_pager_init(&pager, paged, pool_bytes);
+//     splat_culler_init_empty(&culler, pager.capacity, pager.file->layout);
+//     splat_pager_start(&pager, culler.cull_data);
+//     ... every frame ...
+//     splat_pager_update(&pager, view_projection, camera_position);
+//     splat_pager_build_order(&pager, view, depth_sort);
+//     splat_culler_run(&culler, params, pager.records, pager.order.buffer, pager.order_offset, pager.order_count);
+//     ... draw ...
+//     stream_buffer_fence(&pager.order);
+typedef struct splat_pager_t {
+    std::shared_ptr<PagedSplatFile> file;
+    size_t slot_count = 0;
+    size_t capacity = 0; // Splats in the pool, including the summaries
+    GLuint records = 0;
+    GLuint cull_data = 0; // Owned by the culler
+
+    std::vector<size_t> slot_page; // SIZE_MAX when free
+    std::vector<size_t> page_slot; // SIZE_MAX when not resident
+    std::vector<size_t> page_rank; // From the latest update, lower is wanted more
+    std::vector<bool> page_visible;
+    // Centers of the splats in the pool, for depth sorting
+    std::vector<glm::vec3> positions;
+
+    StreamBuffer order;
+    size_t order_offset = 0;
+    size_t order_count = 0;
+    bool order_dirty = true;
+    glm::mat4 order_view = glm::mat4(0.0f);
+    // Indices and sort keys of the order, sized for the whole pool
+    SortArena order_arena;
+
+    // Reading thread, the mutex guards everything below
+    std::thread reader;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<size_t> requests; // Most wanted first, replaced every update
+    size_t reading = SIZE_MAX;
+    std::deque<SplatPageData> ready;
+    std::vector<bool> page_failed;
+    bool stopping = false;
+
+    SplatPagerStats stats;
+} SplatPager;
+
+// Sizes the pool so all GPU buffers used for the pool, including those of the culling, fit in
+// pool_bytes. Creates `records` with the summaries uploaded.
+void splat_pager_init(SplatPager *pager, std::shared_ptr<PagedSplatFile> file, size_t pool_bytes);
+// Uploads the summary cull data and starts reading pages. cull_data must hold `capacity` splats.
+void splat_pager_start(SplatPager *pager, GLuint cull_data);
+// Stops the reading thread and deletes the buffers
+void splat_pager_free(SplatPager *pager);
+// Ranks the pages, requests missing ones and uploads finished reads
+void splat_pager_update(SplatPager *pager, const glm::mat4 &view_projection, glm::vec3 camera_position);
+// Rewrites the drawing order if the view or the resident pages changed. Returns true if it did.
+// Without depth sorting the pages are drawn in file order.
+bool splat_pager_build_order(SplatPager *pager, const glm::mat4 &view, bool depth_sort);
@@ -0,0 +1,293 @@
+#include "splatPrune.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <utility>
+#include <vector>
+#include "profiler.hpp"
+
+// Merged splats must have every axis within this fraction of each other...
+#define MERGE_SCALE_TOLERANCE 0.1f
+// ...and nearly the same orientation, |dot| of the quaternions
+#define MERGE_MIN_ROTATION_DOT 0.98f
+// Comparisons per splat and grid cell, so a pile of splats in one cell can't go quadratic
+#define MERGE_MAX_CANDIDATES 64
+
+static const char *prune_reason_names[SPLAT_PRUNE_REASON_COUNT] = {
+    "kept", "invalid", "transparent", "too small", "too large", "low contribution", "merged",
+};
+
+bool splat_prune_options_parse(const std::string &spec, SplatPruneOptions *options, std::string *error)
+{
+    std::stringstream items(spec);
+    std::string item;
+    while (std::getline(items, item, ',')) {
+        if (item.empty()) {
+            continue;
+        }
+        size_t equals = item.find('=');
+        std::string key = item.substr(0, equals);
+        float value = 0.0f;
+        try {
+            if (equals == std::string::npos) {
+                throw std::invalid_argument(key);
+            }
+            value = std::stof(item.substr(equals + 1));
+        } catch (const std::exception &) {
+            *error = "Error: Expected key=value in the prune options, got " + item;
+            return false;
+        }
+
+        if (key == "opacity") {
+            options->min_opacity = value;
+        } else if (key == "min-scale") {
+            options->min_scale = value;
+        } else if (key == "max-scale") {
+            options->max_scale = value;
+        } else if (key == "contribution") {
+            options->min_contribution = value;
+        } else if (key == "merge") {
+            options->merge_distance = value;
+        } else {
+            *error = "Error: Unknown prune option " + key + ", expected opacity, min-scale, max-scale, contribution or merge";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool splat_prune_is_enabled(const SplatPruneOptions &options)
+{
+    return options.min_opacity > 0.0f || options.min_scale > 0.0f || std::isfinite(options.max_scale) ||
+           options.min_contribution > 0.0f || options.merge_distance > 0.0f;
+}
+
+static bool is_finite(glm::vec3 v)
+{
+    return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+}
+
+SplatPruneReason splat_prune_test(const SplatPruneOptions &options, const GaussianSplat &splat, size_t i)
+{
+    glm::vec3 scale = splat.scales[i];
+    glm::vec4 rotation = splat.rotations[i];
+    float opacity = splat.opacities[i];
+    if (!is_finite(splat.ws_positions[i]) || !is_finite(scale) || !is_finite(splat.colors[i]) ||
+        !std::isfinite(opacity) || !std::isfinite(glm::dot(rotation, rotation)) || glm::dot(rotation, rotation) == 0.0f) {
+        return SPLAT_PRUNE_INVALID;
+    }
+
+    // Axes from largest to smallest
+    float axes[3] = { scale.x, scale.y, scale.z };
+    std::sort(axes, axes + 3, [](float a, float b) { return a > b; });
+    if (axes[0] <= 0.0f) {
+        return SPLAT_PRUNE_INVALID;
+    }
+    if (opacity < options.min_opacity) {
+        return SPLAT_PRUNE_TRANSPARENT;
+    }
+    if (axes[0] < options.min_scale) {
+        return SPLAT_PRUNE_TOO_SMALL;
+    }
+    if (axes[0] > options.max_scale) {
+        return SPLAT_PRUNE_TOO_LARGE;
+    }
+    if (opacity * axes[0] * axes[1] < options.min_contribution) {
+        return SPLAT_PRUNE_LOW_CONTRIBUTION;
+    }
+    return SPLAT_PRUNE_KEEP;
+}
+
+// Drops the elements whose keep flag is 0, keeping the order of the rest
+template <typename T>
+static void compact(std::vector<T> &values, const std::vector<uint8_t> &keep)
+{
+    if (values.size() != keep.size()) {
+        return;
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < values.size(); i++) {
+        if (keep[i]) {
+            values[kept++] = values[i];
+        }
+    }
+    values.resize(kept);
+}
+
+static void compact_splat(GaussianSplat &splat, const std::vector<uint8_t> &keep)
+{
+    compact(splat.ws_positions, keep);
+    compact(splat.normals, keep);
+    compact(splat.colors, keep);
+    compact(splat.shs, keep);
+    compact(splat.sh_indices, keep);
+    compact(splat.opacities, keep);
+    compact(splat.scales, keep);
+    compact(splat.rotations, keep);
+    splat.count = splat.ws_positions.size();
+}
+
+static bool coincident(const GaussianSplat &splat, size_t a, size_t b, float distance)
+{
+    glm::vec3 d = splat.ws_positions[a] - splat.ws_positions[b];
+    if (glm::dot(d, d) > distance * distance) {
+        return false;
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        if (std::fabs(splat.scales[a][axis] - splat.scales[b][axis]) > MERGE_SCALE_TOLERANCE * splat.scales[a][axis]) {
+            return false;
+        }
+    }
+    return std::fabs(glm::dot(splat.rotations[a], splat.rotations[b])) >= MERGE_MIN_ROTATION_DOT;
+}
+
+// Folds b into a. The result is as opaque as the two drawn on top of each other, with the
+// other attributes weighted by opacity.
+static void merge_into(GaussianSplat &splat, size_t a, size_t b)
+{
+    float wa = splat.opacities[a];
+    float wb = splat.opacities[b];
+    float w = std::max(wa + wb, 1e-12f);
+    splat.ws_positions[a] = (splat.ws_positions[a] * wa + splat.ws_positions[b] * wb) / w;
+    splat.colors[a] = (splat.colors[a] * wa + splat.colors[b] * wb) / w;
+    splat.scales[a] = (splat.scales[a] * wa + splat.scales[b] * wb) / w;
+    if (!splat.shs.empty()) {
+        for (int j = 0; j < SPHERICAL_HARMONICS_COEFFS_COUNT; j++) {
+            splat.shs[a].coeffs[j] = (splat.shs[a].coeffs[j] * wa + splat.shs[b].coeffs[j] * wb) / w;
+        }
+    }
+    splat.opacities[a] = 1.0f - (1.0f - wa) * (1.0f - wb);
+}
+
+// Key of a grid cell, 21 bits per axis. Far apart cells that wrap to the same key are told apart
+// by the distance test.
+static uint64_t cell_key(int64_t x, int64_t y, int64_t z)
+{
+    return (uint64_t(x) & 0x1fffff) | (uint64_t(y) & 0x1fffff) << 21 | (uint64_t(z) & 0x1fffff) << 42;
+}
+
+void gaussian_splat_merge_coincident(GaussianSplat &splat, float distance, SplatPruneStats *stats)
+{
+    PROFILE_ZONE("merge coincident splats");
+    size_t count = splat.ws_positions.size();
+    // The cells are as large as the merge distance, so a splat can only merge with splats in its
+    // own cell and the 26 around it
+    std::vector<std::pair<uint64_t, uint32_t>> cells(count);
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 cell = glm::floor(splat.ws_positions[i] / distance);
+        cells[i] = { cell_key(int64_t(cell.x), int64_t(cell.y), int64_t(cell.z)), uint32_t(i) };
+    }
+    std::sort(cells.begin(), cells.end());
+
+    std::vector<uint8_t> keep(count, 1);
+    size_t merged = 0;
+    auto try_merge = [&](uint32_t a, size_t from, size_t to) {
+        for (size_t j = from; j < std::min(to, from + MERGE_MAX_CANDIDATES); j++) {
+            uint32_t b = cells[j].second;
+            if (keep[b] && coincident(splat, a, b, distance)) {
+                merge_into(splat, a, b);
+                keep[b] = 0;
+                merged++;
+            }
+        }
+    };
+    for (size_t begin = 0; begin < count;) {
+        size_t end = begin + 1;
+        while (end < count && cells[end].first == cells[begin].first) {
+            end++;
+        }
+
+        // Neighbouring cells with a larger key, the others already looked at this one. The cell
+        // comes from the key, positions change as splats are merged.
+        uint64_t key = cells[begin].first;
+        int64_t x = int64_t(key & 0x1fffff), y = int64_t(key >> 21 & 0x1fffff), z = int64_t(key >> 42);
+        std::pair<size_t, size_t> neighbours[26];
+        size_t neighbour_count = 0;
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    uint64_t neighbour = cell_key(x + dx, y + dy, z + dz);
+                    if (neighbour <= key) {
+                        continue;
+                    }
+                    auto first = std::lower_bound(cells.begin() + end, cells.end(), std::make_pair(neighbour, uint32_t(0)));
+                    size_t from = size_t(first - cells.begin());
+                    size_t to = from;
+                    while (to < count && cells[to].first == neighbour) {
+                        to++;
+                    }
+                    if (to > from) {
+                        neighbours[neighbour_count++] = { from, to };
+                    }
+                }
+            }
+        }
+
+        for (size_t i = begin; i < end; i++) {
+            uint32_t a = cells[i].second;
+            if (!keep[a]) {
+                continue;
+            }
+            try_merge(a, i + 1, end);
+            for (size_t n = 0; n < neighbour_count; n++) {
+                try_merge(a, neighbours[n].first, neighbours[n].second);
+            }
+        }
+        begin = end;
+    }
+
+    if (merged > 0) {
+        compact_splat(splat, keep);
+    }
+    stats->removed[SPLAT_PRUNE_MERGED] += merged;
+}
+
+void gaussian_splat_prune(GaussianSplat &splat, const SplatPruneOptions &options, SplatPruneStats *stats)
+{
+    PROFILE_ZONE("prune splats");
+    size_t count = splat.ws_positions.size();
+    stats->input += count;
+
+    std::vector<uint8_t> keep(count);
+    size_t removed = 0;
+    for (size_t i = 0; i < count; i++) {
+        SplatPruneReason reason = splat_prune_test(options, splat, i);
+        keep[i] = reason == SPLAT_PRUNE_KEEP;
+        if (reason != SPLAT_PRUNE_KEEP) {
+            stats->removed[reason]++;
+            removed++;
+        }
+    }
+    if (removed > 0) {
+        compact_splat(splat, keep);
+    }
+
+    if (options.merge_distance > 0.0f) {
+        gaussian_splat_merge_coincident(splat, options.merge_distance, stats);
+    }
+}
+
+size_t splat_prune_removed(const SplatPruneStats &stats)
+{
+    size_t removed = 0;
+    for (int reason = SPLAT_PRUNE_KEEP + 1; reason < SPLAT_PRUNE_REASON_COUNT; reason++) {
+        removed += stats.removed[reason];
+    }
+    return removed;
+}
+
+std::string splat_prune_describe(const SplatPruneStats &stats)
+{
+    std::stringstream ss;
+    ss << "Pruned " << splat_prune_removed(stats) << " of " << stats.input << " splats";
+    const char *separator = ": ";
+    for (int reason = SPLAT_PRUNE_KEEP + 1; reason < SPLAT_PRUNE_REASON_COUNT; reason++) {
+        if (stats.removed[reason] > 0) {
+            ss << separator << stats.removed[reason] << " " << prune_reason_names[reason];
+            separator = ", ";
+        }
+    }
+    return ss.str();
+}
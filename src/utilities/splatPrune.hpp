@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <string>
+#include "plyParser.hpp"
+
+// Trained scenes contain many splats that add nothing to the image: nearly transparent ones,
+// degenerate ones, and copies of each other. Pruning removes them when a model is loaded
+// (--prune) or converted (splat-convert --prune), so everything downstream has less to do.
+//
+// The defaults disable every test, see splat_prune_is_enabled().
+typedef struct {
+    // Post-sigmoid opacity
+    float min_opacity = 0.0f;
+    // Of the largest axis, in world units. Catches degenerate specks and huge floaters.
+    float min_scale = 0.0f;
+    float max_scale = std::numeric_limits<float>::infinity();
+    // Opacity times the product of the two largest axes, roughly the alpha of the largest cross
+    // section, in world units squared
+    float min_contribution = 0.0f;
+    // Splats in the same cell of a grid this size, closer than this and with nearly the same
+    // shape, are merged into one. 0 disables merging.
+    float merge_distance = 0.0f;
+} SplatPruneOptions;
+
+typedef enum {
+    SPLAT_PRUNE_KEEP = 0,
+    SPLAT_PRUNE_INVALID, // NaN or infinite attributes, no extent or a zero rotation
+    SPLAT_PRUNE_TRANSPARENT,
+    SPLAT_PRUNE_TOO_SMALL,
+    SPLAT_PRUNE_TOO_LARGE,
+    SPLAT_PRUNE_LOW_CONTRIBUTION,
+    SPLAT_PRUNE_MERGED,
+    SPLAT_PRUNE_REASON_COUNT,
+} SplatPruneReason;
+
+typedef struct {
+    size_t input = 0;
+    size_t removed[SPLAT_PRUNE_REASON_COUNT] = {}; // By reason, SPLAT_PRUNE_KEEP is unused
+} SplatPruneStats;
+
+// Parses a comma separated list like "opacity=0.005,min-scale=1e-4,max-scale=20,contribution=1e-7,merge=0.001".
+// Keys that are left out keep their current value.
+bool splat_prune_options_parse(const std::string &spec, SplatPruneOptions *options, std::string *error);
+bool splat_prune_is_enabled(const SplatPruneOptions &options);
+
+// Tests a single splat against the thresholds. Merging needs all splats, see gaussian_splat_prune().
+SplatPruneReason splat_prune_test(const SplatPruneOptions &options, const GaussianSplat &splat, size_t i);
+// Removes the splats that fail the tests and merges coincident ones, keeping the order of the
+// rest. Coincident splats are found with a spatial hash on a grid of merge_distance. Adds to stats.
+void gaussian_splat_prune(GaussianSplat &splat, const SplatPruneOptions &options, SplatPruneStats *stats);
+// Only the merging step of gaussian_splat_prune(), for splats that were already tested one by one
+void gaussian_splat_merge_coincident(GaussianSplat &splat, float distance, SplatPruneStats *stats);
+
+size_t splat_prune_removed(const SplatPruneStats &stats);
+// Like "Pruned 1200 of 50000 splats: 2 invalid, 1000 transparent, 198 merged"
+std::string splat_prune_describe(const SplatPruneStats &stats);
@@ -0,0 +1,102 @@
+#include "streamBuffer.hpp"
+#include "profiler.hpp"
+
+
+void stream_buffer_init(StreamBuffer *stream, size_t slot_size)
+{
+    *stream = StreamBuffer();
+    stream->slot_size = slot_size;
+    // Start on the last slot, so the first write goes to slot 0
+    stream->current = STREAM_BUFFER_SLOTS - 1;
+
+    GLsizeiptr total_size = GLsizeiptr(slot_size * STREAM_BUFFER_SLOTS);
+    glGenBuffers(1, &stream->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+
+    if (GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, total_size, nullptr, flags);
+        stream->mapped = static_cast<unsigned char *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, total_size, flags));
+        if (!stream->mapped) {
+            // Immutable storage can't be respecified, start over with a new buffer
+            glDeleteBuffers(1, &stream->buffer);
+            glGenBuffers(1, &stream->buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+        }
+    }
+
+    if (!stream->mapped) {
+        glBufferData(GL_ARRAY_BUFFER, total_size, nullptr, GL_STREAM_DRAW);
+        stream->staging.resize(slot_size);
+    }
+}
+
+void stream_buffer_free(StreamBuffer *stream)
+{
+    if (stream->buffer == 0) {
+        return;
+    }
+
+    for (GLsync &fence : stream->fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+    if (stream->mapped) {
+        glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    glDeleteBuffers(1, &stream->buffer);
+    *stream = StreamBuffer();
+}
+
+unsigned char *stream_buffer_begin_write(StreamBuffer *stream)
+{
+    stream->writing = (stream->current + 1) % STREAM_BUFFER_SLOTS;
+
+    if (!stream->mapped) {
+        return stream->staging.data();
+    }
+
+    GLsync &fence = stream->fences[stream->writing];
+    if (fence) {
+        PROFILE_ZONE("wait for stream slot");
+        // Flush on the first wait, otherwise the fence might never be submitted to the GPU
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        const GLuint64 timeout_ns = 1000000000;
+        while (glClientWaitSync(fence, flags, timeout_ns) == GL_TIMEOUT_EXPIRED) {
+            flags = 0;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    return stream->mapped + stream->writing * stream->slot_size;
+}
+
+size_t stream_buffer_end_write(StreamBuffer *stream)
+{
+    size_t offset = stream->writing * stream->slot_size;
+
+    if (!stream->mapped) {
+        // Writing to a different slot than the GPU is reading avoids an implicit sync
+        glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+        glBufferSubData(GL_ARRAY_BUFFER, GLintptr(offset), GLsizeiptr(stream->slot_size), stream->staging.data());
+    }
+
+    stream->current = stream->writing;
+    return offset;
+}
+
+void stream_buffer_fence(StreamBuffer *stream)
+{
+    if (!stream->mapped) {
+        return;
+    }
+
+    GLsync &fence = stream->fences[stream->current];
+    if (fence) {
+        glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
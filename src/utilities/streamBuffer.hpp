@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+// Number of slots in the ring. The CPU can write one slot while the GPU still reads the two
+// previous ones.
+#define STREAM_BUFFER_SLOTS 3
+
+// Ring of STREAM_BUFFER_SLOTS equally sized slots in one GL buffer, for data that is rewritten
+// every frame. With OpenGL 4.4 / ARB_buffer_storage the buffer is persistently and coherently
+// mapped, so the CPU writes straight into GPU visible memory without any glBufferData
+// reallocation or staging copy. Each slot is guarded by a fence, so a slot is only rewritten once
+// the GPU is done reading it.
+//
+// Without buffer storage, writes go to a CPU side staging copy which is uploaded to the slot with
+// glBufferSubData in stream_buffer_end_write().
+//
+//     unsigned char *dst = stream_buffer_begin_write(&ring);
+//     ... fill slot_size bytes of dst ...
+//     size_t offset = stream_buffer_end_write(&ring);
+//     ... point vertex attributes at offset and draw ...
+//     stream_buffer_fence(&ring);
+typedef struct stream_buffer_t {
+    GLuint buffer = 0;
+    size_t slot_size = 0;
+    // Start of the persistent mapping, null when using the fallback path
+    unsigned char *mapped = nullptr;
+    std::vector<unsigned char> staging;
+    GLsync fences[STREAM_BUFFER_SLOTS] = {};
+    // Slot of the most recent write, and of the write in progress
+    size_t current = 0;
+    size_t writing = 0;
+} StreamBuffer;
+
+// Creates the GL buffer. Any previous buffer must have been freed.
+void stream_buffer_init(StreamBuffer *stream, size_t slot_size);
+void stream_buffer_free(StreamBuffer *stream);
+// Waits until the GPU is done with the next slot, and returns where to write slot_size bytes
+unsigned char *stream_buffer_begin_write(StreamBuffer *stream);
+// Publishes the written slot. Returns its byte offset in stream->buffer.
+size_t stream_buffer_end_write(StreamBuffer *stream);
+// Must be called after the draw calls reading the current slot have been issued
+void stream_buffer_fence(StreamBuffer *stream);
@@ -1,3 +1,11 @@
 #pragma once
 
-double getTimeDeltaSeconds();
\ No newline at end of file
+#include <chrono>
+
+double getTimeDeltaSeconds();
+
+// Milliseconds since start, for timing the stages of a frame or a load
+inline double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
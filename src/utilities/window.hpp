@@ -6,6 +6,9 @@
 // Standard headers
 #include <string>
 
+// Local headers
+#include "modelLoadOptions.hpp"
+
 // Constants
 const int windowWidthDefault      = 1920 / 1.5;
 const int windowHeightDefault     = 1080 / 1.5;
@@ -16,4 +19,35 @@ const int         windowSamples   = 4;
 struct CommandLineOptions {
     bool enableMusic;
     bool enableAutoplay;
+
+    // Headless (offscreen) rendering, see run_headless()
+    bool headless = false;
+    std::string modelPath;
+    // Text file with one camera per line: "x y z yaw pitch"
+    std::string cameraFile;
+    std::string outputDirectory = ".";
+    int width = windowWidthDefault;
+    int height = windowHeightDefault;
+    // GPU format preset of the splats, see splatLayout.hpp
+    std::string splatLayout = "float32";
+
+    // Benchmark mode, see run_benchmark(). Uses modelPath, width and height from above, and
+    // cameraFile as the camera path if set.
+    bool benchmark = false;
+    int benchmarkFrames = 600;
+    std::string benchmarkOutput = "benchmark.json";
+    // Also count splats, quad area and fragments of every frame, see frameStats.hpp
+    bool frameStats = false;
+
+    // Budget of the decoded model cache, see modelCache.hpp
+    int modelCacheMegabytes = 2048;
+    // GPU budget of the page pool for paged (.psplat) models, see splatPager.hpp
+    int pagePoolMegabytes = 512;
+    // If set, modelPath is converted to a paged model written here, in the splatLayout format
+    std::string writePagedFile;
+    // Applied to every model when it is loaded, see splatPrune.hpp and shCodebook.hpp
+    ModelLoadOptions loadOptions;
+
+    // If set, profiling zones are recorded from startup and written here as a Chrome trace on exit
+    std::string traceFile;
 };
@@ -0,0 +1,755 @@
+// splat-convert: offline conversion between .ply, .splat, the paged .psplat runtime format and
+// the compressed .csplat format.
+//
+//     splat-convert -i scene.ply -o scene.psplat -l compact
+//
+// The input is streamed a block at a time, so files larger than RAM can be converted. Output in
+// Morton order (always for .psplat and .csplat) is produced with an external merge sort: runs that fit in
+// the --memory budget are sorted and spilled to temporary files next to the output, and merged
+// while writing. Decoding, sorting and encoding are spread over --threads threads.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arrrgh.hpp>
+#include <glm/glm.hpp>
+#include "utilities/compressedSplat.hpp"
+#include "utilities/pagedSplat.hpp"
+#include "utilities/parallel.hpp"
+#include "utilities/plyParser.hpp"
+#include "utilities/splatLayout.hpp"
+#include "utilities/splatPrune.hpp"
+
+// Vertices read and decoded at a time
+#define CONVERT_BLOCK_SPLATS (1 << 18)
+// Rows buffered per run while merging
+#define CONVERT_MERGE_BUFFER_SPLATS 4096
+// Default memory budget of the sort runs, --memory on the command line
+#define CONVERT_DEFAULT_MEGABYTES 2048
+
+// Inverse of the zero degree spherical harmonics in plyParser.cpp
+static const float SH_C0 = 0.28209479177387814f;
+
+typedef enum {
+    OUTPUT_PLY,
+    OUTPUT_SPLAT,
+    OUTPUT_PAGED,
+    OUTPUT_COMPRESSED,
+} OutputKind;
+
+typedef struct {
+    std::string input_path;
+    std::string output_path;
+    OutputKind output_kind;
+    SplatFormat format;  // Of .psplat output
+    bool morton;
+    SplatPruneOptions prune;
+    int threads;
+    size_t memory_bytes; // For the sort runs
+} ConvertOptions;
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void print_pass(const char *name, size_t bytes, double seconds)
+{
+    printf("  %-8s %10.1f MB in %7.2f s, %8.1f MB/s\n", name, double(bytes) / 1e6, seconds,
+           double(bytes) / 1e6 / std::max(seconds, 1e-9));
+}
+
+// Streams the input through fn(block), decoding every block on all threads. The next block is
+// read while the current one is decoded and processed.
+static bool for_each_block(const ConvertOptions &options, std::function<bool(GaussianSplat &)> fn)
+{
+    SplatFileReader reader;
+    if (!splat_file_reader_open(&reader, options.input_path)) {
+        for (const std::string &message : reader.warning_and_error_messages) {
+            std::cerr << message << std::endl;
+        }
+        return false;
+    }
+
+    std::vector<unsigned char> raw;
+    std::vector<unsigned char> next_raw;
+    size_t n = splat_file_reader_read(&reader, CONVERT_BLOCK_SPLATS, raw);
+    GaussianSplat block;
+    while (n > 0) {
+        std::future<size_t> next = std::async(std::launch::async, [&reader, &next_raw]() {
+            return splat_file_reader_read(&reader, CONVERT_BLOCK_SPLATS, next_raw);
+        });
+        gaussian_splat_resize(block, n, reader.from_ply);
+        parallel_for(n, options.threads, [&](size_t begin, size_t end) {
+            splat_file_reader_decode(&reader, raw.data() + begin * reader.record_size, end - begin, block, begin);
+        });
+        bool ok = fn(block);
+        n = next.get();
+        std::swap(raw, next_raw);
+        if (!ok) {
+            return false;
+        }
+    }
+    if (reader.had_error) {
+        for (const std::string &message : reader.warning_and_error_messages) {
+            std::cerr << message << std::endl;
+        }
+        return false;
+    }
+    return true;
+}
+
+// Appends splat i of src to dst
+static void append_splat(GaussianSplat &dst, const GaussianSplat &src, size_t i)
+{
+    dst.ws_positions.push_back(src.ws_positions[i]);
+    dst.colors.push_back(src.colors[i]);
+    dst.opacities.push_back(src.opacities[i]);
+    dst.scales.push_back(src.scales[i]);
+    dst.rotations.push_back(src.rotations[i]);
+    if (!src.shs.empty()) {
+        dst.shs.push_back(src.shs[i]);
+    }
+    dst.count = dst.ws_positions.size();
+}
+
+static void clear_splat(GaussianSplat &splat)
+{
+    splat.count = 0;
+    splat.ws_positions.clear();
+    splat.colors.clear();
+    splat.shs.clear();
+    splat.opacities.clear();
+    splat.scales.clear();
+    splat.rotations.clear();
+}
+
+//
+// Morton order
+//
+
+// Spreads the low 21 bits of v out to every third bit
+static uint64_t spread_bits(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+static uint64_t morton_code(glm::vec3 position, glm::vec3 lo, glm::vec3 inverse_extent)
+{
+    glm::vec3 t = glm::clamp((position - lo) * inverse_extent, 0.0f, 1.0f) * float(0x1fffff);
+    return spread_bits(uint64_t(t.x)) | spread_bits(uint64_t(t.y)) << 1 | spread_bits(uint64_t(t.z)) << 2;
+}
+
+typedef struct {
+    uint64_t code;
+    uint32_t index;
+} SortKey;
+
+static bool operator<(const SortKey &a, const SortKey &b)
+{
+    return a.code < b.code || (a.code == b.code && a.index < b.index);
+}
+
+// Sorts slices on all threads and merges them pairwise
+static void parallel_sort(std::vector<SortKey> &keys, int threads)
+{
+    size_t slice = std::max<size_t>((keys.size() + size_t(threads) - 1) / size_t(threads), 1);
+    parallel_for(keys.size(), threads, [&keys](size_t begin, size_t end) {
+        std::sort(keys.begin() + begin, keys.begin() + end);
+    });
+    for (; slice < keys.size(); slice *= 2) {
+        size_t pairs = (keys.size() + 2 * slice - 1) / (2 * slice);
+        parallel_for(pairs, threads, [&keys, slice](size_t first, size_t last) {
+            for (size_t pair = first; pair < last; pair++) {
+                size_t begin = pair * 2 * slice;
+                size_t middle = std::min(begin + slice, keys.size());
+                size_t end = std::min(begin + 2 * slice, keys.size());
+                std::inplace_merge(keys.begin() + begin, keys.begin() + middle, keys.begin() + end);
+            }
+        });
+    }
+}
+
+//
+// Sort runs. A run is a temporary file of rows in Morton order: the code, then the attributes,
+// then the spherical harmonics if the output keeps them.
+//
+
+typedef struct {
+    uint64_t code;
+    float position[3];
+    float color[3];
+    float opacity;
+    float scale[3];
+    float rotation[4];
+} RunRow;
+
+static size_t run_row_size(bool with_shs)
+{
+    return sizeof(RunRow) + (with_shs ? sizeof(SphericalHarmonics) : 0);
+}
+
+static void pack_run_row(const GaussianSplat &splat, const SortKey &key, bool with_shs, unsigned char *out)
+{
+    size_t i = key.index;
+    RunRow row;
+    row.code = key.code;
+    memcpy(row.position, &splat.ws_positions[i].x, sizeof(row.position));
+    memcpy(row.color, &splat.colors[i].x, sizeof(row.color));
+    row.opacity = splat.opacities[i];
+    memcpy(row.scale, &splat.scales[i].x, sizeof(row.scale));
+    memcpy(row.rotation, &splat.rotations[i].x, sizeof(row.rotation));
+    memcpy(out, &row, sizeof(row));
+    if (with_shs) {
+        memcpy(out + sizeof(row), &splat.shs[i], sizeof(SphericalHarmonics));
+    }
+}
+
+static void append_run_row(GaussianSplat &dst, const unsigned char *in, bool with_shs)
+{
+    RunRow row;
+    memcpy(&row, in, sizeof(row));
+    dst.ws_positions.push_back(glm::vec3(row.position[0], row.position[1], row.position[2]));
+    dst.colors.push_back(glm::vec3(row.color[0], row.color[1], row.color[2]));
+    dst.opacities.push_back(row.opacity);
+    dst.scales.push_back(glm::vec3(row.scale[0], row.scale[1], row.scale[2]));
+    dst.rotations.push_back(glm::vec4(row.rotation[0], row.rotation[1], row.rotation[2], row.rotation[3]));
+    if (with_shs) {
+        SphericalHarmonics sh;
+        memcpy(&sh, in + sizeof(row), sizeof(sh));
+        dst.shs.push_back(sh);
+    }
+    dst.count = dst.ws_positions.size();
+}
+
+typedef struct {
+    std::ifstream file;
+    std::vector<unsigned char> buffer;
+    size_t position = 0; // In buffer
+    size_t filled = 0;
+    size_t remaining = 0; // Rows not read from the file yet
+} RunCursor;
+
+static bool run_cursor_fill(RunCursor &cursor, size_t row_size)
+{
+    size_t n = std::min<size_t>(CONVERT_MERGE_BUFFER_SPLATS, cursor.remaining);
+    cursor.buffer.resize(n * row_size);
+    cursor.file.read(reinterpret_cast<char *>(cursor.buffer.data()), std::streamsize(cursor.buffer.size()));
+    cursor.position = 0;
+    cursor.filled = n;
+    cursor.remaining -= n;
+    return bool(cursor.file);
+}
+
+static uint64_t run_cursor_code(const RunCursor &cursor, size_t row_size)
+{
+    uint64_t code;
+    memcpy(&code, cursor.buffer.data() + cursor.position * row_size, sizeof(code));
+    return code;
+}
+
+//
+// Output
+//
+
+typedef struct {
+    OutputKind kind;
+    std::string path;
+    std::ofstream file;
+    bool with_shs = false;
+    size_t written = 0;
+    std::streamoff count_offset = 0; // Of the vertex count in the .ply header
+
+    // .psplat
+    PagedSplatWriter paged;
+    GaussianSplat page;
+    size_t page_count = 0;
+    size_t pages_written = 0;
+    size_t splat_count = 0;
+
+    // .csplat
+    CompressedSplatWriter compressed;
+} OutputFile;
+
+// Wide enough for any count, so the header can be patched once the count is known
+#define PLY_COUNT_DIGITS 20
+
+static bool output_open(OutputFile *output, const ConvertOptions &options, size_t count, bool with_shs, std::string *error)
+{
+    output->kind = options.output_kind;
+    output->path = options.output_path;
+    output->with_shs = with_shs;
+    if (output->kind == OUTPUT_PAGED) {
+        output->splat_count = count;
+        output->page_count = std::max<size_t>((count + PAGED_SPLAT_PAGE_CAPACITY - 1) / PAGED_SPLAT_PAGE_CAPACITY, 1);
+        return paged_splat_writer_open(&output->paged, output->path, options.format, output->page_count, error);
+    }
+    if (output->kind == OUTPUT_COMPRESSED) {
+        return compressed_splat_writer_open(&output->compressed, output->path, with_shs, options.threads, error);
+    }
+
+    output->file.open(output->path, std::ios::binary | std::ios::trunc);
+    if (!output->file.is_open()) {
+        *error = "Error: Could not open " + output->path + " for writing";
+        return false;
+    }
+    if (output->kind == OUTPUT_PLY) {
+        output->file << "ply\nformat binary_little_endian 1.0\nelement vertex ";
+        output->count_offset = output->file.tellp();
+        output->file << std::string(PLY_COUNT_DIGITS, '0') << "\n";
+        output->file << "property float x\nproperty float y\nproperty float z\n";
+        output->file << "property float nx\nproperty float ny\nproperty float nz\n";
+        for (int i = 0; i < 3; i++) {
+            output->file << "property float f_dc_" << i << "\n";
+        }
+        for (int i = 0; i < SPHERICAL_HARMONICS_COEFFS_COUNT; i++) {
+            output->file << "property float f_rest_" << i << "\n";
+        }
+        output->file << "property float opacity\n";
+        for (int i = 0; i < 3; i++) {
+            output->file << "property float scale_" << i << "\n";
+        }
+        for (int i = 0; i < 4; i++) {
+            output->file << "property float rot_" << i << "\n";
+        }
+        output->file << "end_header\n";
+    }
+    return bool(output->file);
+}
+
+// Same layout as read by plyParser.cpp, with the activations undone
+static void encode_ply(const GaussianSplat &splat, size_t i, unsigned char *out)
+{
+    float data[62] = {};
+    glm::vec3 p = splat.ws_positions[i];
+    data[0] = -p.x;
+    data[1] = -p.y;
+    data[2] = p.z;
+    glm::vec3 dc = (splat.colors[i] - 0.5f) / SH_C0;
+    data[6] = dc.x;
+    data[7] = dc.y;
+    data[8] = dc.z;
+    if (!splat.shs.empty()) {
+        memcpy(data + 9, splat.shs[i].coeffs, sizeof(splat.shs[i].coeffs));
+    }
+    float opacity = glm::clamp(splat.opacities[i], 1e-6f, 1.0f - 1e-6f);
+    data[54] = std::log(opacity / (1.0f - opacity));
+    glm::vec3 scale = glm::log(glm::max(splat.scales[i], glm::vec3(1e-30f)));
+    data[55] = scale.x;
+    data[56] = scale.y;
+    data[57] = scale.z;
+    memcpy(data + 58, &splat.rotations[i].x, 4 * sizeof(float));
+    memcpy(out, data, sizeof(data));
+}
+
+static unsigned char to_byte(float value)
+{
+    return (unsigned char)(glm::clamp(std::round(value), 0.0f, 255.0f));
+}
+
+// 32 byte records, see splat_file_reader_open()
+static void encode_splat(const GaussianSplat &splat, size_t i, unsigned char *out)
+{
+    glm::vec3 p = splat.ws_positions[i];
+    float f[6] = { -p.x, -p.y, p.z, splat.scales[i].x, splat.scales[i].y, splat.scales[i].z };
+    memcpy(out, f, sizeof(f));
+    glm::vec3 color = splat.colors[i] * 255.0f;
+    out[24] = to_byte(color.r);
+    out[25] = to_byte(color.g);
+    out[26] = to_byte(color.b);
+    out[27] = to_byte(splat.opacities[i] * 255.0f);
+    glm::vec4 rotation = splat.rotations[i] * 128.0f + 128.0f;
+    out[28] = to_byte(rotation.x);
+    out[29] = to_byte(rotation.y);
+    out[30] = to_byte(rotation.z);
+    out[31] = to_byte(rotation.w);
+}
+
+static bool output_flush_page(OutputFile *output, std::string *error)
+{
+    bool ok = paged_splat_writer_add_page(&output->paged, output->page, error);
+    output->pages_written++;
+    clear_splat(output->page);
+    return ok;
+}
+
+static bool output_write(OutputFile *output, const GaussianSplat &block, int threads, std::string *error)
+{
+    size_t count = block.ws_positions.size();
+    if (output->kind == OUTPUT_PAGED) {
+        // Spread the splats evenly over the pages, instead of leaving a small last page
+        for (size_t i = 0; i < count; i++) {
+            append_splat(output->page, block, i);
+            size_t page_size = output->splat_count / output->page_count +
+                               (output->pages_written < output->splat_count % output->page_count ? 1 : 0);
+            if (output->page.count == page_size && !output_flush_page(output, error)) {
+                return false;
+            }
+        }
+        output->written += count;
+        return true;
+    }
+    if (output->kind == OUTPUT_COMPRESSED) {
+        output->written += count;
+        return compressed_splat_writer_add(&output->compressed, block, error);
+    }
+
+    size_t record_size = output->kind == OUTPUT_PLY ? 62 * sizeof(float) : 32;
+    std::vector<unsigned char> records(count * record_size);
+    parallel_for(count, threads, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (output->kind == OUTPUT_PLY) {
+                encode_ply(block, i, records.data() + i * record_size);
+            } else {
+                encode_splat(block, i, records.data() + i * record_size);
+            }
+        }
+    });
+    output->file.write(reinterpret_cast<const char *>(records.data()), std::streamsize(records.size()));
+    output->written += count;
+    if (!output->file) {
+        *error = "Error: Failed writing " + output->path;
+        return false;
+    }
+    return true;
+}
+
+static bool output_close(OutputFile *output, std::string *error)
+{
+    if (output->kind == OUTPUT_PAGED) {
+        if (output->page.count > 0 && !output_flush_page(output, error)) {
+            return false;
+        }
+        return paged_splat_writer_close(&output->paged, error);
+    }
+    if (output->kind == OUTPUT_COMPRESSED) {
+        if (!compressed_splat_writer_close(&output->compressed, error)) {
+            return false;
+        }
+        uint64_t raw, compressed;
+        compressed_splat_writer_sizes(&output->compressed, &raw, &compressed);
+        printf("Compressed %zu chunks from %.1f MB to %.1f MB, %.2fx\n", output->compressed.chunks.size(),
+               double(raw) / 1e6, double(compressed) / 1e6, double(raw) / double(std::max<uint64_t>(compressed, 1)));
+        return true;
+    }
+    if (output->kind == OUTPUT_PLY) {
+        char digits[PLY_COUNT_DIGITS + 1];
+        snprintf(digits, sizeof(digits), "%0*zu", PLY_COUNT_DIGITS, output->written);
+        output->file.seekp(output->count_offset);
+        output->file.write(digits, PLY_COUNT_DIGITS);
+    }
+    output->file.close();
+    if (!output->file) {
+        *error = "Error: Failed writing " + output->path;
+        return false;
+    }
+    return true;
+}
+
+//
+// Conversion
+//
+
+// Input order, a single pass
+static bool convert_streaming(const ConvertOptions &options, size_t input_bytes, bool input_is_ply)
+{
+    auto start = std::chrono::steady_clock::now();
+    OutputFile output;
+    std::string error;
+    if (!output_open(&output, options, 0, input_is_ply, &error)) {
+        std::cerr << error << std::endl;
+        return false;
+    }
+    SplatPruneStats prune_stats;
+    bool ok = for_each_block(options, [&](GaussianSplat &block) {
+        gaussian_splat_prune(block, options.prune, &prune_stats);
+        return output_write(&output, block, options.threads, &error);
+    });
+    if (!ok || !output_close(&output, &error)) {
+        std::cerr << error << std::endl;
+        return false;
+    }
+    print_pass("convert", input_bytes, seconds_since(start));
+    printf("Wrote %zu splats to %s\n%s\n", output.written, options.output_path.c_str(),
+           splat_prune_describe(prune_stats).c_str());
+    return true;
+}
+
+// Morton order, by an external merge sort
+static bool convert_sorted(const ConvertOptions &options, size_t input_bytes, bool input_is_ply)
+{
+    // Only .ply and .csplat store spherical harmonics, there is no use sorting them otherwise
+    bool with_shs = input_is_ply && (options.output_kind == OUTPUT_PLY || options.output_kind == OUTPUT_COMPRESSED);
+    size_t row_size = run_row_size(with_shs);
+    // The decoded run, its keys and its packed rows
+    size_t bytes_per_splat = sizeof(glm::vec3) * 3 + sizeof(float) + sizeof(glm::vec4) + sizeof(SortKey) + row_size +
+                             (input_is_ply ? sizeof(SphericalHarmonics) : 0);
+    size_t run_capacity = std::min<size_t>(std::max<size_t>(options.memory_bytes / bytes_per_splat, CONVERT_BLOCK_SPLATS),
+                                           std::numeric_limits<uint32_t>::max());
+
+    // Pass 1: bounds of the kept splats, for the Morton codes
+    auto start = std::chrono::steady_clock::now();
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    size_t kept_count = 0;
+    bool ok = for_each_block(options, [&](GaussianSplat &block) {
+        for (size_t i = 0; i < block.count; i++) {
+            if (splat_prune_test(options.prune, block, i) == SPLAT_PRUNE_KEEP) {
+                lo = glm::min(lo, block.ws_positions[i]);
+                hi = glm::max(hi, block.ws_positions[i]);
+                kept_count++;
+            }
+        }
+        return true;
+    });
+    if (!ok) {
+        return false;
+    }
+    print_pass("bounds", input_bytes, seconds_since(start));
+    if (kept_count == 0) {
+        std::cerr << "Error: No splats left to write" << std::endl;
+        return false;
+    }
+    glm::vec3 inverse_extent = glm::vec3(1.0f) / glm::max(hi - lo, glm::vec3(1e-20f));
+
+    // Pass 2: sorted runs. A single run is written straight from memory. Coincident splats are
+    // merged within each run.
+    start = std::chrono::steady_clock::now();
+    bool single_run = kept_count <= run_capacity;
+    SplatPruneStats prune_stats;
+    std::vector<std::string> run_paths;
+    std::vector<size_t> run_sizes;
+    GaussianSplat run;
+    std::vector<SortKey> keys;
+    std::vector<unsigned char> rows;
+    auto merge_run = [&]() {
+        if (options.prune.merge_distance > 0.0f) {
+            gaussian_splat_merge_coincident(run, options.prune.merge_distance, &prune_stats);
+        }
+    };
+    auto sort_run = [&]() {
+        keys.resize(run.count);
+        parallel_for(run.count, options.threads, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                keys[i] = { morton_code(run.ws_positions[i], lo, inverse_extent), uint32_t(i) };
+            }
+        });
+        parallel_sort(keys, options.threads);
+    };
+    auto spill_run = [&]() {
+        merge_run();
+        sort_run();
+        rows.resize(run.count * row_size);
+        parallel_for(run.count, options.threads, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                pack_run_row(run, keys[i], with_shs, rows.data() + i * row_size);
+            }
+        });
+        std::string path = options.output_path + ".run" + std::to_string(run_paths.size()) + ".tmp";
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(rows.data()), std::streamsize(rows.size()));
+        run_paths.push_back(path);
+        run_sizes.push_back(run.count);
+        clear_splat(run);
+        if (!file) {
+            std::cerr << "Error: Failed writing " << path << std::endl;
+            return false;
+        }
+        return true;
+    };
+    auto remove_runs = [&run_paths]() {
+        for (const std::string &path : run_paths) {
+            std::error_code ignored;
+            std::filesystem::remove(path, ignored);
+        }
+    };
+
+    ok = for_each_block(options, [&](GaussianSplat &block) {
+        if (!with_shs) {
+            // Not needed for the output, and by far the biggest attribute
+            block.shs.clear();
+        }
+        prune_stats.input += block.count;
+        for (size_t i = 0; i < block.count; i++) {
+            SplatPruneReason reason = splat_prune_test(options.prune, block, i);
+            if (reason != SPLAT_PRUNE_KEEP) {
+                prune_stats.removed[reason]++;
+                continue;
+            }
+            append_splat(run, block, i);
+            if (run.count == run_capacity && !single_run && !spill_run()) {
+                return false;
+            }
+        }
+        return true;
+    });
+    if (ok && !single_run && run.count > 0) {
+        ok = spill_run();
+    }
+    if (!ok) {
+        remove_runs();
+        return false;
+    }
+    if (single_run) {
+        merge_run();
+        sort_run();
+    }
+    kept_count = prune_stats.input - splat_prune_removed(prune_stats);
+    print_pass(single_run ? "sort" : "runs", input_bytes, seconds_since(start));
+
+    // Pass 3: merge the runs into the output
+    start = std::chrono::steady_clock::now();
+    OutputFile output;
+    std::string error;
+    ok = output_open(&output, options, kept_count, with_shs, &error);
+    GaussianSplat block;
+    if (ok && single_run) {
+        for (size_t begin = 0; ok && begin < keys.size(); begin += CONVERT_BLOCK_SPLATS) {
+            clear_splat(block);
+            for (size_t i = begin; i < std::min(keys.size(), begin + CONVERT_BLOCK_SPLATS); i++) {
+                append_splat(block, run, keys[i].index);
+            }
+            ok = output_write(&output, block, options.threads, &error);
+        }
+    } else if (ok) {
+        std::vector<RunCursor> cursors(run_paths.size());
+        typedef std::pair<uint64_t, size_t> HeapEntry; // Code and run, lowest first
+        std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+        for (size_t r = 0; ok && r < cursors.size(); r++) {
+            cursors[r].file.open(run_paths[r], std::ios::binary);
+            cursors[r].remaining = run_sizes[r];
+            ok = run_cursor_fill(cursors[r], row_size);
+            heap.push({ run_cursor_code(cursors[r], row_size), r });
+        }
+        if (!ok) {
+            error = "Error: Failed reading the sort runs";
+        }
+        while (ok && !heap.empty()) {
+            size_t r = heap.top().second;
+            heap.pop();
+            RunCursor &cursor = cursors[r];
+            append_run_row(block, cursor.buffer.data() + cursor.position * row_size, with_shs);
+            cursor.position++;
+            if (cursor.position == cursor.filled && cursor.remaining > 0 && !run_cursor_fill(cursor, row_size)) {
+                error = "Error: Failed reading the sort runs";
+                ok = false;
+            }
+            if (cursor.position < cursor.filled) {
+                heap.push({ run_cursor_code(cursor, row_size), r });
+            }
+            if (ok && (block.count == CONVERT_BLOCK_SPLATS || heap.empty())) {
+                ok = output_write(&output, block, options.threads, &error);
+                clear_splat(block);
+            }
+        }
+    }
+    remove_runs();
+    if (!ok || !output_close(&output, &error)) {
+        std::cerr << error << std::endl;
+        return false;
+    }
+    std::error_code size_error;
+    print_pass("write", size_t(std::filesystem::file_size(options.output_path, size_error)), seconds_since(start));
+    printf("Wrote %zu splats in Morton order to %s from %zu run%s\n%s\n", output.written,
+           options.output_path.c_str(), std::max<size_t>(run_paths.size(), 1), run_paths.size() > 1 ? "s" : "",
+           splat_prune_describe(prune_stats).c_str());
+    return true;
+}
+
+int main(int argc, const char* argv[])
+{
+    arrrgh::parser parser("splat-convert", "Convert Gaussian splats between .ply, .splat, paged .psplat and compressed .csplat files");
+    const auto& showHelp = parser.add<bool>("help", "Show this help message.", 'h', arrrgh::Optional, false);
+    const auto& input = parser.add<std::string>("input", "Model to convert, .ply or .splat.", 'i', arrrgh::Required, "");
+    const auto& output = parser.add<std::string>("output", "File to write, .ply, .splat, .psplat or .csplat.", 'o', arrrgh::Required, "");
+    const auto& splatLayout = parser.add<std::string>("splat-layout", "GPU format of .psplat output: float32 or compact.", 'l', arrrgh::Optional, "compact");
+    const auto& morton = parser.add<bool>("morton", "Write .ply and .splat output in Morton order. Always done for .psplat and .csplat.", 'z', arrrgh::Optional, false);
+    const auto& prune = parser.add<std::string>("prune", "Drop splats, e.g. 'opacity=0.005,min-scale=1e-4,max-scale=20,contribution=1e-7,merge=0.001'. Merging implies --morton.", 'p', arrrgh::Optional, "");
+    const auto& threads = parser.add<int>("threads", "Worker threads, 0 for one per core.", 'j', arrrgh::Optional, 0);
+    const auto& memory = parser.add<int>("memory", "Memory budget in MB for sorting. Bigger inputs are sorted in runs on disk.", 'm', arrrgh::Optional, CONVERT_DEFAULT_MEGABYTES);
+
+    try {
+        parser.parse(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error parsing arguments: " << e.what() << std::endl;
+        parser.show_usage(std::cerr);
+        return EXIT_FAILURE;
+    }
+    if (showHelp.value()) {
+        parser.show_usage(std::cout);
+        return EXIT_SUCCESS;
+    }
+
+    ConvertOptions options;
+    options.input_path = input.value();
+    options.output_path = output.value();
+    options.morton = morton.value();
+    std::string prune_error;
+    if (!splat_prune_options_parse(prune.value(), &options.prune, &prune_error)) {
+        std::cerr << prune_error << std::endl;
+        return EXIT_FAILURE;
+    }
+    // Merging needs the splats of a neighbourhood together, which only the sort runs have
+    options.morton = options.morton || options.prune.merge_distance > 0.0f;
+    options.threads = threads.value() > 0 ? threads.value() : parallel_thread_count();
+    options.memory_bytes = size_t(std::max(memory.value(), 1)) * 1024 * 1024;
+    if (!splat_format_from_name(splatLayout.value(), &options.format)) {
+        std::cerr << "Error: Unknown splat layout " << splatLayout.value() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string output_extension = std::filesystem::path(options.output_path).extension().string();
+    std::transform(output_extension.begin(), output_extension.end(), output_extension.begin(), ::tolower);
+    if (output_extension == ".ply") {
+        options.output_kind = OUTPUT_PLY;
+    } else if (output_extension == ".splat") {
+        options.output_kind = OUTPUT_SPLAT;
+    } else if (output_extension == PAGED_SPLAT_EXTENSION) {
+        options.output_kind = OUTPUT_PAGED;
+        options.morton = true;
+    } else if (output_extension == COMPRESSED_SPLAT_EXTENSION) {
+        // Spatially coherent chunks compress better and can be read on their own
+        options.output_kind = OUTPUT_COMPRESSED;
+        options.morton = true;
+    } else {
+        std::cerr << "Error: Unsupported output format " << output_extension << ", use .ply, .splat, .psplat or .csplat" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::error_code size_error;
+    size_t input_bytes = size_t(std::filesystem::file_size(options.input_path, size_error));
+    std::string input_extension = std::filesystem::path(options.input_path).extension().string();
+    std::transform(input_extension.begin(), input_extension.end(), input_extension.begin(), ::tolower);
+    bool input_is_ply = input_extension == ".ply";
+
+    printf("Converting %s (%.1f MB) to %s on %d threads\n", options.input_path.c_str(), double(input_bytes) / 1e6,
+           options.output_path.c_str(), options.threads);
+    auto start = std::chrono::steady_clock::now();
+    bool ok = options.morton ? convert_sorted(options, input_bytes, input_is_ply)
+                             : convert_streaming(options, input_bytes, input_is_ply);
+    if (!ok) {
+        return EXIT_FAILURE;
+    }
+    print_pass("total", input_bytes, seconds_since(start));
+    return EXIT_SUCCESS;
+}